@@ -13,7 +13,10 @@
  * from the use of this software.
  */
 
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_CACHE
+
 #include <libpkgconf/libpkgconf.h>
+#include <libpkgconf/probes.h>
 
 /*
  * !doc
@@ -25,7 +28,10 @@
  * avoid loading duplicate copies of a package/module.
  *
  * A cache is tied to a specific pkgconf client object, so package objects should not
- * be shared across threads.
+ * be shared across threads, unless they were obtained from a package pool (see the `pool`
+ * module).  Each cache holds one reference to every package it contains, and since a pooled
+ * package may be present in the caches of several clients at once, cache entries are
+ * allocated separately from the package objects.
  */
 
 /*
@@ -45,20 +51,17 @@
 pkgconf_pkg_t *
 pkgconf_cache_lookup(const pkgconf_client_t *client, const char *id)
 {
-	pkgconf_node_t *node;
+	pkgconf_pkg_t *pkg = pkgconf_hash_lookup(&client->pkg_cache_ids, id);
 
-	PKGCONF_FOREACH_LIST_ENTRY(client->pkg_cache.head, node)
+	if (pkg != NULL)
 	{
-		pkgconf_pkg_t *pkg = node->data;
-
-		if (!strcmp(pkg->id, id))
-		{
-			PKGCONF_TRACE(client, "found: %s @%p", id, pkg);
-			return pkgconf_pkg_ref(client, pkg);
-		}
+		PKGCONF_TRACE_VERBOSE(client, "found: %s @%p", id, pkg);
+		PKGCONF_PROBE2(cache__lookup, id, 1);
+		return pkgconf_pkg_ref(client, pkg);
 	}
 
-	PKGCONF_TRACE(client, "miss: %s", id);
+	PKGCONF_TRACE_VERBOSE(client, "miss: %s", id);
+	PKGCONF_PROBE2(cache__lookup, id, 0);
 	return NULL;
 }
 
@@ -77,11 +80,21 @@ pkgconf_cache_lookup(const pkgconf_client_t *client, const char *id)
 void
 pkgconf_cache_add(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 {
+	pkgconf_node_t *node;
+
 	if (pkg == NULL)
 		return;
 
+	node = calloc(sizeof(pkgconf_node_t), 1);
+
+	/* shared packages are immutable, they were flagged before being shared */
+	if (!(pkg->flags & PKGCONF_PKG_PROPF_SHARED))
+		pkg->flags |= PKGCONF_PKG_PROPF_CACHED;
+
 	pkgconf_pkg_ref(client, pkg);
-	pkgconf_node_insert(&pkg->cache_iter, pkg, &client->pkg_cache);
+	pkgconf_node_insert(node, pkg, &client->pkg_cache);
+	pkgconf_hash_insert(&client->pkg_cache_ids, pkg->id, pkg);
+	pkgconf_hash_insert(&client->pkg_cache_nodes, pkg, node);
 
 	PKGCONF_TRACE(client, "added @%p to cache", pkg);
 }
@@ -100,12 +113,17 @@ pkgconf_cache_add(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 void
 pkgconf_cache_remove(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 {
-	if (pkg == NULL)
+	pkgconf_node_t *node;
+
+	if (pkg == NULL || (node = pkgconf_hash_lookup(&client->pkg_cache_nodes, pkg)) == NULL)
 		return;
 
 	PKGCONF_TRACE(client, "removed @%p from cache", pkg);
 
-	pkgconf_node_delete(&pkg->cache_iter, &client->pkg_cache);
+	pkgconf_hash_remove(&client->pkg_cache_ids, pkg->id, pkg);
+	pkgconf_hash_remove(&client->pkg_cache_nodes, pkg, node);
+	pkgconf_node_delete(node, &client->pkg_cache);
+	free(node);
 }
 
 /*
@@ -115,22 +133,29 @@ pkgconf_cache_remove(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
  *
  *    Releases all resources related to a client object's package cache.
  *    This function should only be called to clear a client object's package cache,
- *    as it may release any package in the cache.
+ *    as it may release any package in the cache.  Shared packages only lose the
+ *    reference held by the cache.
  *
  *    :param pkgconf_client_t* client: The client object to modify.
  */
 void
 pkgconf_cache_free(pkgconf_client_t *client)
 {
+	pkgconf_list_t cache = client->pkg_cache;
 	pkgconf_node_t *iter, *iter2;
 
-	PKGCONF_FOREACH_LIST_ENTRY_SAFE(client->pkg_cache.head, iter2, iter)
+	/* detach the entries first, so that freeing a package does not find itself in the cache */
+	memset(&client->pkg_cache, 0, sizeof client->pkg_cache);
+	pkgconf_hash_deinit(&client->pkg_cache_ids);
+	pkgconf_hash_deinit(&client->pkg_cache_nodes);
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(cache.head, iter2, iter)
 	{
 		pkgconf_pkg_t *pkg = iter->data;
+
+		free(iter);
 		pkgconf_pkg_free(client, pkg);
 	}
 
-	memset(&client->pkg_cache, 0, sizeof client->pkg_cache);
-
 	PKGCONF_TRACE(client, "cleared package cache");
 }
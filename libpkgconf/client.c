@@ -13,6 +13,8 @@
  * from the use of this software.
  */
 
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_CLIENT
+
 #include <libpkgconf/libpkgconf.h>
 
 /*
@@ -25,8 +27,12 @@
  * Client objects store all necessary state for libpkgconf allowing for multiple instances to run
  * in parallel.
  *
- * Client objects are not thread safe, in other words, a client object should not be shared across
- * thread boundaries.
+ * A client object may only be used from one thread at a time while it is being set up or while it loads
+ * packages.  Once every package a query reaches is in its package cache, the client is only read from,
+ * and such a warm client can serve queries from several threads at once, as described in the `queue`
+ * module.  The library keeps no other mutable state, so independent clients can resolve packages on
+ * different threads at the same time.  Clients on different threads may also share parsed packages
+ * through a package pool, see the `pool` module, or start from a clone of a warm client.
  */
 
 static void
@@ -61,6 +67,10 @@ pkgconf_client_init(pkgconf_client_t *client, pkgconf_error_handler_func_t error
 	client->error_handler_data = error_handler_data;
 	client->error_handler = error_handler;
 	client->auditf = NULL;
+	client->not_found_notice_sent = false;
+
+	pkgconf_hash_init(&client->pkg_cache_ids, pkgconf_hash_str, pkgconf_hash_str_equal);
+	pkgconf_hash_init(&client->pkg_cache_nodes, pkgconf_hash_ptr, pkgconf_hash_ptr_equal);
 
 	if (client->trace_handler == NULL)
 		pkgconf_client_set_trace_handler(client, NULL, NULL);
@@ -113,6 +123,88 @@ pkgconf_client_new(pkgconf_error_handler_func_t error_handler, void *error_handl
 	return out;
 }
 
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_client_t* pkgconf_client_clone(pkgconf_client_t *parent)
+ *
+ *    Allocate a pkgconf client object with the settings of another one.  Unlike ``pkgconf_client_new()``,
+ *    this does not read the environment or check the filesystem: the clone gets copies of the parent's
+ *    search paths, filtered system directories, global variables, flags and handlers, and starts with the
+ *    packages of the parent's cache, which are shared with the parent rather than parsed again.
+ *
+ *    To share them, cloning modifies the parent: every package in its cache gets the
+ *    ``PKGCONF_PKG_PROPF_SHARED`` flag, like the packages obtained from a package pool, and keeps it for
+ *    good.  Those packages are immutable from then on, and ``pkgconf_pkg_free()`` on them only drops a
+ *    reference, for the parent as well.  Beyond that, the clone is independent: packages loaded by either
+ *    client afterwards are neither shared nor seen by the other one, and settings changed on either client
+ *    do not affect the other one.  Timings, profiles, trace buffers and prefetch workers are not inherited.
+ *    The clone uses the package pool of the parent, if it has one.
+ *
+ *    The parent must not be in use on another thread while it is being cloned.  Once created, a clone may
+ *    be used on any thread.
+ *
+ *    :param pkgconf_client_t* parent: The client to clone.
+ *    :return: A pkgconf client object.
+ *    :rtype: pkgconf_client_t*
+ */
+pkgconf_client_t *
+pkgconf_client_clone(pkgconf_client_t *parent)
+{
+	pkgconf_client_t *out = calloc(sizeof(pkgconf_client_t), 1);
+	pkgconf_node_t *n;
+
+	pkgconf_hash_init(&out->pkg_cache_ids, pkgconf_hash_str, pkgconf_hash_str_equal);
+	pkgconf_hash_init(&out->pkg_cache_nodes, pkgconf_hash_ptr, pkgconf_hash_ptr_equal);
+
+	out->trace_filter = parent->trace_filter;
+	pkgconf_client_set_trace_handler(out, parent->trace_handler, parent->trace_handler_data);
+	pkgconf_client_set_error_handler(out, parent->error_handler, parent->error_handler_data);
+	pkgconf_client_set_warn_handler(out, parent->warn_handler, parent->warn_handler_data);
+
+	out->auditf = parent->auditf;
+	out->flags = parent->flags;
+
+	if (parent->sysroot_dir != NULL)
+		out->sysroot_dir = strdup(parent->sysroot_dir);
+	out->sysroot_dir_len = parent->sysroot_dir_len;
+
+	if (parent->buildroot_dir != NULL)
+		out->buildroot_dir = strdup(parent->buildroot_dir);
+
+	out->prefix_varname = strdup(parent->prefix_varname);
+
+	pkgconf_path_copy_list(&out->dir_list, &parent->dir_list);
+	pkgconf_path_copy_list(&out->filter_libdirs, &parent->filter_libdirs);
+	pkgconf_path_copy_list(&out->filter_includedirs, &parent->filter_includedirs);
+
+	/* variables are prepended, walk backwards to keep their order */
+	PKGCONF_FOREACH_LIST_ENTRY_REVERSE(parent->global_vars.tail, n)
+	{
+		const pkgconf_tuple_t *tuple = n->data;
+
+		pkgconf_tuple_add_global(out, tuple->key, tuple->value);
+	}
+
+	/* once shared, freeing a package only drops a reference, so both caches can hold one */
+	PKGCONF_FOREACH_LIST_ENTRY_REVERSE(parent->pkg_cache.tail, n)
+	{
+		pkgconf_pkg_t *pkg = n->data;
+
+		/* shared packages are immutable, they may be in use on other threads */
+		if (!(pkg->flags & PKGCONF_PKG_PROPF_SHARED))
+			pkg->flags |= PKGCONF_PKG_PROPF_SHARED;
+
+		pkgconf_cache_add(out, pkg);
+	}
+
+	pkgconf_client_set_pool(out, parent->pool);
+
+	PKGCONF_TRACE(out, "cloned client @%p from @%p", out, parent);
+
+	return out;
+}
+
 /*
  * !doc
  *
@@ -128,6 +220,13 @@ pkgconf_client_deinit(pkgconf_client_t *client)
 {
 	PKGCONF_TRACE(client, "deinit @%p", client);
 
+	/* stop the workers first, they read the settings released below */
+	pkgconf_client_set_prefetch_threads(client, 0);
+	pkgconf_client_set_trace_buffer(client, 0);
+	pkgconf_client_set_timings(client, false);
+	pkgconf_client_set_trace_events(client, NULL);
+	pkgconf_client_set_profile(client, false);
+
 	if (client->prefix_varname != NULL)
 		free(client->prefix_varname);
 
@@ -139,7 +238,11 @@ pkgconf_client_deinit(pkgconf_client_t *client)
 
 	pkgconf_tuple_free_global(client);
 	pkgconf_path_free(&client->dir_list);
+	pkgconf_path_free(&client->filter_libdirs);
+	pkgconf_path_free(&client->filter_includedirs);
 	pkgconf_cache_free(client);
+
+	pkgconf_client_set_pool(client, NULL);
 }
 
 /*
@@ -197,6 +300,7 @@ pkgconf_client_set_sysroot_dir(pkgconf_client_t *client, const char *sysroot_dir
 		free(client->sysroot_dir);
 
 	client->sysroot_dir = sysroot_dir != NULL ? strdup(sysroot_dir) : NULL;
+	client->sysroot_dir_len = sysroot_dir != NULL ? strlen(sysroot_dir) : 0;
 
 	PKGCONF_TRACE(client, "set sysroot_dir to: %s", client->sysroot_dir != NULL ? client->sysroot_dir : "<default>");
 
@@ -297,39 +401,6 @@ pkgconf_warn(const pkgconf_client_t *client, const char *format, ...)
 	return client->warn_handler(errbuf, client, client->warn_handler_data);
 }
 
-/*
- * !doc
- *
- * .. c:function:: bool pkgconf_trace(const pkgconf_client_t *client, const char *filename, size_t len, const char *funcname, const char *format, ...)
- *
- *    Report a message to a client-registered trace handler.
- *
- *    :param pkgconf_client_t* client: The pkgconf client object to report the trace message to.
- *    :param char* filename: The file the function is in.
- *    :param size_t lineno: The line number currently being executed.
- *    :param char* funcname: The function name to use.
- *    :param char* format: A printf-style format string to use for formatting the trace message.
- *    :return: true if the trace handler processed the message, else false.
- *    :rtype: bool
- */
-bool
-pkgconf_trace(const pkgconf_client_t *client, const char *filename, size_t lineno, const char *funcname, const char *format, ...)
-{
-	char errbuf[PKGCONF_BUFSIZE];
-	size_t len;
-	va_list va;
-
-	len = snprintf(errbuf, sizeof errbuf, "%s:%zu [%s]: ", filename, lineno, funcname);
-
-	va_start(va, format);
-	vsnprintf(errbuf + len, sizeof(errbuf) - len, format, va);
-	va_end(va);
-
-	pkgconf_strlcat(errbuf, "\n", sizeof errbuf);
-
-	return client->trace_handler(errbuf, client, client->trace_handler_data);
-}
-
 /*
  * !doc
  *
@@ -375,7 +446,9 @@ pkgconf_client_get_flags(const pkgconf_client_t *client)
  *
  * .. c:function:: void pkgconf_client_set_flags(pkgconf_client_t *client, unsigned int flags)
  *
- *    Sets resolver-specific flags associated with a client object.
+ *    Sets resolver-specific flags associated with a client object.  The flags of a client govern how it finds and
+ *    parses packages; the way dependency graphs are resolved and walked is governed by the flags of each query
+ *    (see ``pkgconf_query_init()``), for which the flags of the client are the usual defaults.
  *
  *    :param pkgconf_client_t* client: The client object to set the resolver-specific flags on.
  *    :return: nothing
@@ -551,4 +624,6 @@ pkgconf_client_set_trace_handler(pkgconf_client_t *client, pkgconf_error_handler
 		client->trace_handler = pkgconf_default_error_handler;
 		PKGCONF_TRACE(client, "installing default trace handler");
 	}
+
+	client->trace_active = client->trace_buffer != NULL || client->trace_handler != pkgconf_default_error_handler;
 }
@@ -13,6 +13,8 @@
  * from the use of this software.
  */
 
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_DEPENDENCY
+
 #include <libpkgconf/libpkgconf.h>
 
 /*
@@ -36,12 +38,42 @@ typedef enum {
 
 #define DEBUG_PARSE 0
 
+/*
+ * !doc
+ *
+ * .. c:function:: const char *pkgconf_dependency_to_str_r(const pkgconf_dependency_t *dep, char *buf, size_t buflen)
+ *
+ *    Renders a dependency to a caller-supplied buffer.  Unlike ``pkgconf_dependency_to_str()``, this function
+ *    keeps no state of its own, so it can be used on several threads at once.
+ *
+ *    :param pkgconf_dependency_t* dep: The dependency to render.
+ *    :param char* buf: The buffer to render the dependency into.
+ *    :param size_t buflen: The size of the buffer.
+ *    :return: The dependency rendered as a string, which is `buf`.
+ *    :rtype: const char *
+ */
+const char *
+pkgconf_dependency_to_str_r(const pkgconf_dependency_t *dep, char *buf, size_t buflen)
+{
+	pkgconf_strlcpy(buf, dep->package, buflen);
+	if (dep->version != NULL)
+	{
+		pkgconf_strlcat(buf, " ", buflen);
+		pkgconf_strlcat(buf, pkgconf_pkg_get_comparator(dep), buflen);
+		pkgconf_strlcat(buf, " ", buflen);
+		pkgconf_strlcat(buf, dep->version, buflen);
+	}
+
+	return buf;
+}
+
 /*
  * !doc
  *
  * .. c:function:: const char *pkgconf_dependency_to_str(const pkgconf_dependency_t *dep)
  *
- *    Renders a dependency to a string.
+ *    Renders a dependency to a string.  The string is held in a static buffer, which is overwritten by the
+ *    next call, so threaded programs should use ``pkgconf_dependency_to_str_r()`` instead.
  *
  *    :param pkgconf_dependency_t* dep: The dependency to render.
  *    :return: The dependency rendered as a string.
@@ -52,32 +84,27 @@ pkgconf_dependency_to_str(const pkgconf_dependency_t *dep)
 {
 	static char outbuf[PKGCONF_BUFSIZE];
 
-	pkgconf_strlcpy(outbuf, dep->package, sizeof outbuf);
-	if (dep->version != NULL)
-	{
-		pkgconf_strlcat(outbuf, " ", sizeof outbuf);
-		pkgconf_strlcat(outbuf, pkgconf_pkg_get_comparator(dep), sizeof outbuf);
-		pkgconf_strlcat(outbuf, " ", sizeof outbuf);
-		pkgconf_strlcat(outbuf, dep->version, sizeof outbuf);
-	}
-
-	return outbuf;
+	return pkgconf_dependency_to_str_r(dep, outbuf, sizeof outbuf);
 }
 
 static inline pkgconf_dependency_t *
 pkgconf_dependency_addraw(const pkgconf_client_t *client, pkgconf_list_t *list, const char *package, size_t package_sz, const char *version, size_t version_sz, pkgconf_pkg_comparator_t compare)
 {
 	pkgconf_dependency_t *dep;
+	char depbuf[PKGCONF_BUFSIZE];
 
 	dep = calloc(sizeof(pkgconf_dependency_t), 1);
 	dep->package = pkgconf_strndup(package, package_sz);
 
 	if (version_sz != 0)
+	{
 		dep->version = pkgconf_strndup(version, version_sz);
+		dep->parsed_version = pkgconf_version_parse(dep->version);
+	}
 
 	dep->compare = compare;
 
-	PKGCONF_TRACE(client, "added dependency [%s] to list @%p", pkgconf_dependency_to_str(dep), list);
+	PKGCONF_TRACE_VERBOSE(client, "added dependency [%s] to list @%p", pkgconf_dependency_to_str_r(dep, depbuf, sizeof depbuf), list);
 	pkgconf_node_insert_tail(&dep->iter, dep, list);
 
 	return dep;
@@ -149,6 +176,7 @@ pkgconf_dependency_free(pkgconf_list_t *list)
 		if (dep->version != NULL)
 			free(dep->version);
 
+		pkgconf_version_free(dep->parsed_version);
 		free(dep);
 	}
 }
@@ -13,7 +13,11 @@
  * from the use of this software.
  */
 
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_FRAGMENT
+
 #include <libpkgconf/libpkgconf.h>
+#include <libpkgconf/probes.h>
+#include <libpkgconf/thread.h>
 
 /*
  * !doc
@@ -24,51 +28,163 @@
  * The `fragment` module provides low-level management and rendering of fragment lists.  A
  * `fragment list` contains various `fragments` of text (such as ``-I /usr/include``) in a matter
  * which is composable, mergeable and reorderable.
+ *
+ * The text of a `fragment` is reference counted and shared by every copy of the fragment, so that collecting
+ * and filtering fragment lists does not duplicate strings.  It must be treated as read-only, and is only
+ * allocated and released by the functions of this module.
+ */
+
+typedef struct {
+	volatile int refcount;
+	char data[];
+} pkgconf_fragment_data_t;
+
+#define PKGCONF_FRAGMENT_DATA(ptr)	((pkgconf_fragment_data_t *) ((ptr) - offsetof(pkgconf_fragment_data_t, data)))
+
+/*
+ * fragment_data_alloc(len)
+ *
+ * allocate room for a shared fragment string of len bytes plus the terminating nul.
  */
+static char *
+fragment_data_alloc(size_t len)
+{
+	pkgconf_fragment_data_t *fd = calloc(sizeof(pkgconf_fragment_data_t) + len + 1, 1);
+
+	fd->refcount = 1;
+	return fd->data;
+}
+
+static char *
+fragment_data_new(const char *src)
+{
+	size_t len = strlen(src);
+	char *data = fragment_data_alloc(len);
+
+	memcpy(data, src, len);
+	return data;
+}
+
+static inline char *
+fragment_data_ref(char *data)
+{
+	pkgconf_atomic_inc(&PKGCONF_FRAGMENT_DATA(data)->refcount);
+	return data;
+}
+
+static inline void
+fragment_data_unref(char *data)
+{
+	if (data == NULL)
+		return;
+
+	if (pkgconf_atomic_dec(&PKGCONF_FRAGMENT_DATA(data)->refcount) > 0)
+		return;
+
+	free(PKGCONF_FRAGMENT_DATA(data));
+}
+
+static uint32_t
+pkgconf_fragment_hash(const void *key)
+{
+	const pkgconf_fragment_t *frag = key;
+
+	return pkgconf_hash_str(frag->data) ^ (uint32_t) (unsigned char) frag->type;
+}
+
+static bool
+pkgconf_fragment_equal(const void *a, const void *b)
+{
+	const pkgconf_fragment_t *frag_a = a, *frag_b = b;
+
+	return frag_a->type == frag_b->type && !strcmp(frag_a->data, frag_b->data);
+}
+
+/*
+ * an indexed fragment list maps each (type, data) pair to its fragments.  entries are only ever
+ * appended to a list, so the most recent index entry for a key is also the last matching fragment.
+ */
+static inline void
+pkgconf_fragment_index_insert(pkgconf_list_t *list, pkgconf_fragment_t *frag)
+{
+	if (list->index != NULL)
+		pkgconf_hash_insert(list->index, frag, frag);
+}
+
+static inline void
+pkgconf_fragment_index_remove(pkgconf_list_t *list, pkgconf_fragment_t *frag)
+{
+	if (list->index != NULL)
+		pkgconf_hash_remove(list->index, frag, frag);
+}
+
+static inline void
+pkgconf_fragment_append(pkgconf_list_t *list, pkgconf_fragment_t *frag)
+{
+	pkgconf_node_insert_tail(&frag->iter, frag, list);
+	pkgconf_fragment_index_insert(list, frag);
+}
 
 struct pkgconf_fragment_check {
 	char *token;
 	size_t len;
 };
 
+#define PKGCONF_FRAGMENT_HAS_PREFIX(string, prefix)	(!strncmp((string), (prefix), sizeof(prefix) - 1))
+
+/*
+ * pkgconf_fragment_is_unmergeable(string)
+ *
+ * classify an untyped fragment by its flag: the flags matched here take an argument of their own,
+ * or otherwise must be kept in place.  the result is cached in the fragment flags when a fragment is
+ * created, see pkgconf_fragment_classify().
+ */
 static inline bool
 pkgconf_fragment_is_unmergeable(const char *string)
 {
-	static struct pkgconf_fragment_check check_fragments[] = {
-		{"-framework", 10},
-		{"-isystem", 8},
-		{"-idirafter", 10},
-		{"-pthread", 8},
-		{"-Wa,", 4},
-		{"-Wl,", 4},
-		{"-Wp,", 4},
-		{"-trigraphs", 10},
-		{"-pedantic", 9},
-		{"-ansi", 5},
-		{"-std=", 5},
-		{"-stdlib=", 8},
-		{"-include", 8},
-		{"-nostdinc", 9},
-		{"-nostdlibinc", 12},
-		{"-nobuiltininc", 13},
-	};
-
 	if (*string != '-')
 		return true;
 
-	for (size_t i = 0; i < PKGCONF_ARRAY_SIZE(check_fragments); i++)
-		if (!strncmp(string, check_fragments[i].token, check_fragments[i].len))
-			return true;
-
-	/* only one pair of {-flag, arg} may be merged together */
-	if (strchr(string, ' ') != NULL)
+	switch (string[1])
+	{
+	case 'f':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-framework");
+	case 'i':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-isystem") ||
+			PKGCONF_FRAGMENT_HAS_PREFIX(string, "-idirafter") ||
+			PKGCONF_FRAGMENT_HAS_PREFIX(string, "-include");
+	case 'p':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-pthread") ||
+			PKGCONF_FRAGMENT_HAS_PREFIX(string, "-pedantic");
+	case 'W':
+		return (string[2] == 'a' || string[2] == 'l' || string[2] == 'p') && string[3] == ',';
+	case 't':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-trigraphs");
+	case 'a':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-ansi");
+	case 's':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-std=") ||
+			PKGCONF_FRAGMENT_HAS_PREFIX(string, "-stdlib=");
+	case 'n':
+		return PKGCONF_FRAGMENT_HAS_PREFIX(string, "-nostdinc") ||
+			PKGCONF_FRAGMENT_HAS_PREFIX(string, "-nostdlibinc") ||
+			PKGCONF_FRAGMENT_HAS_PREFIX(string, "-nobuiltininc");
+	default:
 		return false;
+	}
+}
 
-	return false;
+static inline void
+pkgconf_fragment_classify(pkgconf_fragment_t *frag)
+{
+	frag->flags = 0;
+
+	if (pkgconf_fragment_is_unmergeable(frag->data))
+		frag->flags |= PKGCONF_FRAGMENT_UNMERGEABLE;
 }
 
 static inline bool
-pkgconf_fragment_should_munge(const char *string, const char *sysroot_dir)
+pkgconf_fragment_should_munge(const char *string, const char *sysroot_dir, size_t sysroot_len)
 {
 	static struct pkgconf_fragment_check check_fragments[] = {
 		{"-isystem", 8},
@@ -79,7 +195,7 @@ pkgconf_fragment_should_munge(const char *string, const char *sysroot_dir)
 	if (*string != '/')
 		return false;
 
-	if (sysroot_dir != NULL && strncmp(sysroot_dir, string, strlen(sysroot_dir)))
+	if (sysroot_dir != NULL && strncmp(sysroot_dir, string, sysroot_len))
 		return true;
 
 	for (size_t i = 0; i < PKGCONF_ARRAY_SIZE(check_fragments); i++)
@@ -95,35 +211,64 @@ pkgconf_fragment_is_special(const char *string)
 	if (*string != '-')
 		return true;
 
-	if (!strncmp(string, "-lib:", 5))
+	if (PKGCONF_FRAGMENT_HAS_PREFIX(string, "-lib:"))
 		return true;
 
 	return pkgconf_fragment_is_unmergeable(string);
 }
 
-static inline void
-pkgconf_fragment_munge(const pkgconf_client_t *client, char *buf, size_t buflen, const char *source, const char *sysroot_dir)
+/*
+ * pkgconf_fragment_munge(client, parent, source, sysroot_dir, sysroot_len)
+ *
+ * build the data of a fragment from its source text: the sysroot is prepended to absolute paths
+ * outside of it, and the result is relocated.  if parent is given, the result is appended to it,
+ * separated by a space, to merge two special fragments.  the string is written once, straight into
+ * the shared allocation of the right size.
+ */
+static char *
+pkgconf_fragment_munge(const pkgconf_client_t *client, const char *parent, const char *source, const char *sysroot_dir, size_t sysroot_len)
 {
-	*buf = '\0';
+	size_t parentlen = parent != NULL ? strlen(parent) + 1 : 0;
+	size_t srclen = strlen(source);
+	size_t rootlen = 0;
+	char *data, *path;
 
-	if (sysroot_dir == NULL)
-		sysroot_dir = pkgconf_tuple_find_global(client, "pc_sysrootdir");
+	if (sysroot_dir != NULL && pkgconf_fragment_should_munge(source, sysroot_dir, sysroot_len))
+		rootlen = sysroot_len;
 
-	if (sysroot_dir != NULL && pkgconf_fragment_should_munge(source, sysroot_dir))
-		pkgconf_strlcat(buf, sysroot_dir, buflen);
+	data = fragment_data_alloc(parentlen + rootlen + srclen);
+	if (parentlen)
+	{
+		memcpy(data, parent, parentlen - 1);
+		data[parentlen - 1] = ' ';
+	}
 
-	pkgconf_strlcat(buf, source, buflen);
+	path = data + parentlen;
+	if (rootlen)
+		memcpy(path, sysroot_dir, rootlen);
+	memcpy(path + rootlen, source, srclen);
 
-	if (*buf == '/' && !(client->flags & PKGCONF_PKG_PKGF_DONT_RELOCATE_PATHS))
-		pkgconf_path_relocate(buf, buflen);
-}
+	if (*path == '/' && !(client->flags & PKGCONF_PKG_PKGF_DONT_RELOCATE_PATHS) &&
+	    !pkgconf_path_relocate(path, rootlen + srclen + 1))
+	{
+		/* relocation may lengthen the path on some platforms, so retry through a scratch buffer */
+		char relocbuf[PKGCONF_BUFSIZE];
+		char *newdata;
+		size_t reloclen;
 
-static inline char *
-pkgconf_fragment_copy_munged(const pkgconf_client_t *client, const char *source)
-{
-	char mungebuf[PKGCONF_BUFSIZE];
-	pkgconf_fragment_munge(client, mungebuf, sizeof mungebuf, source, client->sysroot_dir);
-	return strdup(mungebuf);
+		pkgconf_strlcpy(relocbuf, path, sizeof relocbuf);
+		pkgconf_path_relocate(relocbuf, sizeof relocbuf);
+		reloclen = strlen(relocbuf);
+
+		newdata = fragment_data_alloc(parentlen + reloclen);
+		memcpy(newdata, data, parentlen);
+		memcpy(newdata + parentlen, relocbuf, reloclen);
+
+		fragment_data_unref(data);
+		data = newdata;
+	}
+
+	return data;
 }
 
 /*
@@ -151,44 +296,40 @@ pkgconf_fragment_add(const pkgconf_client_t *client, pkgconf_list_t *list, const
 		frag = calloc(sizeof(pkgconf_fragment_t), 1);
 
 		frag->type = *(string + 1);
-		frag->data = pkgconf_fragment_copy_munged(client, string + 2);
+		if (client->sysroot_dir != NULL)
+			frag->data = pkgconf_fragment_munge(client, NULL, string + 2, client->sysroot_dir, client->sysroot_dir_len);
+		else
+			frag->data = pkgconf_fragment_munge(client, NULL, string + 2, client->sysroot_var, client->sysroot_var_len);
+		pkgconf_fragment_classify(frag);
 
-		PKGCONF_TRACE(client, "added fragment {%c, '%s'} to list @%p", frag->type, frag->data, list);
+		PKGCONF_TRACE_VERBOSE(client, "added fragment {%c, '%s'} to list @%p", frag->type, frag->data, list);
 	}
 	else
 	{
-		char mungebuf[PKGCONF_BUFSIZE];
-
 		if (list->tail != NULL && list->tail->data != NULL)
 		{
 			pkgconf_fragment_t *parent = list->tail->data;
 
 			/* only attempt to merge 'special' fragments together */
-			if (!parent->type && pkgconf_fragment_is_unmergeable(parent->data))
+			if (!parent->type && (parent->flags & PKGCONF_FRAGMENT_UNMERGEABLE))
 			{
-				size_t len;
-				char *newdata;
-
-				pkgconf_fragment_munge(client, mungebuf, sizeof mungebuf, string, NULL);
+				char *newdata = pkgconf_fragment_munge(client, parent->data, string, client->sysroot_var, client->sysroot_var_len);
 
-				len = strlen(parent->data) + strlen(mungebuf) + 2;
-				newdata = malloc(len);
+				PKGCONF_TRACE_VERBOSE(client, "merging '%s' to '%s' to form fragment {'%s'} in list @%p", newdata + strlen(parent->data) + 1, parent->data, newdata, list);
 
-				pkgconf_strlcpy(newdata, parent->data, len);
-				pkgconf_strlcat(newdata, " ", len);
-				pkgconf_strlcat(newdata, mungebuf, len);
+				/* the key of the fragment changes, so take it out of the index first */
+				pkgconf_fragment_index_remove(list, parent);
 
-				PKGCONF_TRACE(client, "merging '%s' to '%s' to form fragment {'%s'} in list @%p", mungebuf, parent->data, newdata, list);
-
-				free(parent->data);
+				fragment_data_unref(parent->data);
 				parent->data = newdata;
+				pkgconf_fragment_classify(parent);
 
 				/* use a copy operation to force a dedup */
 				pkgconf_node_delete(&parent->iter, list);
 				pkgconf_fragment_copy(client, list, parent, false);
 
 				/* the fragment list now (maybe) has the copied node, so free the original */
-				free(parent->data);
+				fragment_data_unref(parent->data);
 				free(parent);
 
 				return;
@@ -198,12 +339,13 @@ pkgconf_fragment_add(const pkgconf_client_t *client, pkgconf_list_t *list, const
 		frag = calloc(sizeof(pkgconf_fragment_t), 1);
 
 		frag->type = 0;
-		frag->data = strdup(string);
+		frag->data = fragment_data_new(string);
+		pkgconf_fragment_classify(frag);
 
-		PKGCONF_TRACE(client, "created special fragment {'%s'} in list @%p", frag->data, list);
+		PKGCONF_TRACE_VERBOSE(client, "created special fragment {'%s'} in list @%p", frag->data, list);
 	}
 
-	pkgconf_node_insert_tail(&frag->iter, frag, list);
+	pkgconf_fragment_append(list, frag);
 }
 
 static inline pkgconf_fragment_t *
@@ -211,6 +353,9 @@ pkgconf_fragment_lookup(pkgconf_list_t *list, const pkgconf_fragment_t *base)
 {
 	pkgconf_node_t *node;
 
+	if (list->index != NULL)
+		return pkgconf_hash_lookup(list->index, base);
+
 	PKGCONF_FOREACH_LIST_ENTRY_REVERSE(list->tail, node)
 	{
 		pkgconf_fragment_t *frag = node->data;
@@ -256,7 +401,7 @@ pkgconf_fragment_can_merge(const pkgconf_fragment_t *base, unsigned int flags, b
 	if (is_private)
 		return false;
 
-	return pkgconf_fragment_is_unmergeable(base->data);
+	return (base->flags & PKGCONF_FRAGMENT_UNMERGEABLE) != 0;
 }
 
 static inline pkgconf_fragment_t *
@@ -347,21 +492,173 @@ void
 pkgconf_fragment_copy(const pkgconf_client_t *client, pkgconf_list_t *list, const pkgconf_fragment_t *base, bool is_private)
 {
 	pkgconf_fragment_t *frag;
+	int outcome = PKGCONF_PROBE_FRAGMENT_ADDED;
 
 	if ((frag = pkgconf_fragment_exists(list, base, client->flags, is_private)) != NULL)
 	{
 		if (pkgconf_fragment_should_merge(frag))
+		{
 			pkgconf_fragment_delete(list, frag);
+			outcome = PKGCONF_PROBE_FRAGMENT_MOVED;
+		}
 	}
 	else if (!is_private && !pkgconf_fragment_can_merge_back(base, client->flags, is_private) && (pkgconf_fragment_lookup(list, base) != NULL))
+	{
+		PKGCONF_PROBE3(fragment__copy, base->type, base->data, PKGCONF_PROBE_FRAGMENT_DROPPED);
 		return;
+	}
 
 	frag = calloc(sizeof(pkgconf_fragment_t), 1);
 
 	frag->type = base->type;
-	frag->data = strdup(base->data);
+	frag->data = fragment_data_ref(base->data);
+	frag->flags = base->flags;
 
-	pkgconf_node_insert_tail(&frag->iter, frag, list);
+	pkgconf_fragment_append(list, frag);
+
+	PKGCONF_PROBE3(fragment__copy, frag->type, frag->data, outcome);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_fragment_copy_list(const pkgconf_client_t *client, pkgconf_list_t *list, const pkgconf_list_t *base, bool is_private)
+ *
+ *    Copies every `fragment` of a `fragment list` to another `fragment list`, applying `mergeback` to each of them
+ *    as ``pkgconf_fragment_copy()`` does.
+ *
+ *    :param pkgconf_client_t* client: The pkgconf client being accessed.
+ *    :param pkgconf_list_t* list: The list the fragments are being added to.
+ *    :param pkgconf_list_t* base: The list of fragments being copied.
+ *    :param bool is_private: Whether the fragment list is a `private` fragment list (static linking).
+ *    :return: nothing
+ */
+void
+pkgconf_fragment_copy_list(const pkgconf_client_t *client, pkgconf_list_t *list, const pkgconf_list_t *base, bool is_private)
+{
+	pkgconf_node_t *node;
+	size_t length = list->length;
+
+	PKGCONF_FOREACH_LIST_ENTRY(base->head, node)
+	{
+		pkgconf_fragment_t *frag = node->data;
+		pkgconf_fragment_copy(client, list, frag, is_private);
+	}
+
+	if (client->profile != NULL)
+		pkgconf_profile_fragments(client, base->length, list->length - length);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_fragment_index_list(pkgconf_list_t *list)
+ *
+ *    Attaches a hash index keyed by fragment type and data to a `fragment list`, so that `mergeback` finds
+ *    a previous copy of a `fragment` in constant time instead of scanning the list.  The index is kept in
+ *    sync by the functions of this module, and released by ``pkgconf_fragment_free()``.  Does nothing if
+ *    the list is already indexed.
+ *
+ *    :param pkgconf_list_t* list: The fragment list to index.
+ *    :return: nothing
+ */
+void
+pkgconf_fragment_index_list(pkgconf_list_t *list)
+{
+	pkgconf_node_t *node;
+
+	if (list->index != NULL)
+		return;
+
+	list->index = calloc(sizeof(pkgconf_hash_t), 1);
+	pkgconf_hash_init(list->index, pkgconf_fragment_hash, pkgconf_fragment_equal);
+
+	PKGCONF_FOREACH_LIST_ENTRY(list->head, node)
+		pkgconf_fragment_index_insert(list, node->data);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_fragment_move_list(pkgconf_list_t *list, pkgconf_list_t *src)
+ *
+ *    Moves every `fragment` of a `fragment list` to the end of another one, without `mergeback`.
+ *    The source list is left empty.
+ *
+ *    :param pkgconf_list_t* list: The list the fragments are being added to.
+ *    :param pkgconf_list_t* src: The list the fragments are taken from.
+ *    :return: nothing
+ */
+void
+pkgconf_fragment_move_list(pkgconf_list_t *list, pkgconf_list_t *src)
+{
+	pkgconf_node_t *node, *next;
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(src->head, next, node)
+	{
+		pkgconf_fragment_t *frag = node->data;
+
+		pkgconf_fragment_index_remove(src, frag);
+		pkgconf_node_delete(node, src);
+
+		node->prev = node->next = NULL;
+		pkgconf_fragment_append(list, frag);
+	}
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_fragment_minimize(const pkgconf_client_t *client, pkgconf_list_t *list)
+ *
+ *    Removes every redundant `fragment` from a `fragment list` in linear time, applying the `mergeback` rules
+ *    of ``pkgconf_fragment_copy()`` to the whole list at once: only the last copy of a ``-l`` fragment is kept,
+ *    only the first copy of a ``-L``, ``-I`` or ``-F`` fragment is kept, and fragments which cannot be merged
+ *    are all kept.  Unlike a `private` copy, duplicates are removed regardless of where the fragments came from.
+ *
+ *    :param pkgconf_client_t* client: The pkgconf client being accessed.
+ *    :param pkgconf_list_t* list: The fragment list to minimize.
+ *    :return: nothing
+ */
+void
+pkgconf_fragment_minimize(const pkgconf_client_t *client, pkgconf_list_t *list)
+{
+	pkgconf_hash_t seen;
+	pkgconf_node_t *node, *next;
+
+	pkgconf_hash_init(&seen, pkgconf_fragment_hash, pkgconf_fragment_equal);
+
+	/* the fragments kept at their first occurrence are handled walking forwards... */
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(list->head, next, node)
+	{
+		pkgconf_fragment_t *frag = node->data;
+
+		if (!pkgconf_fragment_can_merge(frag, client->flags, false) || pkgconf_fragment_can_merge_back(frag, client->flags, false))
+			continue;
+
+		if (pkgconf_hash_lookup(&seen, frag) != NULL)
+			pkgconf_fragment_delete(list, frag);
+		else
+			pkgconf_hash_insert(&seen, frag, frag);
+	}
+
+	/* ...and the ones kept at their last occurrence walking backwards */
+	for (node = list->tail; node != NULL; node = next)
+	{
+		pkgconf_fragment_t *frag = node->data;
+
+		next = node->prev;
+
+		if (!pkgconf_fragment_can_merge(frag, client->flags, false) || !pkgconf_fragment_can_merge_back(frag, client->flags, false))
+			continue;
+
+		if (pkgconf_hash_lookup(&seen, frag) != NULL)
+			pkgconf_fragment_delete(list, frag);
+		else
+			pkgconf_hash_insert(&seen, frag, frag);
+	}
+
+	pkgconf_hash_deinit(&seen);
 }
 
 /*
@@ -392,61 +689,69 @@ pkgconf_fragment_filter(const pkgconf_client_t *client, pkgconf_list_t *dest, pk
 	}
 }
 
-static inline char *
-fragment_escape(const char *src)
+/*
+ * bytes which are prefixed with a backslash when rendering escaped fragments: everything except
+ * space, alphanumerics, backslash and the punctuation in "$()+,-./:=@^_~".
+ */
+static const unsigned char fragment_escape_table[256] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x00 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x10 */
+	0, 1, 1, 1, 0, 1, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0,	/* 0x20 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 1,	/* 0x30 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	/* 0x40 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0,	/* 0x50 */
+	1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	/* 0x60 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 1,	/* 0x70 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x80 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x90 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xa0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xb0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xc0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xd0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xe0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xf0 */
+};
+
+#define fragment_should_escape(c)	(fragment_escape_table[(unsigned char) (c)])
+
+/*
+ * fragment_escape_count(src, len)
+ *
+ * single pass over a fragment's data: stores its length in len and returns how many of its bytes
+ * need a backslash.  the common answer is zero, in which case the data is copied out verbatim.
+ */
+static inline size_t
+fragment_escape_count(const char *src, size_t *len)
 {
-	ssize_t outlen = strlen(src) + 10;
-	char *out = calloc(outlen, 1);
-	char *dst = out;
+	const unsigned char *p = (const unsigned char *) src;
+	size_t count = 0;
 
-	while (*src)
-	{
-		if (((*src < ' ') ||
-		    (*src > ' ' && *src < '$') ||
-		    (*src > '$' && *src < '(') ||
-		    (*src > ')' && *src < '+') ||
-		    (*src > ':' && *src < '=') ||
-		    (*src > '=' && *src < '@') ||
-		    (*src > 'Z' && *src < '^') ||
-		    (*src == '`') ||
-		    (*src > 'z' && *src < '~') ||
-		    (*src > '~')) && *src != '\\')
-			*dst++ = '\\';
-
-		*dst++ = *src++;
-
-		if ((ptrdiff_t)(dst - out) + 2 > outlen)
-		{
-			outlen *= 2;
-			out = realloc(out, outlen);
-		}
-	}
+	for (; *p; p++)
+		count += fragment_escape_table[*p];
 
-	*dst = 0;
-	return out;
+	*len = p - (const unsigned char *) src;
+	return count;
 }
 
 static inline size_t
-pkgconf_fragment_len(const pkgconf_fragment_t *frag, bool escape)
+pkgconf_fragment_len(const pkgconf_fragment_t *frag, bool escape, size_t *datalen, size_t *nescapes)
 {
 	size_t len = 1;
 
+	*datalen = *nescapes = 0;
+
 	if (frag->type)
 		len += 2;
 
-	if (frag->data != NULL)
-	{
-		if (!escape)
-			len += strlen(frag->data);
-		else
-		{
-			char *tmp = fragment_escape(frag->data);
-			len += strlen(tmp);
-			free(tmp);
-		}
-	}
+	if (frag->data == NULL)
+		return len;
+
+	if (escape)
+		*nescapes = fragment_escape_count(frag->data, datalen);
+	else
+		*datalen = strlen(frag->data);
 
-	return len;
+	return len + *datalen + *nescapes;
 }
 
 /*
@@ -470,7 +775,9 @@ pkgconf_fragment_render_len(const pkgconf_list_t *list, bool escape)
 	PKGCONF_FOREACH_LIST_ENTRY(list->head, node)
 	{
 		const pkgconf_fragment_t *frag = node->data;
-		out += pkgconf_fragment_len(frag, escape);
+		size_t datalen, nescapes;
+
+		out += pkgconf_fragment_len(frag, escape, &datalen, &nescapes);
 	}
 
 	return out;
@@ -481,7 +788,7 @@ pkgconf_fragment_render_len(const pkgconf_list_t *list, bool escape)
  *
  * .. c:function:: void pkgconf_fragment_render_buf(const pkgconf_list_t *list, char *buf, size_t buflen)
  *
- *    Renders a `fragment list` into a buffer.
+ *    Renders a `fragment list` into a buffer.  Fragments which do not fit into the buffer are left out.
  *
  *    :param pkgconf_list_t* list: The `fragment list` being rendered.
  *    :param char* buf: The buffer to render the fragment list into.
@@ -495,14 +802,19 @@ pkgconf_fragment_render_buf(const pkgconf_list_t *list, char *buf, size_t buflen
 	pkgconf_node_t *node;
 	char *bptr = buf;
 
+	if (buflen == 0)
+		return;
+
 	memset(buf, 0, buflen);
 
 	PKGCONF_FOREACH_LIST_ENTRY(list->head, node)
 	{
 		const pkgconf_fragment_t *frag = node->data;
 		size_t buf_remaining = buflen - (bptr - buf);
+		size_t datalen, nescapes;
 
-		if (pkgconf_fragment_len(frag, escape) > buf_remaining)
+		/* leave room for the trailing nul */
+		if (pkgconf_fragment_len(frag, escape, &datalen, &nescapes) >= buf_remaining)
 			break;
 
 		if (frag->type)
@@ -511,15 +823,22 @@ pkgconf_fragment_render_buf(const pkgconf_list_t *list, char *buf, size_t buflen
 			*bptr++ = frag->type;
 		}
 
-		if (frag->data)
+		if (nescapes == 0)
 		{
-			if (!escape)
-				bptr += pkgconf_strlcpy(bptr, frag->data, buf_remaining);
-			else
+			if (datalen)
+				memcpy(bptr, frag->data, datalen);
+			bptr += datalen;
+		}
+		else
+		{
+			const char *src;
+
+			for (src = frag->data; *src; src++)
 			{
-				char *tmp = fragment_escape(frag->data);
-				bptr += pkgconf_strlcpy(bptr, tmp, buf_remaining);
-				free(tmp);
+				if (fragment_should_escape(*src))
+					*bptr++ = '\\';
+
+				*bptr++ = *src;
 			}
 		}
 
@@ -552,6 +871,53 @@ pkgconf_fragment_render(const pkgconf_list_t *list, bool escape)
 	return buf;
 }
 
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_fragment_render_file(const pkgconf_list_t *list, FILE *out, bool escape)
+ *
+ *    Renders a `fragment list` directly into a stdio stream, without building the rendered string in memory
+ *    first.  The output is the same as the string returned by ``pkgconf_fragment_render()``.
+ *
+ *    :param pkgconf_list_t* list: The `fragment list` being rendered.
+ *    :param FILE* out: The stream to write the rendered `fragment list` to.
+ *    :param bool escape: Whether or not to escape special shell characters.
+ *    :return: nothing
+ */
+void
+pkgconf_fragment_render_file(const pkgconf_list_t *list, FILE *out, bool escape)
+{
+	pkgconf_node_t *node;
+
+	PKGCONF_FOREACH_LIST_ENTRY(list->head, node)
+	{
+		const pkgconf_fragment_t *frag = node->data;
+		const char *src, *run;
+
+		if (frag->type)
+		{
+			putc('-', out);
+			putc(frag->type, out);
+		}
+
+		/* write the data in runs of bytes which need no escaping */
+		for (src = run = frag->data; src != NULL && *src; src++)
+		{
+			if (!escape || !fragment_should_escape(*src))
+				continue;
+
+			fwrite(run, 1, src - run, out);
+			putc('\\', out);
+			run = src;
+		}
+
+		if (src != NULL && src > run)
+			fwrite(run, 1, src - run, out);
+
+		putc(' ', out);
+	}
+}
+
 /*
  * !doc
  *
@@ -566,9 +932,10 @@ pkgconf_fragment_render(const pkgconf_list_t *list, bool escape)
 void
 pkgconf_fragment_delete(pkgconf_list_t *list, pkgconf_fragment_t *node)
 {
+	pkgconf_fragment_index_remove(list, node);
 	pkgconf_node_delete(&node->iter, list);
 
-	free(node->data);
+	fragment_data_unref(node->data);
 	free(node);
 }
 
@@ -591,9 +958,19 @@ pkgconf_fragment_free(pkgconf_list_t *list)
 	{
 		pkgconf_fragment_t *frag = node->data;
 
-		free(frag->data);
+		fragment_data_unref(frag->data);
 		free(frag);
 	}
+
+	list->head = list->tail = NULL;
+	list->length = 0;
+
+	if (list->index != NULL)
+	{
+		pkgconf_hash_deinit(list->index);
+		free(list->index);
+		list->index = NULL;
+	}
 }
 
 /*
@@ -0,0 +1,922 @@
+/*
+ * graph.c
+ * resolved dependency graph objects
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_GRAPH
+
+#include <libpkgconf/libpkgconf.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `graph` module
+ * =========================
+ *
+ * The `graph` module resolves a dependency graph once and keeps the result, so that any number of
+ * questions can be asked about the same set of packages without looking up a single dependency again.
+ *
+ * The graph below the root is resolved breadth-first into flat node and edge arrays.  Every package is
+ * looked up and expanded exactly once, however many paths lead to it, and each edge remembers whether
+ * it came from a ``Requires.private`` entry.  The ``Conflicts`` rules of all expanded packages are then
+ * checked against the whole graph in one pass.  A topological order, where every package comes after
+ * all of the packages requiring it, is computed as part of the build.
+ *
+ * A graph visits each package only once, which is also how ``pkgconf_pkg_traverse()`` behaves when the
+ * ``PKGCONF_PKG_PKGF_TRAVERSE_ONCE`` flag is set.  The recursive walker visits a package once per path,
+ * and the fragment collectors rely on where the first and the last of those visits happen: merge-back
+ * keeps the first copy of a ``-I``, ``-L`` or ``-F`` fragment but the last copy of any other fragment,
+ * such as ``-l`` or ``-D``.  Both positions are computed without expanding every path, from the number
+ * of visits below each package, and the fragments of a package are collected at its first and at its
+ * last visit, in the order and with the private flag the recursive walker would use for them.
+ *
+ * On most graphs, merge-back then keeps the same copy of every fragment as it does with the recursive
+ * walker, but the output can differ: the visits in between are skipped, while the recursive walker
+ * appends a copy of the private fragments at each of them, and a fragment it moves there changes which
+ * neighbour a later copy is merged against.  Reproducing those takes one visit per path, which is what
+ * the recursive walker does.
+ *
+ * A graph keeps the query it was built for.  The functions walking a graph take the query being answered,
+ * which decides how the graph is walked: a graph built with ``PKGCONF_PKG_PKGF_SEARCH_PRIVATE`` set can
+ * answer queries with and without that flag.
+ */
+
+typedef struct {
+	pkgconf_pkg_t *pkg;
+	int depth;
+	size_t edges;
+	size_t nedges;
+	bool expanded;
+	bool visited;
+	bool public;
+} pkgconf_graph_node_t;
+
+typedef struct {
+	size_t node;
+	bool is_private;
+} pkgconf_graph_edge_t;
+
+typedef struct {
+	size_t node;
+	size_t next;
+} pkgconf_graph_frame_t;
+
+struct pkgconf_graph_ {
+	pkgconf_query_t query;
+	pkgconf_pkg_t world;
+
+	pkgconf_hash_t index;
+
+	pkgconf_graph_node_t *nodes;
+	size_t nnodes;
+	size_t nodes_size;
+
+	pkgconf_graph_edge_t *edges;
+	size_t nedges;
+	size_t edges_size;
+
+	size_t *order;
+	size_t norder;
+
+	unsigned int eflags;
+};
+
+typedef struct {
+	pkgconf_graph_t *graph;
+	size_t parent;
+} pkgconf_graph_resolve_ctx_t;
+
+static size_t
+pkgconf_graph_add_node(pkgconf_graph_t *graph, pkgconf_pkg_t *pkg, int depth)
+{
+	pkgconf_graph_node_t *node;
+
+	if (graph->nnodes == graph->nodes_size)
+	{
+		graph->nodes_size = graph->nodes_size ? graph->nodes_size * 2 : 16;
+		graph->nodes = realloc(graph->nodes, graph->nodes_size * sizeof(pkgconf_graph_node_t));
+	}
+
+	node = &graph->nodes[graph->nnodes];
+	memset(node, 0, sizeof *node);
+	node->pkg = pkg;
+	node->depth = depth;
+
+	pkgconf_hash_insert(&graph->index, pkg, (void *)(uintptr_t) (graph->nnodes + 1));
+
+	return graph->nnodes++;
+}
+
+static void
+pkgconf_graph_add_edge(pkgconf_graph_t *graph, size_t target, bool is_private)
+{
+	if (graph->nedges == graph->edges_size)
+	{
+		graph->edges_size = graph->edges_size ? graph->edges_size * 2 : 16;
+		graph->edges = realloc(graph->edges, graph->edges_size * sizeof(pkgconf_graph_edge_t));
+	}
+
+	graph->edges[graph->nedges].node = target;
+	graph->edges[graph->nedges].is_private = is_private;
+	graph->nedges++;
+}
+
+static void
+pkgconf_graph_add_dependency(const pkgconf_query_t *query, pkgconf_pkg_t *parent, pkgconf_pkg_t *pkg, bool is_private, void *data)
+{
+	pkgconf_graph_resolve_ctx_t *ctx = data;
+	pkgconf_graph_t *graph = ctx->graph;
+	uintptr_t target;
+	(void) parent;
+
+	target = (uintptr_t) pkgconf_hash_lookup(&graph->index, pkg);
+	if (target != 0)
+		pkgconf_pkg_unref(query->client, pkg);
+	else
+		target = pkgconf_graph_add_node(graph, pkg, graph->nodes[ctx->parent].depth + 1) + 1;
+
+	pkgconf_graph_add_edge(graph, target - 1, is_private);
+}
+
+static void
+pkgconf_graph_resolve(pkgconf_graph_t *graph, int maxdepth)
+{
+	pkgconf_graph_resolve_ctx_t ctx = {
+		.graph = graph,
+	};
+	size_t i;
+
+	/* the node array doubles as the breadth-first queue, so nodes are reached at their shallowest depth */
+	for (i = 0; i < graph->nnodes; i++)
+	{
+		if (maxdepth >= 0 && graph->nodes[i].depth >= maxdepth)
+			continue;
+
+		graph->nodes[i].expanded = true;
+		graph->nodes[i].edges = graph->nedges;
+
+		PKGCONF_TRACE(graph->query.client, "%s: resolving at depth %d", graph->nodes[i].pkg->id, graph->nodes[i].depth);
+
+		ctx.parent = i;
+		graph->eflags |= pkgconf_pkg_resolve(&graph->query, graph->nodes[i].pkg, pkgconf_graph_add_dependency, &ctx);
+
+		graph->nodes[i].nedges = graph->nedges - graph->nodes[i].edges;
+	}
+}
+
+static void
+pkgconf_graph_verify_conflicts(pkgconf_graph_t *graph)
+{
+	pkgconf_pkg_t **pkgs = calloc(graph->nnodes, sizeof(pkgconf_pkg_t *));
+	size_t npkgs = 0, i;
+
+	for (i = 0; i < graph->nnodes; i++)
+	{
+		if (graph->nodes[i].expanded)
+			pkgs[npkgs++] = graph->nodes[i].pkg;
+	}
+
+	graph->eflags |= pkgconf_pkg_verify_conflicts(&graph->query, pkgs, npkgs);
+
+	free(pkgs);
+}
+
+/*
+ * pkgconf_graph_follow(graph, edge, public_only)
+ *
+ * check whether a walk goes through an edge.  if `public_only` is set, Requires.private
+ * edges are not followed.
+ */
+static inline bool
+pkgconf_graph_follow(const pkgconf_graph_t *graph, const pkgconf_graph_edge_t *edge, bool public_only)
+{
+	const pkgconf_graph_node_t *child = &graph->nodes[edge->node];
+
+	if (!child->expanded)
+		return false;
+
+	if (public_only && (edge->is_private || !child->public))
+		return false;
+
+	return true;
+}
+
+/*
+ * pkgconf_graph_order(graph, public_only, order)
+ *
+ * fill `order` with the expanded nodes in last-visit order, where every package comes
+ * after all of the packages requiring it.
+ */
+static size_t
+pkgconf_graph_order(pkgconf_graph_t *graph, bool public_only, size_t *order)
+{
+	pkgconf_graph_frame_t *stack;
+	size_t depth = 0, count = 0, i;
+
+	if (!graph->nodes[0].expanded)
+		return 0;
+
+	for (i = 0; i < graph->nnodes; i++)
+		graph->nodes[i].visited = false;
+
+	stack = calloc(graph->nnodes, sizeof(pkgconf_graph_frame_t));
+	stack[depth].node = 0;
+	stack[depth].next = 0;
+	depth++;
+
+	graph->nodes[0].visited = true;
+
+	while (depth > 0)
+	{
+		pkgconf_graph_frame_t *frame = &stack[depth - 1];
+		const pkgconf_graph_node_t *node = &graph->nodes[frame->node];
+		const pkgconf_graph_edge_t *edge;
+
+		if (frame->next == node->nedges)
+		{
+			order[count++] = frame->node;
+
+			depth--;
+			continue;
+		}
+
+		/* the children are taken in reverse order, so that the reversed postorder lists them as required */
+		edge = &graph->edges[node->edges + node->nedges - frame->next - 1];
+		frame->next++;
+
+		if (graph->nodes[edge->node].visited || !pkgconf_graph_follow(graph, edge, public_only))
+			continue;
+
+		graph->nodes[edge->node].visited = true;
+
+		stack[depth].node = edge->node;
+		stack[depth].next = 0;
+		depth++;
+	}
+
+	free(stack);
+
+	for (i = 0; i < count / 2; i++)
+	{
+		size_t tmp = order[i];
+
+		order[i] = order[count - i - 1];
+		order[count - i - 1] = tmp;
+	}
+
+	return count;
+}
+
+#define PKGCONF_GRAPH_ITER_FLAGS (PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE | PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH)
+
+typedef struct {
+	uint64_t position;
+	size_t rank;
+	size_t node;
+	unsigned int flags;
+} pkgconf_graph_visit_t;
+
+static inline uint64_t
+pkgconf_graph_position_add(uint64_t a, uint64_t b)
+{
+	return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+static int
+pkgconf_graph_visit_cmp(const void *a, const void *b)
+{
+	const pkgconf_graph_visit_t *visit_a = a;
+	const pkgconf_graph_visit_t *visit_b = b;
+
+	if (visit_a->position != visit_b->position)
+		return visit_a->position < visit_b->position ? -1 : 1;
+
+	if (visit_a->rank != visit_b->rank)
+		return visit_a->rank < visit_b->rank ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * pkgconf_graph_visit_flags(edge, parent_flags, first_in_list)
+ *
+ * compute the iteration flags of a visit made through `edge` from a visit of its parent
+ * with `parent_flags`, as the recursive walker sets them.  the path is private if it goes
+ * through a Requires.private edge anywhere.  the walker however sets the is-private flag
+ * when it starts on a Requires.private list and clears it when the walk below any package
+ * is done, so only the first package walked from a list sees the flag of that list: set
+ * for a Requires.private list, the one of the parent visit for a Requires list.
+ */
+static inline unsigned int
+pkgconf_graph_visit_flags(const pkgconf_graph_edge_t *edge, unsigned int parent_flags, bool first_in_list)
+{
+	unsigned int flags = 0;
+
+	if (edge->is_private || (parent_flags & PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH))
+		flags |= PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH;
+
+	if (first_in_list && (edge->is_private || (parent_flags & PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE)))
+		flags |= PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE;
+
+	return flags;
+}
+
+/*
+ * pkgconf_graph_visits(graph, public_only, visits, visit_flags)
+ *
+ * fill `visits` with the first and the last visit of every expanded node, in the order a
+ * walk visiting a package once per path would make them, and `visit_flags` with the
+ * iteration flags that walk passes for each of those visits.  both arrays must have room
+ * for twice as many entries as there are nodes.
+ *
+ * the position of a visit in such a walk is computed without doing it: a package visited
+ * at position p is followed by the walks below each of its children in turn, and the length
+ * of the walk below a package is one plus the lengths below its children.  the first visit
+ * of a package is then the earliest one made from the first visit of any of its parents, and
+ * the last visit the latest one made from the last visit of any of them.  edges closing a
+ * cycle are not walked.  the positions saturate on graphs with more than 2^64 paths, and
+ * the visits past that point tie; they are then taken in topological order, which keeps
+ * every package after the packages requiring it but no longer matches the recursive walker.
+ */
+static size_t
+pkgconf_graph_visits(pkgconf_graph_t *graph, bool public_only, size_t *visits, unsigned int *visit_flags)
+{
+	size_t *order = calloc(graph->nnodes, sizeof(size_t));
+	size_t *rank = calloc(graph->nnodes, sizeof(size_t));
+	uint64_t *length = calloc(graph->nnodes, sizeof(uint64_t));
+	uint64_t *first = calloc(graph->nnodes, sizeof(uint64_t));
+	uint64_t *last = calloc(graph->nnodes, sizeof(uint64_t));
+	unsigned int *first_flags = calloc(graph->nnodes, sizeof(unsigned int));
+	unsigned int *last_flags = calloc(graph->nnodes, sizeof(unsigned int));
+	pkgconf_graph_visit_t *sorted;
+	size_t count, nvisits = 0, i, j;
+
+	count = pkgconf_graph_order(graph, public_only, order);
+
+	/* ranks start at 1, an edge to a node of lower rank closes a cycle */
+	for (i = 0; i < count; i++)
+	{
+		rank[order[i]] = i + 1;
+		first[order[i]] = UINT64_MAX;
+	}
+
+	for (i = count; i > 0; i--)
+	{
+		size_t parent = order[i - 1];
+		const pkgconf_graph_node_t *node = &graph->nodes[parent];
+
+		length[parent] = 1;
+
+		for (j = node->edges; j < node->edges + node->nedges; j++)
+		{
+			const pkgconf_graph_edge_t *edge = &graph->edges[j];
+
+			if (pkgconf_graph_follow(graph, edge, public_only) && rank[edge->node] > rank[parent])
+				length[parent] = pkgconf_graph_position_add(length[parent], length[edge->node]);
+		}
+	}
+
+	if (count > 0)
+		first[order[0]] = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		size_t parent = order[i];
+		const pkgconf_graph_node_t *node = &graph->nodes[parent];
+		uint64_t offset = 1;
+		bool walked_public = false, walked_private = false;
+
+		for (j = node->edges; j < node->edges + node->nedges; j++)
+		{
+			const pkgconf_graph_edge_t *edge = &graph->edges[j];
+			bool first_in_list;
+			uint64_t position;
+
+			if (!pkgconf_graph_follow(graph, edge, public_only) || rank[edge->node] <= rank[parent])
+				continue;
+
+			/* the Requires.private edges of a node come after its Requires edges */
+			first_in_list = edge->is_private ? !walked_private : !walked_public;
+			if (edge->is_private)
+				walked_private = true;
+			else
+				walked_public = true;
+
+			position = pkgconf_graph_position_add(first[parent], offset);
+			if (position < first[edge->node])
+			{
+				first[edge->node] = position;
+				first_flags[edge->node] = pkgconf_graph_visit_flags(edge, first_flags[parent], first_in_list);
+			}
+
+			position = pkgconf_graph_position_add(last[parent], offset);
+			if (position > last[edge->node])
+			{
+				last[edge->node] = position;
+				last_flags[edge->node] = pkgconf_graph_visit_flags(edge, last_flags[parent], first_in_list);
+			}
+
+			offset = pkgconf_graph_position_add(offset, length[edge->node]);
+		}
+	}
+
+	sorted = calloc(count * 2, sizeof(pkgconf_graph_visit_t));
+
+	for (i = 0; i < count; i++)
+	{
+		sorted[nvisits].position = first[order[i]];
+		sorted[nvisits].rank = i;
+		sorted[nvisits].node = order[i];
+		sorted[nvisits].flags = first_flags[order[i]];
+		nvisits++;
+
+		if (last[order[i]] == first[order[i]])
+			continue;
+
+		sorted[nvisits].position = last[order[i]];
+		sorted[nvisits].rank = i;
+		sorted[nvisits].node = order[i];
+		sorted[nvisits].flags = last_flags[order[i]];
+		nvisits++;
+	}
+
+	qsort(sorted, nvisits, sizeof(pkgconf_graph_visit_t), pkgconf_graph_visit_cmp);
+
+	for (i = 0; i < nvisits; i++)
+	{
+		visits[i] = sorted[i].node;
+		visit_flags[i] = sorted[i].flags;
+	}
+
+	free(sorted);
+	free(last_flags);
+	free(first_flags);
+	free(last);
+	free(first);
+	free(length);
+	free(rank);
+	free(order);
+
+	return nvisits;
+}
+
+/*
+ * pkgconf_graph_mark_public(graph, maxdepth)
+ *
+ * a package reached through several paths is private only if every one of them goes
+ * through a Requires.private edge.  the public depth is tracked separately, so that a
+ * walk which does not follow Requires.private edges stops at the same packages as one
+ * over a graph resolved without them.
+ */
+static void
+pkgconf_graph_mark_public(pkgconf_graph_t *graph, int maxdepth)
+{
+	size_t *queue = calloc(graph->nnodes, sizeof(size_t));
+	int *depths = calloc(graph->nnodes, sizeof(int));
+	size_t head = 0, tail = 0, i;
+
+	graph->nodes[0].public = true;
+	queue[tail++] = 0;
+
+	while (head < tail)
+	{
+		size_t parent = queue[head++];
+		const pkgconf_graph_node_t *node = &graph->nodes[parent];
+
+		for (i = node->edges; i < node->edges + node->nedges; i++)
+		{
+			size_t target = graph->edges[i].node;
+			pkgconf_graph_node_t *child = &graph->nodes[target];
+
+			if (graph->edges[i].is_private || child->public || !child->expanded)
+				continue;
+
+			if (maxdepth >= 0 && depths[parent] + 1 >= maxdepth)
+				continue;
+
+			child->public = true;
+			depths[target] = depths[parent] + 1;
+			queue[tail++] = target;
+		}
+	}
+
+	free(depths);
+	free(queue);
+}
+
+/*
+ * pkgconf_graph_visit(graph, query, order, visit_flags, count, func, data)
+ *
+ * call `func` for the nodes listed in `order`, on behalf of `query`.  the function is passed
+ * a copy of the query owned by the walk, whose iteration flags describe the node visited.
+ * if `visit_flags` is given, it holds the iteration flags of each visit, otherwise a node
+ * is private if it can only be reached through a Requires.private edge.
+ */
+static void
+pkgconf_graph_visit(pkgconf_graph_t *graph, const pkgconf_query_t *query, const size_t *order, const unsigned int *visit_flags, size_t count, pkgconf_pkg_traverse_func_t func, void *data)
+{
+	pkgconf_client_t *client = query->client;
+	pkgconf_query_t walk = *query;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		const pkgconf_graph_node_t *node = &graph->nodes[order[i]];
+
+		if ((node->pkg->flags & PKGCONF_PKG_PROPF_VIRTUAL) && (query->flags & PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL))
+			continue;
+
+		if ((query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE) && (graph->query.flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE))
+		{
+			walk.flags &= ~PKGCONF_GRAPH_ITER_FLAGS;
+
+			if (visit_flags != NULL)
+				walk.flags |= visit_flags[i];
+			else if (!node->public)
+				walk.flags |= PKGCONF_GRAPH_ITER_FLAGS;
+		}
+
+		if (client->profile != NULL)
+			pkgconf_profile_visit(client, node->pkg->id);
+
+		func(&walk, node->pkg, data);
+	}
+}
+
+static void
+pkgconf_graph_visit_ordered(pkgconf_graph_t *graph, const pkgconf_query_t *query, bool public_only, pkgconf_pkg_traverse_func_t func, void *data)
+{
+	size_t *order = calloc(graph->nnodes, sizeof(size_t));
+	size_t count;
+
+	count = pkgconf_graph_order(graph, public_only, order);
+	pkgconf_graph_visit(graph, query, order, NULL, count, func, data);
+
+	free(order);
+}
+
+static void
+pkgconf_graph_build(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_t *root, int maxdepth)
+{
+	pkgconf_client_t *client = query->client;
+
+	graph->query = *query;
+
+	PKGCONF_TIMING_BEGIN(client, PKGCONF_TIMING_TRAVERSE, root->id);
+	PKGCONF_TRACE(client, "%s: building dependency graph, level %d", root->id, maxdepth);
+
+	pkgconf_hash_init(&graph->index, pkgconf_hash_ptr, pkgconf_hash_ptr_equal);
+	pkgconf_graph_add_node(graph, root, 0);
+
+	pkgconf_graph_resolve(graph, maxdepth);
+
+	if (!(query->flags & PKGCONF_PKG_PKGF_SKIP_CONFLICTS))
+		pkgconf_graph_verify_conflicts(graph);
+
+	if (query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE)
+		pkgconf_graph_mark_public(graph, maxdepth);
+
+	graph->order = calloc(graph->nnodes, sizeof(size_t));
+	graph->norder = pkgconf_graph_order(graph, false, graph->order);
+
+	PKGCONF_TIMING_END(client, PKGCONF_TIMING_TRAVERSE);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_graph_t *pkgconf_graph_new_from_pkg(const pkgconf_query_t *query, pkgconf_pkg_t *root, int maxdepth)
+ *
+ *    Resolves the dependency graph below a package up to `maxdepth` levels.  ``Requires.private`` entries are only
+ *    followed if the ``PKGCONF_PKG_PKGF_SEARCH_PRIVATE`` flag is set on the query.  Resolution errors are reported
+ *    while the graph is built, and can be retrieved afterwards with ``pkgconf_graph_get_errors()``.
+ *
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.  The graph keeps a copy of it.
+ *    :param pkgconf_pkg_t* root: The root of the dependency graph.  It must remain valid while the graph exists.
+ *    :param int maxdepth: The maximum depth to resolve the dependency graph for.  -1 means infinite recursion.
+ *    :return: A dependency graph object.
+ *    :rtype: pkgconf_graph_t *
+ */
+pkgconf_graph_t *
+pkgconf_graph_new_from_pkg(const pkgconf_query_t *query, pkgconf_pkg_t *root, int maxdepth)
+{
+	pkgconf_graph_t *graph = calloc(sizeof(pkgconf_graph_t), 1);
+
+	pkgconf_graph_build(graph, query, root, maxdepth);
+
+	return graph;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_graph_t *pkgconf_graph_new(const pkgconf_query_t *query, pkgconf_list_t *list, int maxdepth)
+ *
+ *    Compiles a dependency resolution queue and resolves the resulting dependency graph up to `maxdepth` levels.
+ *    The root of the graph is a virtual package, owned by the graph, which requires every package in the queue.
+ *
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.  The graph keeps a copy of it.
+ *    :param pkgconf_list_t* list: The list of dependency requests to consider.
+ *    :param int maxdepth: The maximum depth to resolve the dependency graph for.  -1 means infinite recursion.
+ *    :return: A dependency graph object, or ``NULL`` if the queue could not be compiled.
+ *    :rtype: pkgconf_graph_t *
+ */
+pkgconf_graph_t *
+pkgconf_graph_new(const pkgconf_query_t *query, pkgconf_list_t *list, int maxdepth)
+{
+	pkgconf_graph_t *graph = calloc(sizeof(pkgconf_graph_t), 1);
+
+	graph->world.id = "virtual:world";
+	graph->world.realname = "virtual world package";
+	graph->world.flags = PKGCONF_PKG_PROPF_STATIC | PKGCONF_PKG_PROPF_VIRTUAL;
+
+	if (!pkgconf_queue_compile(query->client, &graph->world, list))
+	{
+		pkgconf_dependency_free(&graph->world.requires);
+		free(graph);
+		return NULL;
+	}
+
+	pkgconf_graph_build(graph, query, &graph->world, maxdepth);
+
+	return graph;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_graph_free(pkgconf_graph_t *graph)
+ *
+ *    Releases a dependency graph object and the references it holds on the packages in it.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to release.
+ *    :return: nothing
+ */
+void
+pkgconf_graph_free(pkgconf_graph_t *graph)
+{
+	size_t i;
+
+	if (graph == NULL)
+		return;
+
+	for (i = 1; i < graph->nnodes; i++)
+		pkgconf_pkg_unref(graph->query.client, graph->nodes[i].pkg);
+
+	pkgconf_dependency_free(&graph->world.requires);
+
+	pkgconf_hash_deinit(&graph->index);
+	free(graph->nodes);
+	free(graph->edges);
+	free(graph->order);
+	free(graph);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: unsigned int pkgconf_graph_get_errors(const pkgconf_graph_t *graph)
+ *
+ *    Retrieves the errors found while resolving a dependency graph.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to access.
+ *    :return: ``PKGCONF_PKG_ERRF_OK`` if the whole graph could be resolved, else an error code.
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_graph_get_errors(const pkgconf_graph_t *graph)
+{
+	return graph->eflags;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_graph_traverse(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_traverse_func_t func, void *data)
+ *
+ *    Visits every package in a dependency graph once, in topological order: every package is visited after all of the
+ *    packages which require it.  The query flags are handled as in ``pkgconf_pkg_traverse()``.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to walk.
+ *    :param pkgconf_query_t* query: The query to walk the graph for, or ``NULL`` for the query the graph was built for.
+ *    :param pkgconf_pkg_traverse_func_t func: A traversal function to call for each package in the dependency graph.
+ *    :param void* data: An opaque pointer to data to be passed to the traversal function.
+ *    :return: nothing
+ */
+void
+pkgconf_graph_traverse(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_traverse_func_t func, void *data)
+{
+	if (query == NULL)
+		query = &graph->query;
+
+	pkgconf_graph_visit(graph, query, graph->order, NULL, graph->norder, func, data);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_graph_requires(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_traverse_func_t func, void *data)
+ *
+ *    Visits the packages directly required by the root of a dependency graph, in the order they are required.  For a
+ *    graph built from a queue, these are the packages which were requested.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to access.
+ *    :param pkgconf_query_t* query: The query to pass to the function, or ``NULL`` for the query the graph was built for.
+ *    :param pkgconf_pkg_traverse_func_t func: A function to call for each package directly required by the root.
+ *    :param void* data: An opaque pointer to data to be passed to the function.
+ *    :return: nothing
+ */
+void
+pkgconf_graph_requires(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_traverse_func_t func, void *data)
+{
+	const pkgconf_graph_node_t *root = &graph->nodes[0];
+	size_t i;
+
+	if (query == NULL)
+		query = &graph->query;
+
+	for (i = root->edges; i < root->edges + root->nedges; i++)
+	{
+		if (graph->edges[i].is_private)
+			continue;
+
+		func(query, graph->nodes[graph->edges[i].node].pkg, data);
+	}
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_graph_foreach_pkg(const pkgconf_graph_t *graph, pkgconf_pkg_iteration_func_t func, void *data)
+ *
+ *    Calls a function for every package of a dependency graph, in the order the packages were resolved.  This includes
+ *    the root and the packages which were found but not expanded because of the depth limit.  The iteration stops as
+ *    soon as the function returns true.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to access.
+ *    :param pkgconf_pkg_iteration_func_t func: A function to call for each package.
+ *    :param void* data: An opaque pointer to data to be passed to the function.
+ *    :return: nothing
+ */
+void
+pkgconf_graph_foreach_pkg(const pkgconf_graph_t *graph, pkgconf_pkg_iteration_func_t func, void *data)
+{
+	size_t i;
+
+	for (i = 0; i < graph->nnodes; i++)
+	{
+		if (func(graph->nodes[i].pkg, data))
+			return;
+	}
+}
+
+static void
+pkgconf_graph_cflags_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	pkgconf_fragment_copy_list(query->client, data, &pkg->cflags, false);
+}
+
+static void
+pkgconf_graph_cflags_private_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	pkgconf_fragment_copy_list(query->client, data, &pkg->cflags_private, true);
+}
+
+static void
+pkgconf_graph_link_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	/* copied as private fragments, that is without mergeback, which is done once at the end */
+	pkgconf_fragment_copy_list(query->client, data, &pkg->libs, true);
+
+	if (query->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+		pkgconf_fragment_copy_list(query->client, data, &pkg->libs_private, true);
+}
+
+static void
+pkgconf_graph_libs_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	pkgconf_fragment_copy_list(query->client, data, &pkg->libs, (query->flags & PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE) != 0);
+
+	if (query->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+		pkgconf_fragment_copy_list(query->client, data, &pkg->libs_private, true);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: unsigned int pkgconf_graph_cflags(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list)
+ *
+ *    Extracts the ``CFLAGS`` fragments of every package in a dependency graph.  The dependencies reached through
+ *    ``Requires.private`` are included if the graph was built with the ``PKGCONF_PKG_PKGF_SEARCH_PRIVATE`` flag set.
+ *    The fragments are merged and ordered as ``pkgconf_pkg_cflags()`` does with the default traversal, from the
+ *    first and the last visit of each package only, so the result can differ where a package is reached through
+ *    more than two paths.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to access.
+ *    :param pkgconf_query_t* query: The query to extract the fragments for, or ``NULL`` for the query the graph was built for.
+ *    :param pkgconf_list_t* list: The fragment list to add the extracted ``CFLAGS`` fragments to.
+ *    :return: ``PKGCONF_PKG_ERRF_OK`` if the graph was resolved successfully, otherwise an error code.
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_graph_cflags(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list)
+{
+	size_t *visits = calloc(graph->nnodes * 2, sizeof(size_t));
+	unsigned int *visit_flags = calloc(graph->nnodes * 2, sizeof(unsigned int));
+	size_t count;
+
+	if (query == NULL)
+		query = &graph->query;
+
+	pkgconf_fragment_index_list(list);
+
+	count = pkgconf_graph_visits(graph, false, visits, visit_flags);
+
+	pkgconf_graph_visit(graph, query, visits, visit_flags, count, pkgconf_graph_cflags_collect, list);
+
+	if (query->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+		pkgconf_graph_visit(graph, query, visits, visit_flags, count, pkgconf_graph_cflags_private_collect, list);
+
+	free(visit_flags);
+	free(visits);
+
+	if (graph->eflags != PKGCONF_PKG_ERRF_OK)
+		pkgconf_fragment_free(list);
+
+	return graph->eflags;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: unsigned int pkgconf_graph_libs(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list)
+ *
+ *    Extracts the ``LIBS`` fragments of every package in a dependency graph.  The dependencies reached through
+ *    ``Requires.private`` are only included if the ``PKGCONF_PKG_PKGF_SEARCH_PRIVATE`` flag is set on the query, so
+ *    a single graph built with that flag can answer both a ``CFLAGS`` and a non-static ``LIBS`` query.  The fragments
+ *    are merged and ordered as ``pkgconf_pkg_libs()`` does with the default traversal, from the first and the last
+ *    visit of each package only, so the result can differ where a package is reached through more than two paths.
+ *
+ *    If the ``PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS`` flag is set on the query, the fragments of all packages are gathered
+ *    in topological order, where every package comes after all of the packages requiring it, and the redundant ones
+ *    are then removed in a single pass with ``pkgconf_fragment_minimize()``.  Every library then appears once, after
+ *    all of its users, which gives the shortest link line the linker can resolve without rescanning archives.
+ *
+ *    :param pkgconf_graph_t* graph: The dependency graph to access.
+ *    :param pkgconf_query_t* query: The query to extract the fragments for, or ``NULL`` for the query the graph was built for.
+ *    :param pkgconf_list_t* list: The fragment list to add the extracted ``LIBS`` fragments to.
+ *    :return: ``PKGCONF_PKG_ERRF_OK`` if the graph was resolved successfully, otherwise an error code.
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_graph_libs(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list)
+{
+	bool public_only;
+
+	if (query == NULL)
+		query = &graph->query;
+
+	public_only = (graph->query.flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE) && !(query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE);
+
+	pkgconf_fragment_index_list(list);
+
+	if (query->flags & PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS)
+	{
+		pkgconf_list_t link_list = PKGCONF_LIST_INITIALIZER;
+
+		if (public_only)
+			pkgconf_graph_visit_ordered(graph, query, true, pkgconf_graph_link_collect, &link_list);
+		else
+			pkgconf_graph_visit(graph, query, graph->order, NULL, graph->norder, pkgconf_graph_link_collect, &link_list);
+
+		pkgconf_fragment_minimize(query->client, &link_list);
+		pkgconf_fragment_move_list(list, &link_list);
+	}
+	else
+	{
+		size_t *visits = calloc(graph->nnodes * 2, sizeof(size_t));
+		unsigned int *visit_flags = calloc(graph->nnodes * 2, sizeof(unsigned int));
+		size_t count;
+
+		count = pkgconf_graph_visits(graph, public_only, visits, visit_flags);
+		pkgconf_graph_visit(graph, query, visits, visit_flags, count, pkgconf_graph_libs_collect, list);
+
+		free(visit_flags);
+		free(visits);
+	}
+
+	if (graph->eflags != PKGCONF_PKG_ERRF_OK)
+		pkgconf_fragment_free(list);
+
+	return graph->eflags;
+}
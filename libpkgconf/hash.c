@@ -0,0 +1,329 @@
+/*
+ * hash.c
+ * chained hash tables
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#include <libpkgconf/libpkgconf.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `hash` module
+ * ========================
+ *
+ * The `hash` module provides a small chained hash table used to index objects which would otherwise
+ * have to be found by walking a list, such as the packages already visited during a traversal.
+ *
+ * A table does not own its keys or values.  Several entries may share the same key, in which case
+ * lookups return the most recently inserted one.
+ */
+
+#define PKGCONF_HASH_INITIAL_BUCKETS	16
+
+struct pkgconf_hash_entry_ {
+	pkgconf_hash_entry_t *next;
+
+	uint32_t hash;
+	const void *key;
+	void *value;
+};
+
+/*
+ * !doc
+ *
+ * .. c:function:: uint32_t pkgconf_hash_str(const void *key)
+ *
+ *    Hashes a NUL-terminated string using the 32-bit FNV-1a function.
+ *
+ *    :param void* key: The string to hash.
+ *    :return: the hash value
+ *    :rtype: uint32_t
+ */
+uint32_t
+pkgconf_hash_str(const void *key)
+{
+	const unsigned char *p = key;
+	uint32_t hash = 2166136261U;
+
+	while (*p)
+	{
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: bool pkgconf_hash_str_equal(const void *a, const void *b)
+ *
+ *    Compares two string keys.
+ *
+ *    :param void* a: The first string.
+ *    :param void* b: The second string.
+ *    :return: true if the strings are equal, else false
+ *    :rtype: bool
+ */
+bool
+pkgconf_hash_str_equal(const void *a, const void *b)
+{
+	return !strcmp(a, b);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: uint32_t pkgconf_hash_ptr(const void *key)
+ *
+ *    Hashes a pointer value, for tables keyed by object identity.
+ *
+ *    :param void* key: The pointer to hash.
+ *    :return: the hash value
+ *    :rtype: uint32_t
+ */
+uint32_t
+pkgconf_hash_ptr(const void *key)
+{
+	uint64_t value = (uintptr_t) key;
+
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+
+	return (uint32_t) value;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: bool pkgconf_hash_ptr_equal(const void *a, const void *b)
+ *
+ *    Compares two pointer keys.
+ *
+ *    :param void* a: The first pointer.
+ *    :param void* b: The second pointer.
+ *    :return: true if the pointers are equal, else false
+ *    :rtype: bool
+ */
+bool
+pkgconf_hash_ptr_equal(const void *a, const void *b)
+{
+	return a == b;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_hash_init(pkgconf_hash_t *table, pkgconf_hash_func_t hash_func, pkgconf_hash_equal_func_t equal_func)
+ *
+ *    Initialises an empty hash table.  No memory is allocated until the first insertion.
+ *
+ *    :param pkgconf_hash_t* table: The hash table to initialise.
+ *    :param pkgconf_hash_func_t hash_func: The function used to hash keys.
+ *    :param pkgconf_hash_equal_func_t equal_func: The function used to compare keys.
+ *    :return: nothing
+ */
+void
+pkgconf_hash_init(pkgconf_hash_t *table, pkgconf_hash_func_t hash_func, pkgconf_hash_equal_func_t equal_func)
+{
+	table->buckets = NULL;
+	table->nbuckets = 0;
+	table->count = 0;
+	table->hash_func = hash_func;
+	table->equal_func = equal_func;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_hash_deinit(pkgconf_hash_t *table)
+ *
+ *    Releases the memory used by a hash table.  Keys and values are not freed.
+ *
+ *    :param pkgconf_hash_t* table: The hash table to release.
+ *    :return: nothing
+ */
+void
+pkgconf_hash_deinit(pkgconf_hash_t *table)
+{
+	size_t i;
+
+	for (i = 0; i < table->nbuckets; i++)
+	{
+		pkgconf_hash_entry_t *entry = table->buckets[i];
+
+		while (entry != NULL)
+		{
+			pkgconf_hash_entry_t *next = entry->next;
+
+			free(entry);
+			entry = next;
+		}
+	}
+
+	free(table->buckets);
+
+	table->buckets = NULL;
+	table->nbuckets = 0;
+	table->count = 0;
+}
+
+static void
+pkgconf_hash_grow(pkgconf_hash_t *table)
+{
+	size_t nbuckets = table->nbuckets ? table->nbuckets * 2 : PKGCONF_HASH_INITIAL_BUCKETS;
+	pkgconf_hash_entry_t **buckets = calloc(nbuckets, sizeof(pkgconf_hash_entry_t *));
+	size_t i;
+
+	/* walk each chain backwards so that entries sharing a key keep their relative order */
+	for (i = 0; i < table->nbuckets; i++)
+	{
+		pkgconf_hash_entry_t *entry = table->buckets[i], *reversed = NULL;
+
+		while (entry != NULL)
+		{
+			pkgconf_hash_entry_t *next = entry->next;
+
+			entry->next = reversed;
+			reversed = entry;
+			entry = next;
+		}
+
+		while (reversed != NULL)
+		{
+			pkgconf_hash_entry_t *next = reversed->next;
+			size_t bucket = reversed->hash & (nbuckets - 1);
+
+			reversed->next = buckets[bucket];
+			buckets[bucket] = reversed;
+			reversed = next;
+		}
+	}
+
+	free(table->buckets);
+
+	table->buckets = buckets;
+	table->nbuckets = nbuckets;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_hash_insert(pkgconf_hash_t *table, const void *key, void *value)
+ *
+ *    Adds an entry to a hash table.  An existing entry with the same key is shadowed, not replaced.
+ *
+ *    :param pkgconf_hash_t* table: The hash table to modify.
+ *    :param void* key: The key of the entry, which must remain valid while the entry exists.
+ *    :param void* value: The value of the entry.
+ *    :return: nothing
+ */
+void
+pkgconf_hash_insert(pkgconf_hash_t *table, const void *key, void *value)
+{
+	pkgconf_hash_entry_t *entry;
+	size_t bucket;
+
+	if (table->count >= table->nbuckets)
+		pkgconf_hash_grow(table);
+
+	entry = calloc(sizeof(pkgconf_hash_entry_t), 1);
+	entry->hash = table->hash_func(key);
+	entry->key = key;
+	entry->value = value;
+
+	bucket = entry->hash & (table->nbuckets - 1);
+	entry->next = table->buckets[bucket];
+	table->buckets[bucket] = entry;
+
+	table->count++;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void *pkgconf_hash_lookup(const pkgconf_hash_t *table, const void *key)
+ *
+ *    Looks up the most recently inserted entry for a key.
+ *
+ *    :param pkgconf_hash_t* table: The hash table to search.
+ *    :param void* key: The key to look up.
+ *    :return: the value of the entry, or ``NULL`` if there is none
+ *    :rtype: void *
+ */
+void *
+pkgconf_hash_lookup(const pkgconf_hash_t *table, const void *key)
+{
+	pkgconf_hash_entry_t *entry;
+	uint32_t hash;
+
+	if (table->count == 0)
+		return NULL;
+
+	hash = table->hash_func(key);
+
+	for (entry = table->buckets[hash & (table->nbuckets - 1)]; entry != NULL; entry = entry->next)
+	{
+		if (entry->hash == hash && table->equal_func(entry->key, key))
+			return entry->value;
+	}
+
+	return NULL;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: bool pkgconf_hash_remove(pkgconf_hash_t *table, const void *key, const void *value)
+ *
+ *    Removes an entry from a hash table.  If `value` is not ``NULL``, only an entry with that value is
+ *    removed, which allows a specific entry to be dropped when several share a key.
+ *
+ *    :param pkgconf_hash_t* table: The hash table to modify.
+ *    :param void* key: The key of the entry to remove.
+ *    :param void* value: The value of the entry to remove, or ``NULL`` to remove the most recent entry for `key`.
+ *    :return: true if an entry was removed, else false
+ *    :rtype: bool
+ */
+bool
+pkgconf_hash_remove(pkgconf_hash_t *table, const void *key, const void *value)
+{
+	pkgconf_hash_entry_t **link;
+	uint32_t hash;
+
+	if (table->count == 0)
+		return false;
+
+	hash = table->hash_func(key);
+
+	for (link = &table->buckets[hash & (table->nbuckets - 1)]; *link != NULL; link = &(*link)->next)
+	{
+		pkgconf_hash_entry_t *entry = *link;
+
+		if (entry->hash != hash || !table->equal_func(entry->key, key))
+			continue;
+
+		if (value != NULL && entry->value != value)
+			continue;
+
+		*link = entry->next;
+		free(entry);
+
+		table->count--;
+		return true;
+	}
+
+	return false;
+}
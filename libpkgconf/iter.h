@@ -23,12 +23,17 @@ struct pkgconf_node_ {
 	void *data;
 };
 
+struct pkgconf_hash_;
+
 typedef struct {
 	pkgconf_node_t *head, *tail;
 	size_t length;
+
+	/* optional index of the entries, kept in sync by the module owning the entries */
+	struct pkgconf_hash_ *index;
 } pkgconf_list_t;
 
-#define PKGCONF_LIST_INITIALIZER		{ NULL, NULL, 0 }
+#define PKGCONF_LIST_INITIALIZER		{ NULL, NULL, 0, NULL }
 
 static inline void
 pkgconf_node_insert(pkgconf_node_t *node, void *data, pkgconf_list_t *list)
@@ -52,8 +52,19 @@ typedef struct pkgconf_pkg_ pkgconf_pkg_t;
 typedef struct pkgconf_dependency_ pkgconf_dependency_t;
 typedef struct pkgconf_tuple_ pkgconf_tuple_t;
 typedef struct pkgconf_fragment_ pkgconf_fragment_t;
+typedef struct pkgconf_version_ pkgconf_version_t;
 typedef struct pkgconf_path_ pkgconf_path_t;
 typedef struct pkgconf_client_ pkgconf_client_t;
+typedef struct pkgconf_query_ pkgconf_query_t;
+typedef struct pkgconf_pool_ pkgconf_pool_t;
+typedef struct pkgconf_graph_ pkgconf_graph_t;
+typedef struct pkgconf_prefetch_ pkgconf_prefetch_t;
+typedef struct pkgconf_watch_ pkgconf_watch_t;
+typedef struct pkgconf_watch_query_ pkgconf_watch_query_t;
+typedef struct pkgconf_trace_buffer_ pkgconf_trace_buffer_t;
+typedef struct pkgconf_timings_ pkgconf_timings_t;
+typedef struct pkgconf_profile_ pkgconf_profile_t;
+typedef struct pkgconf_hash_entry_ pkgconf_hash_entry_t;
 
 #define PKGCONF_ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
 
@@ -66,13 +77,29 @@ typedef struct pkgconf_client_ pkgconf_client_t;
 #define PKGCONF_FOREACH_LIST_ENTRY_REVERSE(tail, value) \
 	for ((value) = (tail); (value) != NULL; (value) = (value)->prev)
 
+typedef uint32_t (*pkgconf_hash_func_t)(const void *key);
+typedef bool (*pkgconf_hash_equal_func_t)(const void *a, const void *b);
+
+typedef struct pkgconf_hash_ {
+	pkgconf_hash_entry_t **buckets;
+	size_t nbuckets;
+	size_t count;
+
+	pkgconf_hash_func_t hash_func;
+	pkgconf_hash_equal_func_t equal_func;
+} pkgconf_hash_t;
+
 struct pkgconf_fragment_ {
 	pkgconf_node_t iter;
 
 	char type;
 	char *data;
+
+	unsigned int flags;
 };
 
+#define PKGCONF_FRAGMENT_UNMERGEABLE		0x1
+
 struct pkgconf_dependency_ {
 	pkgconf_node_t iter;
 
@@ -80,6 +107,8 @@ struct pkgconf_dependency_ {
 	pkgconf_pkg_comparator_t compare;
 	char *version;
 	pkgconf_pkg_t *parent;
+
+	pkgconf_version_t *parsed_version;
 };
 
 struct pkgconf_tuple_ {
@@ -103,10 +132,9 @@ struct pkgconf_path_ {
 #define PKGCONF_PKG_PROPF_SEEN			0x04
 #define PKGCONF_PKG_PROPF_UNINSTALLED		0x08
 #define PKGCONF_PKG_PROPF_VIRTUAL		0x10
+#define PKGCONF_PKG_PROPF_SHARED		0x20
 
 struct pkgconf_pkg_ {
-	pkgconf_node_t cache_iter;
-
 	int refcount;
 	char *id;
 	char *filename;
@@ -129,17 +157,24 @@ struct pkgconf_pkg_ {
 	pkgconf_list_t vars;
 
 	unsigned int flags;
+
+	pkgconf_version_t *parsed_version;
 };
 
 typedef bool (*pkgconf_pkg_iteration_func_t)(const pkgconf_pkg_t *pkg, void *data);
-typedef void (*pkgconf_pkg_traverse_func_t)(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data);
-typedef bool (*pkgconf_queue_apply_func_t)(pkgconf_client_t *client, pkgconf_pkg_t *world, void *data, int maxdepth);
+typedef void (*pkgconf_pkg_traverse_func_t)(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data);
+typedef void (*pkgconf_pkg_resolve_func_t)(const pkgconf_query_t *query, pkgconf_pkg_t *parent, pkgconf_pkg_t *pkg, bool is_private, void *data);
+typedef bool (*pkgconf_queue_apply_func_t)(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *data, int maxdepth);
 typedef bool (*pkgconf_error_handler_func_t)(const char *msg, const pkgconf_client_t *client, const void *data);
 
 struct pkgconf_client_ {
 	pkgconf_list_t dir_list;
 	pkgconf_list_t pkg_cache;
 
+	/* the cached packages indexed by id, and their cache nodes indexed by package */
+	pkgconf_hash_t pkg_cache_ids;
+	pkgconf_hash_t pkg_cache_nodes;
+
 	pkgconf_list_t filter_libdirs;
 	pkgconf_list_t filter_includedirs;
 
@@ -158,14 +193,43 @@ struct pkgconf_client_ {
 	char *sysroot_dir;
 	char *buildroot_dir;
 
+	/* precomputed for fragment munging: the length of sysroot_dir, and the value of $(pc_sysrootdir) */
+	size_t sysroot_dir_len;
+	const char *sysroot_var;
+	size_t sysroot_var_len;
+
 	unsigned int flags;
 
 	char *prefix_varname;
+
+	/* whether the hint about PKG_CONFIG_PATH was already given for a missing package, set atomically */
+	volatile int not_found_notice_sent;
+
+	pkgconf_pool_t *pool;
+	pkgconf_prefetch_t *prefetch;
+
+	/* see the trace module: whether any message can be delivered, and the levels filtered out */
+	bool trace_active;
+	unsigned int trace_filter;
+	pkgconf_trace_buffer_t *trace_buffer;
+
+	/* see the timing module, NULL unless timings are being collected */
+	pkgconf_timings_t *timings;
+
+	/* see the profile module, NULL unless packages are being profiled */
+	pkgconf_profile_t *profile;
+};
+
+/* see the queue module: the client a query looks packages up with, and the flags it is resolved with */
+struct pkgconf_query_ {
+	pkgconf_client_t *client;
+	unsigned int flags;
 };
 
 /* client.c */
 PKGCONF_API void pkgconf_client_init(pkgconf_client_t *client, pkgconf_error_handler_func_t error_handler, void *error_handler_data);
 PKGCONF_API pkgconf_client_t * pkgconf_client_new(pkgconf_error_handler_func_t error_handler, void *error_handler_data);
+PKGCONF_API pkgconf_client_t * pkgconf_client_clone(pkgconf_client_t *parent);
 PKGCONF_API void pkgconf_client_deinit(pkgconf_client_t *client);
 PKGCONF_API void pkgconf_client_free(pkgconf_client_t *client);
 PKGCONF_API const char *pkgconf_client_get_sysroot_dir(const pkgconf_client_t *client);
@@ -200,6 +264,9 @@ PKGCONF_API void pkgconf_client_set_trace_handler(pkgconf_client_t *client, pkgc
 #define PKGCONF_PKG_PKGF_REDEFINE_PREFIX		0x0400
 #define PKGCONF_PKG_PKGF_DONT_RELOCATE_PATHS		0x0800
 #define PKGCONF_PKG_PKGF_SIMPLIFY_ERRORS		0x1000
+#define PKGCONF_PKG_PKGF_TRAVERSE_ONCE			0x2000
+#define PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH		0x4000
+#define PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS		0x8000
 
 #define PKGCONF_PKG_ERRF_OK			0x0
 #define PKGCONF_PKG_ERRF_PACKAGE_NOT_FOUND	0x1
@@ -223,33 +290,147 @@ PKGCONF_API bool pkgconf_warn(const pkgconf_client_t *client, const char *format
 PKGCONF_API bool pkgconf_trace(const pkgconf_client_t *client, const char *filename, size_t lineno, const char *funcname, const char *format, ...) PRINTFLIKE(5, 6);
 PKGCONF_API bool pkgconf_default_error_handler(const char *msg, const pkgconf_client_t *client, const void *data);
 
-#if defined(__GNUC__) || defined(__INTEL_COMPILER)
-#define PKGCONF_TRACE(client, ...) do { \
-		pkgconf_trace(client, __FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__); \
+typedef enum {
+	PKGCONF_TRACE_GENERAL = 0,
+	PKGCONF_TRACE_CLIENT,
+	PKGCONF_TRACE_CACHE,
+	PKGCONF_TRACE_PKG,
+	PKGCONF_TRACE_PARSER,
+	PKGCONF_TRACE_DEPENDENCY,
+	PKGCONF_TRACE_FRAGMENT,
+	PKGCONF_TRACE_GRAPH,
+	PKGCONF_TRACE_POOL,
+	PKGCONF_TRACE_SUBSYSTEM_COUNT
+} pkgconf_trace_subsystem_t;
+
+#define PKGCONF_TRACE_LEVEL_NONE		0
+#define PKGCONF_TRACE_LEVEL_INFO		1
+#define PKGCONF_TRACE_LEVEL_VERBOSE		2
+
+#define PKGCONF_TRACE_FILTER_BIT(subsystem, level)	(1U << ((subsystem) * 2 + (level) - 1))
+#define PKGCONF_TRACE_ENABLED(client, subsystem, level) \
+	((client)->trace_active && !((client)->trace_filter & PKGCONF_TRACE_FILTER_BIT(subsystem, level)))
+
+/* the subsystem of PKGCONF_TRACE() messages, may be defined before including this header */
+#ifndef PKGCONF_TRACE_SUBSYSTEM
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_GENERAL
+#endif
+
+#if defined(PKGCONF_DISABLE_TRACE)
+/* the call is dead code, so the arguments stay referenced but nothing is emitted */
+#define PKGCONF_TRACE_AT(client, subsystem, level, ...) do { \
+		if (0) \
+			pkgconf_trace(client, __FILE__, __LINE__, __func__, __VA_ARGS__); \
+	} while (0);
+#elif defined(__GNUC__) || defined(__INTEL_COMPILER)
+#define PKGCONF_TRACE_AT(client, subsystem, level, ...) do { \
+		if (PKGCONF_TRACE_ENABLED(client, subsystem, level)) \
+			pkgconf_trace(client, __FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__); \
 	} while (0);
 #else
-#define PKGCONF_TRACE(client, ...) do { \
-		pkgconf_trace(client, __FILE__, __LINE__, __func__, __VA_ARGS__); \
+#define PKGCONF_TRACE_AT(client, subsystem, level, ...) do { \
+		if (PKGCONF_TRACE_ENABLED(client, subsystem, level)) \
+			pkgconf_trace(client, __FILE__, __LINE__, __func__, __VA_ARGS__); \
 	} while (0);
 #endif
 
+#define PKGCONF_TRACE(client, ...) PKGCONF_TRACE_AT(client, PKGCONF_TRACE_SUBSYSTEM, PKGCONF_TRACE_LEVEL_INFO, __VA_ARGS__)
+#define PKGCONF_TRACE_VERBOSE(client, ...) PKGCONF_TRACE_AT(client, PKGCONF_TRACE_SUBSYSTEM, PKGCONF_TRACE_LEVEL_VERBOSE, __VA_ARGS__)
+
 PKGCONF_API pkgconf_pkg_t *pkgconf_pkg_ref(const pkgconf_client_t *client, pkgconf_pkg_t *pkg);
 PKGCONF_API void pkgconf_pkg_unref(pkgconf_client_t *client, pkgconf_pkg_t *pkg);
 PKGCONF_API void pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg);
 PKGCONF_API pkgconf_pkg_t *pkgconf_pkg_find(pkgconf_client_t *client, const char *name);
-PKGCONF_API unsigned int pkgconf_pkg_traverse(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_pkg_traverse_func_t func, void *data, int maxdepth);
-PKGCONF_API unsigned int pkgconf_pkg_verify_graph(pkgconf_client_t *client, pkgconf_pkg_t *root, int depth);
-PKGCONF_API pkgconf_pkg_t *pkgconf_pkg_verify_dependency(pkgconf_client_t *client, pkgconf_dependency_t *pkgdep, unsigned int *eflags);
+PKGCONF_API void pkgconf_pkg_preload(const pkgconf_client_t *client, const char *name);
+PKGCONF_API unsigned int pkgconf_pkg_traverse(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_pkg_traverse_func_t func, void *data, int maxdepth);
+PKGCONF_API unsigned int pkgconf_pkg_verify_graph(const pkgconf_query_t *query, pkgconf_pkg_t *root, int depth);
+PKGCONF_API unsigned int pkgconf_pkg_resolve(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, pkgconf_pkg_resolve_func_t func, void *data);
+PKGCONF_API pkgconf_pkg_t *pkgconf_pkg_verify_dependency(const pkgconf_query_t *query, pkgconf_dependency_t *pkgdep, unsigned int *eflags);
+PKGCONF_API unsigned int pkgconf_pkg_verify_conflicts(const pkgconf_query_t *query, pkgconf_pkg_t *const *pkgs, size_t npkgs);
 PKGCONF_API const char *pkgconf_pkg_get_comparator(const pkgconf_dependency_t *pkgdep);
-PKGCONF_API unsigned int pkgconf_pkg_cflags(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth);
-PKGCONF_API unsigned int pkgconf_pkg_libs(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth);
+PKGCONF_API unsigned int pkgconf_pkg_cflags(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth);
+PKGCONF_API unsigned int pkgconf_pkg_libs(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth);
+PKGCONF_API unsigned int pkgconf_pkg_collect(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *cflags, pkgconf_list_t *libs, int maxdepth);
 PKGCONF_API pkgconf_pkg_comparator_t pkgconf_pkg_comparator_lookup_by_name(const char *name);
 PKGCONF_API pkgconf_pkg_t *pkgconf_builtin_pkg_get(const char *name);
 
 PKGCONF_API int pkgconf_compare_version(const char *a, const char *b);
+PKGCONF_API pkgconf_version_t *pkgconf_version_parse(const char *version);
+PKGCONF_API void pkgconf_version_free(pkgconf_version_t *version);
+PKGCONF_API int pkgconf_version_compare(const pkgconf_version_t *a, const pkgconf_version_t *b);
 PKGCONF_API pkgconf_pkg_t *pkgconf_scan_all(pkgconf_client_t *client, void *ptr, pkgconf_pkg_iteration_func_t func);
 PKGCONF_API void pkgconf_pkg_dir_list_build(pkgconf_client_t *client);
 
+/* trace.c */
+PKGCONF_API void pkgconf_client_set_trace_level(pkgconf_client_t *client, pkgconf_trace_subsystem_t subsystem, unsigned int level);
+PKGCONF_API unsigned int pkgconf_client_get_trace_level(const pkgconf_client_t *client, pkgconf_trace_subsystem_t subsystem);
+PKGCONF_API void pkgconf_client_set_trace_buffer(pkgconf_client_t *client, size_t nrecords);
+PKGCONF_API void pkgconf_client_dump_trace_buffer(const pkgconf_client_t *client, FILE *out);
+
+/* timing.c */
+typedef enum {
+	PKGCONF_TIMING_PATH_SETUP = 0,
+	PKGCONF_TIMING_LOOKUP,
+	PKGCONF_TIMING_PARSE,
+	PKGCONF_TIMING_TRAVERSE,
+	PKGCONF_TIMING_RENDER,
+	PKGCONF_TIMING_PHASE_COUNT
+} pkgconf_timing_phase_t;
+
+typedef struct {
+	uint64_t elapsed_ns;
+	size_t count;
+} pkgconf_timing_t;
+
+#define PKGCONF_TIMING_BEGIN(client, phase, subject) do { \
+		if ((client)->timings != NULL) \
+			pkgconf_timing_begin(client, phase, subject); \
+	} while (0)
+#define PKGCONF_TIMING_END(client, phase) do { \
+		if ((client)->timings != NULL) \
+			pkgconf_timing_end(client, phase); \
+	} while (0)
+
+PKGCONF_API uint64_t pkgconf_timing_now(void);
+PKGCONF_API void pkgconf_client_set_timings(pkgconf_client_t *client, bool enabled);
+PKGCONF_API void pkgconf_client_set_trace_events(pkgconf_client_t *client, FILE *out);
+PKGCONF_API bool pkgconf_client_get_timing(const pkgconf_client_t *client, pkgconf_timing_phase_t phase, pkgconf_timing_t *timing);
+PKGCONF_API uint64_t pkgconf_client_get_timings_total(const pkgconf_client_t *client);
+PKGCONF_API void pkgconf_client_dump_timings(const pkgconf_client_t *client, FILE *out);
+PKGCONF_API const char *pkgconf_timing_phase_name(pkgconf_timing_phase_t phase);
+PKGCONF_API void pkgconf_timing_begin(const pkgconf_client_t *client, pkgconf_timing_phase_t phase, const char *subject);
+PKGCONF_API void pkgconf_timing_end(const pkgconf_client_t *client, pkgconf_timing_phase_t phase);
+
+/* profile.c */
+typedef enum {
+	PKGCONF_PROFILE_LOOKUPS = 0,
+	PKGCONF_PROFILE_PROBES,
+	PKGCONF_PROFILE_PARSES,
+	PKGCONF_PROFILE_VISITS,
+	PKGCONF_PROFILE_FRAGMENTS,
+	PKGCONF_PROFILE_DEDUPLICATED,
+	PKGCONF_PROFILE_COUNTER_COUNT
+} pkgconf_profile_counter_t;
+
+typedef struct {
+	const char *package;
+	size_t counters[PKGCONF_PROFILE_COUNTER_COUNT];
+	uint64_t parse_ns;
+} pkgconf_profile_entry_t;
+
+#define PKGCONF_PROFILE_COUNT(client, package, counter) do { \
+		if ((client)->profile != NULL) \
+			pkgconf_profile_count(client, package, counter, 1); \
+	} while (0)
+
+PKGCONF_API void pkgconf_client_set_profile(pkgconf_client_t *client, bool enabled);
+PKGCONF_API const pkgconf_profile_entry_t *pkgconf_client_get_profile(const pkgconf_client_t *client, const char *package);
+PKGCONF_API void pkgconf_client_dump_profile(const pkgconf_client_t *client, FILE *out);
+PKGCONF_API void pkgconf_profile_count(const pkgconf_client_t *client, const char *package, pkgconf_profile_counter_t counter, size_t n);
+PKGCONF_API void pkgconf_profile_parse(const pkgconf_client_t *client, const char *package, uint64_t elapsed_ns);
+PKGCONF_API void pkgconf_profile_visit(const pkgconf_client_t *client, const char *package);
+PKGCONF_API void pkgconf_profile_fragments(const pkgconf_client_t *client, size_t copied, size_t added);
+
 /* parse.c */
 PKGCONF_API pkgconf_pkg_t *pkgconf_pkg_new_from_file(pkgconf_client_t *client, const char *path, FILE *f);
 PKGCONF_API void pkgconf_dependency_parse_str(const pkgconf_client_t *client, pkgconf_list_t *deplist_head, const char *depends);
@@ -257,6 +438,7 @@ PKGCONF_API void pkgconf_dependency_parse(const pkgconf_client_t *client, pkgcon
 PKGCONF_API void pkgconf_dependency_append(pkgconf_list_t *list, pkgconf_dependency_t *tail);
 PKGCONF_API void pkgconf_dependency_free(pkgconf_list_t *list);
 PKGCONF_API const char *pkgconf_dependency_to_str(const pkgconf_dependency_t *dep);
+PKGCONF_API const char *pkgconf_dependency_to_str_r(const pkgconf_dependency_t *dep, char *buf, size_t buflen);
 PKGCONF_API pkgconf_dependency_t *pkgconf_dependency_add(const pkgconf_client_t *client, pkgconf_list_t *list, const char *package, const char *version, pkgconf_pkg_comparator_t compare);
 
 /* argvsplit.c */
@@ -268,12 +450,17 @@ typedef bool (*pkgconf_fragment_filter_func_t)(const pkgconf_client_t *client, c
 PKGCONF_API void pkgconf_fragment_parse(const pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_list_t *vars, const char *value);
 PKGCONF_API void pkgconf_fragment_add(const pkgconf_client_t *client, pkgconf_list_t *list, const char *string);
 PKGCONF_API void pkgconf_fragment_copy(const pkgconf_client_t *client, pkgconf_list_t *list, const pkgconf_fragment_t *base, bool is_private);
+PKGCONF_API void pkgconf_fragment_copy_list(const pkgconf_client_t *client, pkgconf_list_t *list, const pkgconf_list_t *base, bool is_private);
+PKGCONF_API void pkgconf_fragment_minimize(const pkgconf_client_t *client, pkgconf_list_t *list);
+PKGCONF_API void pkgconf_fragment_index_list(pkgconf_list_t *list);
+PKGCONF_API void pkgconf_fragment_move_list(pkgconf_list_t *list, pkgconf_list_t *src);
 PKGCONF_API void pkgconf_fragment_delete(pkgconf_list_t *list, pkgconf_fragment_t *node);
 PKGCONF_API void pkgconf_fragment_free(pkgconf_list_t *list);
 PKGCONF_API void pkgconf_fragment_filter(const pkgconf_client_t *client, pkgconf_list_t *dest, pkgconf_list_t *src, pkgconf_fragment_filter_func_t filter_func, void *data);
 PKGCONF_API size_t pkgconf_fragment_render_len(const pkgconf_list_t *list, bool escape);
 PKGCONF_API void pkgconf_fragment_render_buf(const pkgconf_list_t *list, char *buf, size_t len, bool escape);
 PKGCONF_API char *pkgconf_fragment_render(const pkgconf_list_t *list, bool escape);
+PKGCONF_API void pkgconf_fragment_render_file(const pkgconf_list_t *list, FILE *out, bool escape);
 PKGCONF_API bool pkgconf_fragment_has_system_dir(const pkgconf_client_t *client, const pkgconf_fragment_t *frag);
 
 /* fileio.c */
@@ -290,12 +477,61 @@ PKGCONF_API char *pkgconf_tuple_find_global(const pkgconf_client_t *client, cons
 PKGCONF_API void pkgconf_tuple_free_global(pkgconf_client_t *client);
 PKGCONF_API void pkgconf_tuple_define_global(pkgconf_client_t *client, const char *kv);
 
+/* pool.c */
+PKGCONF_API pkgconf_pool_t *pkgconf_pool_new(void);
+PKGCONF_API pkgconf_pool_t *pkgconf_pool_ref(pkgconf_pool_t *pool);
+PKGCONF_API void pkgconf_pool_unref(pkgconf_pool_t *pool);
+PKGCONF_API pkgconf_pkg_t *pkgconf_pool_lookup(pkgconf_pool_t *pool, const char *key);
+PKGCONF_API pkgconf_pkg_t *pkgconf_pool_insert(pkgconf_pool_t *pool, const char *key, pkgconf_pkg_t *pkg);
+PKGCONF_API bool pkgconf_pool_evict(pkgconf_pool_t *pool, const pkgconf_pkg_t *pkg);
+PKGCONF_API void pkgconf_client_set_pool(pkgconf_client_t *client, pkgconf_pool_t *pool);
+PKGCONF_API pkgconf_pool_t *pkgconf_client_get_pool(const pkgconf_client_t *client);
+
+/* prefetch.c */
+PKGCONF_API void pkgconf_client_set_prefetch_threads(pkgconf_client_t *client, size_t nthreads);
+PKGCONF_API size_t pkgconf_client_get_prefetch_threads(const pkgconf_client_t *client);
+
+/* graph.c */
+PKGCONF_API pkgconf_graph_t *pkgconf_graph_new(const pkgconf_query_t *query, pkgconf_list_t *list, int maxdepth);
+PKGCONF_API pkgconf_graph_t *pkgconf_graph_new_from_pkg(const pkgconf_query_t *query, pkgconf_pkg_t *root, int maxdepth);
+PKGCONF_API void pkgconf_graph_free(pkgconf_graph_t *graph);
+PKGCONF_API unsigned int pkgconf_graph_get_errors(const pkgconf_graph_t *graph);
+PKGCONF_API void pkgconf_graph_traverse(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_traverse_func_t func, void *data);
+PKGCONF_API void pkgconf_graph_requires(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_pkg_traverse_func_t func, void *data);
+PKGCONF_API void pkgconf_graph_foreach_pkg(const pkgconf_graph_t *graph, pkgconf_pkg_iteration_func_t func, void *data);
+PKGCONF_API unsigned int pkgconf_graph_cflags(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list);
+PKGCONF_API unsigned int pkgconf_graph_libs(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list);
+
+/* watch.c */
+PKGCONF_API pkgconf_watch_t *pkgconf_watch_new(pkgconf_client_t *client, int maxdepth);
+PKGCONF_API void pkgconf_watch_free(pkgconf_watch_t *watch);
+PKGCONF_API pkgconf_watch_query_t *pkgconf_watch_add(pkgconf_watch_t *watch, const char *packages);
+PKGCONF_API void pkgconf_watch_remove(pkgconf_watch_t *watch, pkgconf_watch_query_t *query);
+PKGCONF_API pkgconf_graph_t *pkgconf_watch_query_get_graph(pkgconf_watch_query_t *query);
+PKGCONF_API const pkgconf_list_t *pkgconf_watch_query_cflags(pkgconf_watch_query_t *query, unsigned int *eflags);
+PKGCONF_API const pkgconf_list_t *pkgconf_watch_query_libs(pkgconf_watch_query_t *query, unsigned int *eflags);
+PKGCONF_API size_t pkgconf_watch_invalidate(pkgconf_watch_t *watch, const char *name);
+PKGCONF_API size_t pkgconf_watch_refresh(pkgconf_watch_t *watch);
+
+/* hash.c */
+PKGCONF_API void pkgconf_hash_init(pkgconf_hash_t *table, pkgconf_hash_func_t hash_func, pkgconf_hash_equal_func_t equal_func);
+PKGCONF_API void pkgconf_hash_deinit(pkgconf_hash_t *table);
+PKGCONF_API void pkgconf_hash_insert(pkgconf_hash_t *table, const void *key, void *value);
+PKGCONF_API void *pkgconf_hash_lookup(const pkgconf_hash_t *table, const void *key);
+PKGCONF_API bool pkgconf_hash_remove(pkgconf_hash_t *table, const void *key, const void *value);
+PKGCONF_API uint32_t pkgconf_hash_str(const void *key);
+PKGCONF_API bool pkgconf_hash_str_equal(const void *a, const void *b);
+PKGCONF_API uint32_t pkgconf_hash_ptr(const void *key);
+PKGCONF_API bool pkgconf_hash_ptr_equal(const void *a, const void *b);
+
 /* queue.c */
+PKGCONF_API void pkgconf_query_init(pkgconf_query_t *query, pkgconf_client_t *client, unsigned int flags);
 PKGCONF_API void pkgconf_queue_push(pkgconf_list_t *list, const char *package);
 PKGCONF_API bool pkgconf_queue_compile(pkgconf_client_t *client, pkgconf_pkg_t *world, pkgconf_list_t *list);
 PKGCONF_API void pkgconf_queue_free(pkgconf_list_t *list);
-PKGCONF_API bool pkgconf_queue_apply(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data);
-PKGCONF_API bool pkgconf_queue_validate(pkgconf_client_t *client, pkgconf_list_t *list, int maxdepth);
+PKGCONF_API bool pkgconf_queue_apply(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data);
+PKGCONF_API bool pkgconf_queue_validate(const pkgconf_query_t *query, pkgconf_list_t *list, int maxdepth);
+PKGCONF_API bool pkgconf_queue_solve(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_pkg_t *world, int maxdepth);
 
 /* cache.c */
 PKGCONF_API pkgconf_pkg_t *pkgconf_cache_lookup(const pkgconf_client_t *client, const char *id);
@@ -313,6 +549,7 @@ PKGCONF_API void pkgconf_path_add(const char *text, pkgconf_list_t *dirlist, boo
 PKGCONF_API size_t pkgconf_path_split(const char *text, pkgconf_list_t *dirlist, bool filter);
 PKGCONF_API size_t pkgconf_path_build_from_environ(const char *envvarname, const char *fallback, pkgconf_list_t *dirlist, bool filter);
 PKGCONF_API bool pkgconf_path_match_list(const char *path, const pkgconf_list_t *dirlist);
+PKGCONF_API void pkgconf_path_copy_list(pkgconf_list_t *dst, const pkgconf_list_t *src);
 PKGCONF_API void pkgconf_path_free(pkgconf_list_t *dirlist);
 PKGCONF_API bool pkgconf_path_relocate(char *buf, size_t buflen);
 
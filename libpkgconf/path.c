@@ -141,12 +141,20 @@ pkgconf_path_split(const char *text, pkgconf_list_t *dirlist, bool filter)
 	if (text == NULL)
 		return 0;
 
+	/* not strtok(), which keeps its position in hidden static state shared by every thread */
 	iter = workbuf = strdup(text);
-	while ((p = strtok(iter, PKG_CONFIG_PATH_SEP_S)) != NULL)
+	while (iter != NULL)
 	{
-		pkgconf_path_add(p, dirlist, filter);
+		p = iter;
+		if ((iter = strpbrk(iter, PKG_CONFIG_PATH_SEP_S)) != NULL)
+			*iter++ = '\0';
+
+		/* like strtok(), skip empty elements */
+		if (*p == '\0')
+			continue;
 
-		count++, iter = NULL;
+		pkgconf_path_add(p, dirlist, filter);
+		count++;
 	}
 	free(workbuf);
 
@@ -218,6 +226,36 @@ pkgconf_path_match_list(const char *path, const pkgconf_list_t *dirlist)
 	return false;
 }
 
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_path_copy_list(pkgconf_list_t *dst, const pkgconf_list_t *src)
+ *
+ *    Appends copies of the path nodes of one path list to another.  The copies keep the identity the
+ *    paths were filtered by, so unlike adding the paths again, this does not touch the filesystem.
+ *
+ *    :param pkgconf_list_t* dst: The path list to append the copies to.
+ *    :param pkgconf_list_t* src: The path list to copy.
+ *    :return: nothing
+ */
+void
+pkgconf_path_copy_list(pkgconf_list_t *dst, const pkgconf_list_t *src)
+{
+	pkgconf_node_t *n;
+
+	PKGCONF_FOREACH_LIST_ENTRY(src->head, n)
+	{
+		const pkgconf_path_t *srcpath = n->data;
+		pkgconf_path_t *path = calloc(sizeof(pkgconf_path_t), 1);
+
+		path->path = strdup(srcpath->path);
+		path->handle_path = srcpath->handle_path;
+		path->handle_device = srcpath->handle_device;
+
+		pkgconf_node_insert_tail(&path->lnode, path, dst);
+	}
+}
+
 /*
  * !doc
  *
@@ -242,31 +280,25 @@ pkgconf_path_free(pkgconf_list_t *dirlist)
 	}
 }
 
-static char *
-normpath(const char *path)
+/*
+ * normpath(path)
+ *
+ * collapse runs of slashes in a path.  the path only ever shrinks, so this is done in place.
+ */
+static void
+normpath(char *path)
 {
-	if (!path)
-		return NULL;
-
-	char *copy = strdup(path);
-	if (NULL == copy)
-		return NULL;
-	char *ptr = copy;
+	char *src, *dst;
 
-	for (int ii = 0; copy[ii]; ii++)
+	for (src = dst = path; *src; src++)
 	{
-		*ptr++ = path[ii];
-		if ('/' == path[ii])
-		{
-			ii++;
-			while ('/' == path[ii])
-				ii++;
-			ii--;
-		}
+		if (*src == '/' && dst > path && dst[-1] == '/')
+			continue;
+
+		*dst++ = *src;
 	}
-	*ptr = '\0';
 
-	return copy;
+	*dst = '\0';
 }
 
 /*
@@ -306,20 +338,9 @@ pkgconf_path_relocate(char *buf, size_t buflen)
 			*ti = '/';
 	}
 #else
-	char *tmpbuf;
-
-	if ((tmpbuf = normpath(buf)) != NULL)
-	{
-		size_t tmpbuflen = strlen(tmpbuf);
-		if (tmpbuflen > buflen)
-		{
-			free(tmpbuf);
-			return false;
-		}
+	(void) buflen;
 
-		pkgconf_strlcpy(buf, tmpbuf, buflen);
-		free(tmpbuf);
-	}
+	normpath(buf);
 #endif
 
 	return true;
@@ -13,8 +13,16 @@
  * from the use of this software.
  */
 
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_PKG
+
 #include <libpkgconf/config.h>
 #include <libpkgconf/libpkgconf.h>
+#include <libpkgconf/probes.h>
+#include <libpkgconf/thread.h>
+
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
 
 /*
  * !doc
@@ -50,10 +58,9 @@ str_has_suffix(const char *str, const char *suffix)
 }
 
 static inline const char *
-get_default_pkgconfig_path(void)
+get_default_pkgconfig_path(char *outbuf, size_t outlen)
 {
 #ifdef _WIN32
-	static char outbuf[MAX_PATH];
 	char namebuf[MAX_PATH];
 	char *p;
 
@@ -69,27 +76,29 @@ get_default_pkgconfig_path(void)
 		return PKG_DEFAULT_PATH;
 
 	*p = '\0';
-	pkgconf_strlcpy(outbuf, namebuf, sizeof outbuf);
-	pkgconf_strlcat(outbuf, "/", sizeof outbuf);
-	pkgconf_strlcat(outbuf, "../lib/pkgconfig", sizeof outbuf);
-	pkgconf_strlcat(outbuf, ";", sizeof outbuf);
-	pkgconf_strlcat(outbuf, namebuf, sizeof outbuf);
-	pkgconf_strlcat(outbuf, "/", sizeof outbuf);
-	pkgconf_strlcat(outbuf, "../share/pkgconfig", sizeof outbuf);
+	pkgconf_strlcpy(outbuf, namebuf, outlen);
+	pkgconf_strlcat(outbuf, "/", outlen);
+	pkgconf_strlcat(outbuf, "../lib/pkgconfig", outlen);
+	pkgconf_strlcat(outbuf, ";", outlen);
+	pkgconf_strlcat(outbuf, namebuf, outlen);
+	pkgconf_strlcat(outbuf, "/", outlen);
+	pkgconf_strlcat(outbuf, "../share/pkgconfig", outlen);
 
 	return outbuf;
+#else
+	(void) outbuf;
+	(void) outlen;
 #endif
 
 	return PKG_DEFAULT_PATH;
 }
 
 static const char *
-pkg_get_parent_dir(pkgconf_pkg_t *pkg)
+pkg_get_parent_dir(pkgconf_pkg_t *pkg, char *buf, size_t buflen)
 {
-	static char buf[PKGCONF_BUFSIZE];
 	char *pathbuf;
 
-	pkgconf_strlcpy(buf, pkg->filename, sizeof buf);
+	pkgconf_strlcpy(buf, pkg->filename, buflen);
 	pathbuf = strrchr(buf, PKG_DIR_SEP_S);
 	if (pathbuf == NULL)
 		pathbuf = strrchr(buf, '/');
@@ -114,10 +123,16 @@ pkg_get_parent_dir(pkgconf_pkg_t *pkg)
 void
 pkgconf_pkg_dir_list_build(pkgconf_client_t *client)
 {
+	char pathbuf[PKGCONF_BUFSIZE];
+
+	PKGCONF_TIMING_BEGIN(client, PKGCONF_TIMING_PATH_SETUP, NULL);
+
 	pkgconf_path_build_from_environ("PKG_CONFIG_PATH", NULL, &client->dir_list, true);
 
 	if (!(client->flags & PKGCONF_PKG_PKGF_ENV_ONLY))
-		pkgconf_path_build_from_environ("PKG_CONFIG_LIBDIR", get_default_pkgconfig_path(), &client->dir_list, true);
+		pkgconf_path_build_from_environ("PKG_CONFIG_LIBDIR", get_default_pkgconfig_path(pathbuf, sizeof pathbuf), &client->dir_list, true);
+
+	PKGCONF_TIMING_END(client, PKGCONF_TIMING_PATH_SETUP);
 }
 
 typedef void (*pkgconf_pkg_parser_keyword_func_t)(const pkgconf_client_t *client, pkgconf_pkg_t *pkg, const ptrdiff_t offset, char *value);
@@ -184,13 +199,12 @@ pkgconf_pkg_parser_keyword_set(const pkgconf_client_t *client, pkgconf_pkg_t *pk
 }
 
 static const char *
-determine_prefix(const pkgconf_pkg_t *pkg)
+determine_prefix(const pkgconf_pkg_t *pkg, char *buf, size_t buflen)
 {
-	static char buf[PKGCONF_BUFSIZE];
 	char *pathiter;
 
-	pkgconf_strlcpy(buf, pkg->filename, sizeof buf);
-	pkgconf_path_relocate(buf, sizeof buf);
+	pkgconf_strlcpy(buf, pkg->filename, buflen);
+	pkgconf_path_relocate(buf, buflen);
 
 	pathiter = strrchr(buf, PKG_DIR_SEP_S);
 	if (pathiter == NULL)
@@ -252,30 +266,81 @@ pkgconf_pkg_validate(const pkgconf_client_t *client, const pkgconf_pkg_t *pkg)
 	return valid;
 }
 
+/* client flags which change the result of parsing a .pc file */
+#define PKGCONF_PKG_POOL_FLAGS_MASK	(PKGCONF_PKG_PKGF_REDEFINE_PREFIX | PKGCONF_PKG_PKGF_DONT_RELOCATE_PATHS)
+
 /*
- * !doc
+ * pkgconf_pkg_pool_key(client, filename, f, propflags)
  *
- * .. c:function:: pkgconf_pkg_t *pkgconf_pkg_new_from_file(const pkgconf_client_t *client, const char *filename, FILE *f)
- *
- *    Parse a .pc file into a pkgconf_pkg_t object structure.
- *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
- *    :param char* filename: The filename of the package file (including full path).
- *    :param FILE* f: The file object to read from.
- *    :returns: A ``pkgconf_pkg_t`` object which contains the package data.
- *    :rtype: pkgconf_pkg_t *
+ * build the key identifying a parsed package in a package pool: the file identity followed by
+ * every client setting which is consulted while parsing.  returns NULL if the file identity
+ * cannot be determined, in which case the package is simply not pooled.
  */
-pkgconf_pkg_t *
-pkgconf_pkg_new_from_file(pkgconf_client_t *client, const char *filename, FILE *f)
+static char *
+pkgconf_pkg_pool_key(const pkgconf_client_t *client, const char *filename, FILE *f, unsigned int propflags)
+{
+#ifdef HAVE_SYS_STAT_H
+	struct stat st;
+	char idbuf[256];
+	const char *sysroot_dir = client->sysroot_dir != NULL ? client->sysroot_dir : "";
+	const char *prefix_varname = client->prefix_varname != NULL ? client->prefix_varname : "";
+	pkgconf_node_t *n;
+	size_t len;
+	char *key;
+
+	if (fstat(fileno(f), &st) == -1)
+		return NULL;
+
+	snprintf(idbuf, sizeof idbuf, "%llu:%llu:%lld:%lld:%x:%x",
+		(unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+		(long long) st.st_size, (long long) st.st_mtime,
+		propflags, client->flags & PKGCONF_PKG_POOL_FLAGS_MASK);
+
+	len = strlen(filename) + strlen(idbuf) + strlen(sysroot_dir) + strlen(prefix_varname) + 5;
+	PKGCONF_FOREACH_LIST_ENTRY(client->global_vars.head, n)
+	{
+		const pkgconf_tuple_t *tuple = n->data;
+
+		len += strlen(tuple->key) + strlen(tuple->value) + 2;
+	}
+
+	key = malloc(len);
+	snprintf(key, len, "%s\n%s\n%s\n%s\n", filename, idbuf, sysroot_dir, prefix_varname);
+
+	PKGCONF_FOREACH_LIST_ENTRY(client->global_vars.head, n)
+	{
+		const pkgconf_tuple_t *tuple = n->data;
+
+		pkgconf_strlcat(key, tuple->key, len);
+		pkgconf_strlcat(key, "=", len);
+		pkgconf_strlcat(key, tuple->value, len);
+		pkgconf_strlcat(key, "\n", len);
+	}
+
+	return key;
+#else
+	(void) client;
+	(void) filename;
+	(void) f;
+	(void) propflags;
+
+	return NULL;
+#endif
+}
+
+static pkgconf_pkg_t *
+pkgconf_pkg_parse_file(pkgconf_client_t *client, const char *filename, FILE *f, unsigned int propflags)
 {
 	pkgconf_pkg_t *pkg;
 	char readbuf[PKGCONF_BUFSIZE];
+	char pathbuf[PKGCONF_BUFSIZE];
 	char *idptr;
 	size_t lineno = 0;
 
 	pkg = calloc(sizeof(pkgconf_pkg_t), 1);
+	pkg->flags = propflags;
 	pkg->filename = strdup(filename);
-	pkgconf_tuple_add(client, &pkg->vars, "pcfiledir", pkg_get_parent_dir(pkg), true);
+	pkgconf_tuple_add(client, &pkg->vars, "pcfiledir", pkg_get_parent_dir(pkg, pathbuf, sizeof pathbuf), true);
 
 	/* make module id */
 	if ((idptr = strrchr(pkg->filename, PKG_DIR_SEP_S)) != NULL)
@@ -299,7 +364,7 @@ pkgconf_pkg_new_from_file(pkgconf_client_t *client, const char *filename, FILE *
 
 		lineno++;
 
-		PKGCONF_TRACE(client, "%s:%zu > [%s]", filename, lineno, readbuf);
+		PKGCONF_TRACE_AT(client, PKGCONF_TRACE_PARSER, PKGCONF_TRACE_LEVEL_VERBOSE, "%s:%zu > [%s]", filename, lineno, readbuf);
 
 		p = readbuf;
 		while (*p && (isalpha((unsigned int)*p) || isdigit((unsigned int)*p) || *p == '_' || *p == '.'))
@@ -355,7 +420,7 @@ pkgconf_pkg_new_from_file(pkgconf_client_t *client, const char *filename, FILE *
 				pkgconf_tuple_add(client, &pkg->vars, key, value, true);
 			else
 			{
-				const char *relvalue = determine_prefix(pkg);
+				const char *relvalue = determine_prefix(pkg, pathbuf, sizeof pathbuf);
 				if (relvalue != NULL)
 				{
 					pkgconf_tuple_add(client, &pkg->vars, "orig_prefix", value, true);
@@ -379,29 +444,100 @@ pkgconf_pkg_new_from_file(pkgconf_client_t *client, const char *filename, FILE *
 		return NULL;
 	}
 
+	pkg->parsed_version = pkgconf_version_parse(pkg->version);
 	pkgconf_dependency_add(client, &pkg->provides, pkg->id, pkg->version, PKGCONF_CMP_EQUAL);
 
 	return pkgconf_pkg_ref(client, pkg);
 }
 
+/*
+ * pkgconf_pkg_parse_file_timed(client, filename, f, propflags)
+ *
+ * parse a .pc file, accounting for it in the client's timings and profile.
+ */
+static pkgconf_pkg_t *
+pkgconf_pkg_parse_file_timed(pkgconf_client_t *client, const char *filename, FILE *f, unsigned int propflags)
+{
+	pkgconf_pkg_t *pkg;
+	uint64_t started = 0;
+
+	PKGCONF_TIMING_BEGIN(client, PKGCONF_TIMING_PARSE, filename);
+	PKGCONF_PROBE1(parse__start, filename);
+
+	if (client->profile != NULL)
+		started = pkgconf_timing_now();
+
+	pkg = pkgconf_pkg_parse_file(client, filename, f, propflags);
+
+	if (client->profile != NULL && pkg != NULL)
+		pkgconf_profile_parse(client, pkg->id, pkgconf_timing_now() - started);
+
+	PKGCONF_PROBE3(parse__done, filename, pkg != NULL ? pkg->id : NULL, pkg != NULL);
+	PKGCONF_TIMING_END(client, PKGCONF_TIMING_PARSE);
+
+	return pkg;
+}
+
+/*
+ * pkgconf_pkg_load(client, filename, f, propflags)
+ *
+ * parse a .pc file, going through the client's package pool if one is attached.
+ * the property flags are applied before the package is published, as pooled
+ * packages may not be modified afterwards.
+ */
+static pkgconf_pkg_t *
+pkgconf_pkg_load(pkgconf_client_t *client, const char *filename, FILE *f, unsigned int propflags)
+{
+	pkgconf_pkg_t *pkg;
+	char *key;
+
+	if (client->pool == NULL || (key = pkgconf_pkg_pool_key(client, filename, f, propflags)) == NULL)
+	{
+		return pkgconf_pkg_parse_file_timed(client, filename, f, propflags);
+	}
+
+	if ((pkg = pkgconf_pool_lookup(client->pool, key)) != NULL)
+	{
+		PKGCONF_TRACE(client, "%s: found in package pool @%p", filename, pkg);
+
+		fclose(f);
+		free(key);
+		return pkg;
+	}
+
+	pkg = pkgconf_pkg_parse_file_timed(client, filename, f, propflags);
+	if (pkg != NULL)
+		pkg = pkgconf_pool_insert(client->pool, key, pkg);
+
+	free(key);
+	return pkg;
+}
+
 /*
  * !doc
  *
- * .. c:function:: void pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
+ * .. c:function:: pkgconf_pkg_t *pkgconf_pkg_new_from_file(const pkgconf_client_t *client, const char *filename, FILE *f)
  *
- *    Releases all releases for a given ``pkgconf_pkg_t`` object.
+ *    Parse a .pc file into a pkgconf_pkg_t object structure.  If a package pool is attached to the client,
+ *    an already parsed copy of the same file may be returned instead.
  *
- *    :param pkgconf_client_t* client: The client which owns the ``pkgconf_pkg_t`` object, `pkg`.
- *    :param pkgconf_pkg_t* pkg: The package to free.
- *    :return: nothing
+ *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param char* filename: The filename of the package file (including full path).
+ *    :param FILE* f: The file object to read from.
+ *    :returns: A ``pkgconf_pkg_t`` object which contains the package data.
+ *    :rtype: pkgconf_pkg_t *
  */
-void
-pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
+pkgconf_pkg_t *
+pkgconf_pkg_new_from_file(pkgconf_client_t *client, const char *filename, FILE *f)
 {
-	if (pkg == NULL || pkg->flags & PKGCONF_PKG_PROPF_STATIC)
-		return;
+	return pkgconf_pkg_load(client, filename, f, PKGCONF_PKG_PROPF_NONE);
+}
 
-	pkgconf_cache_remove(client, pkg);
+static void
+pkgconf_pkg_destroy(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
+{
+	if (client != NULL)
+		pkgconf_cache_remove(client, pkg);
 
 	pkgconf_dependency_free(&pkg->requires);
 	pkgconf_dependency_free(&pkg->requires_private);
@@ -427,6 +563,8 @@ pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 	if (pkg->version != NULL)
 		free(pkg->version);
 
+	pkgconf_version_free(pkg->parsed_version);
+
 	if (pkg->description != NULL)
 		free(pkg->description);
 
@@ -439,6 +577,33 @@ pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 	free(pkg);
 }
 
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
+ *
+ *    Releases all releases for a given ``pkgconf_pkg_t`` object.  Shared packages (see the `pool` module)
+ *    may be in use by other clients, so only the caller's reference is released for those.
+ *
+ *    :param pkgconf_client_t* client: The client which owns the ``pkgconf_pkg_t`` object, `pkg`.
+ *    :param pkgconf_pkg_t* pkg: The package to free.
+ *    :return: nothing
+ */
+void
+pkgconf_pkg_free(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
+{
+	if (pkg == NULL || pkg->flags & PKGCONF_PKG_PROPF_STATIC)
+		return;
+
+	if (pkg->flags & PKGCONF_PKG_PROPF_SHARED)
+	{
+		pkgconf_pkg_unref(client, pkg);
+		return;
+	}
+
+	pkgconf_pkg_destroy(client, pkg);
+}
+
 /*
  * !doc
  *
@@ -456,7 +621,7 @@ pkgconf_pkg_ref(const pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 {
 	(void) client;
 
-	pkg->refcount++;
+	pkgconf_atomic_inc(&pkg->refcount);
 	return pkg;
 }
 
@@ -466,6 +631,7 @@ pkgconf_pkg_ref(const pkgconf_client_t *client, pkgconf_pkg_t *pkg)
  * .. c:function:: void pkgconf_pkg_unref(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
  *
  *    Releases a reference on the package object.  If the reference count is 0, then also free the package.
+ *    The reference count is maintained atomically, so shared packages may be released from any thread.
  *
  *    :param pkgconf_client_t* client: The pkgconf client object which owns the package being dereferenced.
  *    :param pkgconf_pkg_t* pkg: The package object being dereferenced.
@@ -474,37 +640,71 @@ pkgconf_pkg_ref(const pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 void
 pkgconf_pkg_unref(pkgconf_client_t *client, pkgconf_pkg_t *pkg)
 {
-	pkg->refcount--;
-	if (pkg->refcount <= 0)
-		pkgconf_pkg_free(client, pkg);
+	if (pkgconf_atomic_dec(&pkg->refcount) > 0)
+		return;
+
+	if (pkg->flags & PKGCONF_PKG_PROPF_STATIC)
+		return;
+
+	pkgconf_pkg_destroy(client, pkg);
 }
 
-static inline pkgconf_pkg_t *
-pkgconf_pkg_try_specific_path(pkgconf_client_t *client, const char *path, const char *name)
+/*
+ * pkgconf_pkg_open_specific_path(client, path, name, locbuf, locbuflen, propflags)
+ *
+ * open the .pc file for `name` in the directory `path`, preferring the uninstalled variant.
+ * the filename is stored in `locbuf` and the property flags the package should be loaded
+ * with in `propflags`.
+ */
+static FILE *
+pkgconf_pkg_open_specific_path(const pkgconf_client_t *client, const char *path, const char *name, char *locbuf, size_t locbuflen, unsigned int *propflags)
 {
-	pkgconf_pkg_t *pkg = NULL;
 	FILE *f;
-	char locbuf[PKG_CONFIG_PATH_SZ];
-	char uninst_locbuf[PKG_CONFIG_PATH_SZ];
 
-	PKGCONF_TRACE(client, "trying path: %s for %s", path, name);
+	PKGCONF_TRACE_VERBOSE(client, "trying path: %s for %s", path, name);
 
-	snprintf(locbuf, sizeof locbuf, "%s/%s" PKG_CONFIG_EXT, path, name);
-	snprintf(uninst_locbuf, sizeof uninst_locbuf, "%s/%s-uninstalled" PKG_CONFIG_EXT, path, name);
-
-	if (!(client->flags & PKGCONF_PKG_PKGF_NO_UNINSTALLED) && (f = fopen(uninst_locbuf, "r")) != NULL)
+	if (!(client->flags & PKGCONF_PKG_PKGF_NO_UNINSTALLED))
 	{
-		PKGCONF_TRACE(client, "found (uninstalled): %s", uninst_locbuf);
-		pkg = pkgconf_pkg_new_from_file(client, uninst_locbuf, f);
-		pkg->flags |= PKGCONF_PKG_PROPF_UNINSTALLED;
+		snprintf(locbuf, locbuflen, "%s/%s-uninstalled" PKG_CONFIG_EXT, path, name);
+
+		if ((f = fopen(locbuf, "r")) != NULL)
+		{
+			PKGCONF_TRACE(client, "found (uninstalled): %s", locbuf);
+
+			*propflags = PKGCONF_PKG_PROPF_UNINSTALLED;
+			return f;
+		}
 	}
-	else if ((f = fopen(locbuf, "r")) != NULL)
+
+	snprintf(locbuf, locbuflen, "%s/%s" PKG_CONFIG_EXT, path, name);
+
+	if ((f = fopen(locbuf, "r")) != NULL)
 	{
 		PKGCONF_TRACE(client, "found: %s", locbuf);
-		pkg = pkgconf_pkg_new_from_file(client, locbuf, f);
+
+		*propflags = PKGCONF_PKG_PROPF_NONE;
+		return f;
 	}
 
-	return pkg;
+	return NULL;
+}
+
+static inline pkgconf_pkg_t *
+pkgconf_pkg_try_specific_path(pkgconf_client_t *client, const char *path, const char *name)
+{
+	char locbuf[PKG_CONFIG_PATH_SZ];
+	unsigned int propflags;
+	FILE *f;
+
+	PKGCONF_PROFILE_COUNT(client, name, PKGCONF_PROFILE_PROBES);
+
+	f = pkgconf_pkg_open_specific_path(client, path, name, locbuf, sizeof locbuf, &propflags);
+	PKGCONF_PROBE3(probe__path, name, path, f != NULL);
+
+	if (f == NULL)
+		return NULL;
+
+	return pkgconf_pkg_load(client, locbuf, f, propflags);
 }
 
 static pkgconf_pkg_t *
@@ -522,7 +722,7 @@ pkgconf_pkg_scan_dir(pkgconf_client_t *client, const char *path, void *data, pkg
 
 	for (dirent = readdir(dir); dirent != NULL; dirent = readdir(dir))
 	{
-		static char filebuf[PKGCONF_BUFSIZE];
+		char filebuf[PKGCONF_BUFSIZE];
 		pkgconf_pkg_t *pkg;
 		FILE *f;
 
@@ -533,7 +733,7 @@ pkgconf_pkg_scan_dir(pkgconf_client_t *client, const char *path, void *data, pkg
 		if (!str_has_suffix(filebuf, PKG_CONFIG_EXT))
 			continue;
 
-		PKGCONF_TRACE(client, "trying file [%s]", filebuf);
+		PKGCONF_TRACE_VERBOSE(client, "trying file [%s]", filebuf);
 
 		f = fopen(filebuf, "r");
 		if (f == NULL)
@@ -629,20 +829,8 @@ pkgconf_pkg_find_in_registry_key(pkgconf_client_t *client, HKEY hkey, const char
 }
 #endif
 
-/*
- * !doc
- *
- * .. c:function:: pkgconf_pkg_t *pkgconf_pkg_find(pkgconf_client_t *client, const char *name)
- *
- *    Search for a package.
- *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
- *    :param char* name: The name of the package `atom` to use for searching.
- *    :return: A package object reference if the package was found, else ``NULL``.
- *    :rtype: pkgconf_pkg_t *
- */
-pkgconf_pkg_t *
-pkgconf_pkg_find(pkgconf_client_t *client, const char *name)
+static pkgconf_pkg_t *
+pkgconf_pkg_lookup(pkgconf_client_t *client, const char *name)
 {
 	pkgconf_pkg_t *pkg = NULL;
 	pkgconf_node_t *n;
@@ -656,13 +844,14 @@ pkgconf_pkg_find(pkgconf_client_t *client, const char *name)
 		if ((f = fopen(name, "r")) != NULL)
 		{
 			pkgconf_pkg_t *pkg;
+			char pathbuf[PKGCONF_BUFSIZE];
 
 			PKGCONF_TRACE(client, "%s is a file", name);
 
 			pkg = pkgconf_pkg_new_from_file(client, name, f);
 			if (pkg != NULL)
 			{
-				pkgconf_path_add(pkg_get_parent_dir(pkg), &client->dir_list, true);
+				pkgconf_path_add(pkg_get_parent_dir(pkg, pathbuf, sizeof pathbuf), &client->dir_list, true);
 				return pkg;
 			}
 		}
@@ -681,12 +870,14 @@ pkgconf_pkg_find(pkgconf_client_t *client, const char *name)
 		if ((pkg = pkgconf_cache_lookup(client, name)) != NULL)
 		{
 			PKGCONF_TRACE(client, "%s is cached", name);
-
-			pkg->flags |= PKGCONF_PKG_PROPF_CACHED;
 			return pkg;
 		}
 	}
 
+	/* if the package is being preloaded in the background, let that finish rather than parsing it twice */
+	if (client->prefetch != NULL)
+		pkgconf_prefetch_wait(client, name);
+
 	PKGCONF_FOREACH_LIST_ENTRY(client->dir_list.head, n)
 	{
 		pkgconf_path_t *pnode = n->data;
@@ -712,138 +903,411 @@ out:
 /*
  * !doc
  *
- * .. c:function:: int pkgconf_compare_version(const char *a, const char *b)
+ * .. c:function:: pkgconf_pkg_t *pkgconf_pkg_find(pkgconf_client_t *client, const char *name)
  *
- *    Compare versions using RPM version comparison rules as described in the LSB.
+ *    Search for a package.
  *
- *    :param char* a: The first version to compare in the pair.
- *    :param char* b: The second version to compare in the pair.
- *    :return: -1 if the first version is greater, 0 if both versions are equal, 1 if the second version is greater.
- *    :rtype: int
+ *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param char* name: The name of the package `atom` to use for searching.
+ *    :return: A package object reference if the package was found, else ``NULL``.
+ *    :rtype: pkgconf_pkg_t *
  */
-int
-pkgconf_compare_version(const char *a, const char *b)
+pkgconf_pkg_t *
+pkgconf_pkg_find(pkgconf_client_t *client, const char *name)
 {
-	char oldch1, oldch2;
-	char buf1[PKGCONF_BUFSIZE], buf2[PKGCONF_BUFSIZE];
-	char *str1, *str2;
-	char *one, *two;
-	int ret;
-	bool isnum;
+	pkgconf_pkg_t *pkg;
 
-	/* optimization: if version matches then it's the same version. */
-	if (a == NULL)
-		return 1;
+	PKGCONF_TIMING_BEGIN(client, PKGCONF_TIMING_LOOKUP, name);
+	PKGCONF_PROFILE_COUNT(client, name, PKGCONF_PROFILE_LOOKUPS);
+	PKGCONF_PROBE1(find__start, name);
 
-	if (b == NULL)
-		return -1;
+	pkg = pkgconf_pkg_lookup(client, name);
 
-	if (!strcasecmp(a, b))
-		return 0;
+	PKGCONF_PROBE3(find__done, name, pkg != NULL ? pkg->filename : NULL, pkg != NULL);
+	PKGCONF_TIMING_END(client, PKGCONF_TIMING_LOOKUP);
 
-	pkgconf_strlcpy(buf1, a, sizeof buf1);
-	pkgconf_strlcpy(buf2, b, sizeof buf2);
+	return pkg;
+}
 
-	one = str1 = buf1;
-	two = str2 = buf2;
+static bool
+pkgconf_pkg_preload_diagnostic(const char *msg, const pkgconf_client_t *client, const void *data)
+{
+	bool *diagnosed = (bool *) data;
 
-	while (*one || *two)
-	{
-		while (*one && !isalnum((unsigned int)*one) && *one != '~')
-			one++;
-		while (*two && !isalnum((unsigned int)*two) && *two != '~')
-			two++;
+	(void) msg;
+	(void) client;
 
-		if (*one == '~' || *two == '~')
-		{
-			if (*one != '~')
-				return -1;
-			if (*two != '~')
-				return 1;
+	*diagnosed = true;
 
-			one++;
-			two++;
-			continue;
-		}
+	return true;
+}
 
-		if (!(*one && *two))
-			break;
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_pkg_preload(const pkgconf_client_t *client, const char *name)
+ *
+ *    Searches the `package directory list` for a package and parses it into the package pool attached
+ *    to the client, so that a later ``pkgconf_pkg_find()`` for the same package finds it already parsed.
+ *    The client itself is not modified: its package cache is not consulted or updated, and nothing is
+ *    reported to its handlers.  A package whose parsing emits a diagnostic is not published, so that the
+ *    diagnostic is reported when the package is loaded normally.
+ *
+ *    As the client is only read, this may be called from any thread, as long as no other thread
+ *    modifies the client at the same time.
+ *
+ *    :param pkgconf_client_t* client: The pkgconf client object to use for searching.
+ *    :param char* name: The name of the package `atom` to preload.
+ *    :return: nothing
+ */
+void
+pkgconf_pkg_preload(const pkgconf_client_t *client, const char *name)
+{
+	pkgconf_client_t preload_client = *client;
+	pkgconf_pkg_t *pkg;
+	pkgconf_node_t *n;
+	bool diagnosed = false;
+
+	if (client->pool == NULL || str_has_suffix(name, PKG_CONFIG_EXT) || pkgconf_builtin_pkg_get(name) != NULL)
+		return;
 
-		str1 = one;
-		str2 = two;
+	/* parse with a private view of the client, which can neither report nor cache anything */
+	memset(&preload_client.pkg_cache, 0, sizeof preload_client.pkg_cache);
+	memset(&preload_client.pkg_cache_ids, 0, sizeof preload_client.pkg_cache_ids);
+	memset(&preload_client.pkg_cache_nodes, 0, sizeof preload_client.pkg_cache_nodes);
+	preload_client.pool = NULL;
+	preload_client.auditf = NULL;
+	preload_client.error_handler = preload_client.warn_handler = pkgconf_pkg_preload_diagnostic;
+	preload_client.error_handler_data = preload_client.warn_handler_data = &diagnosed;
+	preload_client.trace_handler = pkgconf_default_error_handler;
 
-		if (isdigit((unsigned int)*str1))
-		{
-			while (*str1 && isdigit((unsigned int)*str1))
-				str1++;
+	PKGCONF_FOREACH_LIST_ENTRY(client->dir_list.head, n)
+	{
+		pkgconf_path_t *pnode = n->data;
+		char locbuf[PKG_CONFIG_PATH_SZ];
+		unsigned int propflags;
+		char *key;
+		FILE *f;
 
-			while (*str2 && isdigit((unsigned int)*str2))
-				str2++;
+		if ((f = pkgconf_pkg_open_specific_path(&preload_client, pnode->path, name, locbuf, sizeof locbuf, &propflags)) == NULL)
+			continue;
 
-			isnum = true;
-		}
-		else
+		if ((key = pkgconf_pkg_pool_key(&preload_client, locbuf, f, propflags)) == NULL)
 		{
-			while (*str1 && isalpha((unsigned int)*str1))
-				str1++;
-
-			while (*str2 && isalpha((unsigned int)*str2))
-				str2++;
+			fclose(f);
+			return;
+		}
 
-			isnum = false;
+		if ((pkg = pkgconf_pool_lookup(client->pool, key)) == NULL)
+		{
+			pkg = pkgconf_pkg_parse_file(&preload_client, locbuf, f, propflags);
+			if (pkg != NULL && !diagnosed)
+				pkg = pkgconf_pool_insert(client->pool, key, pkg);
 		}
+		else
+			fclose(f);
+
+		if (pkg != NULL)
+			pkgconf_pkg_unref(&preload_client, pkg);
 
-		oldch1 = *str1;
-		oldch2 = *str2;
+		free(key);
+		return;
+	}
+}
 
-		*str1 = '\0';
-		*str2 = '\0';
+typedef enum {
+	PKGCONF_VERSION_SEGMENT_TILDE,
+	PKGCONF_VERSION_SEGMENT_NUMERIC,
+	PKGCONF_VERSION_SEGMENT_ALPHA,
+} pkgconf_version_segment_type_t;
 
-		if (one == str1)
-			return -1;
+/*
+ * a version string is compared as a sequence of segments: maximal runs of digits (without their
+ * leading zeros), maximal runs of letters and tildes.  any other character only separates segments.
+ */
+typedef struct {
+	const char *start;
+	size_t len;
+	pkgconf_version_segment_type_t type;
+} pkgconf_version_segment_t;
 
-		if (two == str2)
-			return (isnum ? 1 : -1);
+struct pkgconf_version_ {
+	const char *text;
+	size_t len;
 
-		if (isnum)
-		{
-			int onelen, twolen;
+	size_t nsegments;
+	pkgconf_version_segment_t segments[];
+};
 
-			while (*one == '0')
-				one++;
+/* segments kept on the stack when comparing raw version strings */
+#define PKGCONF_VERSION_STACK_SEGMENTS	32
 
-			while (*two == '0')
-				two++;
+/*
+ * pkgconf_version_tokenize(str, segments, maxsegments)
+ *
+ * split a version string into segments, storing at most maxsegments of them.  returns the total
+ * number of segments in the string.
+ */
+static size_t
+pkgconf_version_tokenize(const char *str, pkgconf_version_segment_t *segments, size_t maxsegments)
+{
+	size_t n = 0;
 
-			onelen = strlen(one);
-			twolen = strlen(two);
+	while (*str)
+	{
+		pkgconf_version_segment_t seg;
 
-			if (onelen > twolen)
-				return 1;
-			else if (twolen > onelen)
-				return -1;
+		if (*str == '~')
+		{
+			seg.type = PKGCONF_VERSION_SEGMENT_TILDE;
+			seg.start = str++;
+			seg.len = 0;
 		}
+		else if (isdigit((unsigned int)*str))
+		{
+			seg.type = PKGCONF_VERSION_SEGMENT_NUMERIC;
+			seg.start = str;
 
-		ret = strcmp(one, two);
-		if (ret)
-			return ret;
-
-		*str1 = oldch1;
-		*str2 = oldch2;
+			while (*str && isdigit((unsigned int)*str))
+				str++;
 
-		one = str1;
-		two = str2;
-	}
+			while (*seg.start == '0' && seg.start < str)
+				seg.start++;
 
-	if ((!*one) && (!*two))
+			seg.len = str - seg.start;
+		}
+		else if (isalpha((unsigned int)*str))
+		{
+			seg.type = PKGCONF_VERSION_SEGMENT_ALPHA;
+			seg.start = str;
+
+			while (*str && isalpha((unsigned int)*str))
+				str++;
+
+			seg.len = str - seg.start;
+		}
+		else
+		{
+			str++;
+			continue;
+		}
+
+		if (n < maxsegments)
+			segments[n] = seg;
+
+		n++;
+	}
+
+	return n;
+}
+
+static int
+pkgconf_version_compare_segments(const pkgconf_version_segment_t *one, size_t n1, const pkgconf_version_segment_t *two, size_t n2)
+{
+	size_t i = 0, j = 0;
+
+	while (i < n1 || j < n2)
+	{
+		const pkgconf_version_segment_t *s1 = i < n1 ? &one[i] : NULL;
+		const pkgconf_version_segment_t *s2 = j < n2 ? &two[j] : NULL;
+		int ret;
+
+		if ((s1 != NULL && s1->type == PKGCONF_VERSION_SEGMENT_TILDE) ||
+		    (s2 != NULL && s2->type == PKGCONF_VERSION_SEGMENT_TILDE))
+		{
+			if (s1 == NULL || s1->type != PKGCONF_VERSION_SEGMENT_TILDE)
+				return -1;
+			if (s2 == NULL || s2->type != PKGCONF_VERSION_SEGMENT_TILDE)
+				return 1;
+
+			i++;
+			j++;
+			continue;
+		}
+
+		if (s1 == NULL || s2 == NULL)
+			break;
+
+		if (s1->type == PKGCONF_VERSION_SEGMENT_NUMERIC)
+		{
+			if (s2->type != PKGCONF_VERSION_SEGMENT_NUMERIC)
+				return 1;
+
+			if (s1->len != s2->len)
+				return s1->len > s2->len ? 1 : -1;
+
+			ret = memcmp(s1->start, s2->start, s1->len);
+		}
+		else
+		{
+			if (s2->type != PKGCONF_VERSION_SEGMENT_ALPHA)
+				return -1;
+
+			ret = memcmp(s1->start, s2->start, s1->len < s2->len ? s1->len : s2->len);
+			if (!ret && s1->len != s2->len)
+				ret = s1->len > s2->len ? 1 : -1;
+		}
+
+		if (ret)
+			return ret;
+
+		i++;
+		j++;
+	}
+
+	if (i == n1 && j == n2)
 		return 0;
 
-	if (!*one)
+	if (i == n1)
 		return -1;
 
 	return 1;
 }
 
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_version_t *pkgconf_version_parse(const char *version)
+ *
+ *    Parses a version string into the segments it is compared by, so that it can be compared repeatedly with
+ *    ``pkgconf_version_compare()`` without being parsed again.  Package versions and the versions of dependency
+ *    nodes are parsed when they are loaded.
+ *
+ *    :param char* version: The version string to parse.
+ *    :return: the parsed version, or ``NULL`` if `version` is ``NULL``.
+ *    :rtype: pkgconf_version_t *
+ */
+pkgconf_version_t *
+pkgconf_version_parse(const char *version)
+{
+	pkgconf_version_t *out;
+	size_t len, nsegments;
+	char *text;
+
+	if (version == NULL)
+		return NULL;
+
+	len = strlen(version);
+	nsegments = pkgconf_version_tokenize(version, NULL, 0);
+
+	out = calloc(sizeof(pkgconf_version_t) + nsegments * sizeof(pkgconf_version_segment_t) + len + 1, 1);
+	text = (char *) &out->segments[nsegments];
+	memcpy(text, version, len);
+
+	out->text = text;
+	out->len = len;
+	out->nsegments = pkgconf_version_tokenize(text, out->segments, nsegments);
+
+	return out;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_version_free(pkgconf_version_t *version)
+ *
+ *    Releases a parsed version.
+ *
+ *    :param pkgconf_version_t* version: The parsed version to release, may be ``NULL``.
+ *    :return: nothing
+ */
+void
+pkgconf_version_free(pkgconf_version_t *version)
+{
+	free(version);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: int pkgconf_version_compare(const pkgconf_version_t *a, const pkgconf_version_t *b)
+ *
+ *    Compares two parsed versions, with the same result as ``pkgconf_compare_version()`` on the strings they
+ *    were parsed from.
+ *
+ *    :param pkgconf_version_t* a: The first version to compare in the pair.
+ *    :param pkgconf_version_t* b: The second version to compare in the pair.
+ *    :return: -1 if the first version is greater, 0 if both versions are equal, 1 if the second version is greater.
+ *    :rtype: int
+ */
+int
+pkgconf_version_compare(const pkgconf_version_t *a, const pkgconf_version_t *b)
+{
+	if (a == NULL)
+		return 1;
+
+	if (b == NULL)
+		return -1;
+
+	if (a->len == b->len && !strcasecmp(a->text, b->text))
+		return 0;
+
+	return pkgconf_version_compare_segments(a->segments, a->nsegments, b->segments, b->nsegments);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: int pkgconf_compare_version(const char *a, const char *b)
+ *
+ *    Compare versions using RPM version comparison rules as described in the LSB.  Versions which are compared
+ *    repeatedly should be parsed with ``pkgconf_version_parse()`` and compared with ``pkgconf_version_compare()``
+ *    instead.
+ *
+ *    :param char* a: The first version to compare in the pair.
+ *    :param char* b: The second version to compare in the pair.
+ *    :return: -1 if the first version is greater, 0 if both versions are equal, 1 if the second version is greater.
+ *    :rtype: int
+ */
+int
+pkgconf_compare_version(const char *a, const char *b)
+{
+	pkgconf_version_segment_t stack1[PKGCONF_VERSION_STACK_SEGMENTS], stack2[PKGCONF_VERSION_STACK_SEGMENTS];
+	pkgconf_version_t *va, *vb;
+	size_t n1, n2;
+	int ret;
+
+	/* optimization: if version matches then it's the same version. */
+	if (a == NULL)
+		return 1;
+
+	if (b == NULL)
+		return -1;
+
+	if (!strcasecmp(a, b))
+		return 0;
+
+	n1 = pkgconf_version_tokenize(a, stack1, PKGCONF_ARRAY_SIZE(stack1));
+	n2 = pkgconf_version_tokenize(b, stack2, PKGCONF_ARRAY_SIZE(stack2));
+
+	if (n1 <= PKGCONF_ARRAY_SIZE(stack1) && n2 <= PKGCONF_ARRAY_SIZE(stack2))
+		return pkgconf_version_compare_segments(stack1, n1, stack2, n2);
+
+	/* unusually long versions */
+	va = pkgconf_version_parse(a);
+	vb = pkgconf_version_parse(b);
+	ret = pkgconf_version_compare_segments(va->segments, va->nsegments, vb->segments, vb->nsegments);
+	pkgconf_version_free(va);
+	pkgconf_version_free(vb);
+
+	return ret;
+}
+
+/*
+ * pkgconf_pkg_vercmp(a, va, b, vb)
+ *
+ * compare two versions, using their parsed form when both have one.  the built-in packages, for one,
+ * only have a version string.
+ */
+static int
+pkgconf_pkg_vercmp(const char *a, const pkgconf_version_t *va, const char *b, const pkgconf_version_t *vb)
+{
+	if (va != NULL && vb != NULL)
+		return pkgconf_version_compare(va, vb);
+
+	return pkgconf_compare_version(a, b);
+}
+
 static pkgconf_pkg_t pkg_config_virtual = {
 	.id = "pkg-config",
 	.realname = "pkg-config",
@@ -922,7 +1386,7 @@ pkgconf_builtin_pkg_get(const char *name)
 	return (pair != NULL) ? pair->pkg : NULL;
 }
 
-typedef bool (*pkgconf_vercmp_res_func_t)(const char *a, const char *b);
+typedef bool (*pkgconf_vercmp_res_func_t)(int cmp);
 
 typedef struct {
 	const char *name;
@@ -945,48 +1409,46 @@ static int pkgconf_pkg_comparator_pair_namecmp(const void *key, const void *ptr)
 	return strcmp(key, pair->name);
 }
 
-static bool pkgconf_pkg_comparator_lt(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_lt(int cmp)
 {
-	return (pkgconf_compare_version(a, b) < 0);
+	return (cmp < 0);
 }
 
-static bool pkgconf_pkg_comparator_gt(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_gt(int cmp)
 {
-	return (pkgconf_compare_version(a, b) > 0);
+	return (cmp > 0);
 }
 
-static bool pkgconf_pkg_comparator_lte(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_lte(int cmp)
 {
-	return (pkgconf_compare_version(a, b) <= 0);
+	return (cmp <= 0);
 }
 
-static bool pkgconf_pkg_comparator_gte(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_gte(int cmp)
 {
-	return (pkgconf_compare_version(a, b) >= 0);
+	return (cmp >= 0);
 }
 
-static bool pkgconf_pkg_comparator_eq(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_eq(int cmp)
 {
-	return (pkgconf_compare_version(a, b) == 0);
+	return (cmp == 0);
 }
 
-static bool pkgconf_pkg_comparator_ne(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_ne(int cmp)
 {
-	return (pkgconf_compare_version(a, b) != 0);
+	return (cmp != 0);
 }
 
-static bool pkgconf_pkg_comparator_any(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_any(int cmp)
 {
-	(void) a;
-	(void) b;
+	(void) cmp;
 
 	return true;
 }
 
-static bool pkgconf_pkg_comparator_none(const char *a, const char *b)
+static bool pkgconf_pkg_comparator_none(int cmp)
 {
-	(void) a;
-	(void) b;
+	(void) cmp;
 
 	return false;
 }
@@ -1164,11 +1626,11 @@ pkgconf_pkg_scan_provides_vercmp(const pkgconf_dependency_t *pkgdep, const pkgco
 	const pkgconf_pkg_provides_vermatch_rule_t *rule = &pkgconf_pkg_provides_vermatch_rules[pkgdep->compare];
 
 	if (rule->depcmp[provider->compare] != NULL &&
-	    !rule->depcmp[provider->compare](provider->version, pkgdep->version))
+	    !rule->depcmp[provider->compare](pkgconf_pkg_vercmp(provider->version, provider->parsed_version, pkgdep->version, pkgdep->parsed_version)))
 		return false;
 
 	if (rule->rulecmp[provider->compare] != NULL &&
-	    !rule->rulecmp[provider->compare](pkgdep->version, provider->version))
+	    !rule->rulecmp[provider->compare](pkgconf_pkg_vercmp(pkgdep->version, pkgdep->parsed_version, provider->version, provider->parsed_version)))
 		return false;
 
 	return true;
@@ -1221,49 +1683,47 @@ pkgconf_pkg_scan_providers(pkgconf_client_t *client, pkgconf_dependency_t *pkgde
 /*
  * !doc
  *
- * .. c:function:: pkgconf_pkg_t *pkgconf_pkg_verify_dependency(pkgconf_client_t *client, pkgconf_dependency_t *pkgdep, unsigned int *eflags)
+ * .. c:function:: pkgconf_pkg_t *pkgconf_pkg_verify_dependency(const pkgconf_query_t *query, pkgconf_dependency_t *pkgdep, unsigned int *eflags)
  *
  *    Verify a pkgconf_dependency_t node in the depgraph.  If the dependency is solvable,
  *    return the appropriate ``pkgconf_pkg_t`` object, else ``NULL``.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param pkgconf_query_t* query: The query to resolve the dependency for.
  *    :param pkgconf_dependency_t* pkgdep: The dependency graph node to solve.
  *    :param uint* eflags: An optional pointer that, if set, will be populated with an error code from the resolver.
  *    :return: On success, the appropriate ``pkgconf_pkg_t`` object to solve the dependency, else ``NULL``.
  *    :rtype: pkgconf_pkg_t *
  */
 pkgconf_pkg_t *
-pkgconf_pkg_verify_dependency(pkgconf_client_t *client, pkgconf_dependency_t *pkgdep, unsigned int *eflags)
+pkgconf_pkg_verify_dependency(const pkgconf_query_t *query, pkgconf_dependency_t *pkgdep, unsigned int *eflags)
 {
+	pkgconf_client_t *client = query->client;
 	pkgconf_pkg_t *pkg = NULL;
-
-	if (eflags != NULL)
-		*eflags = PKGCONF_PKG_ERRF_OK;
+	unsigned int result = PKGCONF_PKG_ERRF_OK;
 
 	PKGCONF_TRACE(client, "trying to verify dependency: %s", pkgdep->package);
 
 	pkg = pkgconf_pkg_find(client, pkgdep->package);
 	if (pkg == NULL)
 	{
-		if (client->flags & PKGCONF_PKG_PKGF_SKIP_PROVIDES)
-		{
-			if (eflags != NULL)
-				*eflags |= PKGCONF_PKG_ERRF_PACKAGE_NOT_FOUND;
-
-			return NULL;
-		}
-
-		return pkgconf_pkg_scan_providers(client, pkgdep, eflags);
+		if (query->flags & PKGCONF_PKG_PKGF_SKIP_PROVIDES)
+			result |= PKGCONF_PKG_ERRF_PACKAGE_NOT_FOUND;
+		else
+			pkg = pkgconf_pkg_scan_providers(client, pkgdep, &result);
 	}
+	else
+	{
+		if (pkg->id == NULL)
+			pkg->id = strdup(pkgdep->package);
 
-	if (pkg->id == NULL)
-		pkg->id = strdup(pkgdep->package);
+		if (pkgconf_pkg_comparator_impls[pkgdep->compare](pkgconf_pkg_vercmp(pkg->version, pkg->parsed_version, pkgdep->version, pkgdep->parsed_version)) != true)
+			result |= PKGCONF_PKG_ERRF_PACKAGE_VER_MISMATCH;
+	}
 
-	if (pkgconf_pkg_comparator_impls[pkgdep->compare](pkg->version, pkgdep->version) == true)
-		return pkg;
+	PKGCONF_PROBE3(verify__dependency, pkgdep->package, pkg != NULL ? pkg->id : NULL, result);
 
 	if (eflags != NULL)
-		*eflags |= PKGCONF_PKG_ERRF_PACKAGE_VER_MISMATCH;
+		*eflags = result;
 
 	return pkg;
 }
@@ -1271,36 +1731,36 @@ pkgconf_pkg_verify_dependency(pkgconf_client_t *client, pkgconf_dependency_t *pk
 /*
  * !doc
  *
- * .. c:function:: unsigned int pkgconf_pkg_verify_graph(pkgconf_client_t *client, pkgconf_pkg_t *root, int depth)
+ * .. c:function:: unsigned int pkgconf_pkg_verify_graph(const pkgconf_query_t *query, pkgconf_pkg_t *root, int depth)
  *
  *    Verify the graph dependency nodes are satisfiable by walking the tree using
  *    ``pkgconf_pkg_traverse()``.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
  *    :param pkgconf_pkg_t* root: The root entry in the package dependency graph which should contain the top-level dependencies to resolve.
  *    :param int depth: The maximum allowed depth for dependency resolution.
  *    :return: On success, ``PKGCONF_PKG_ERRF_OK`` (0), else an error code.
  *    :rtype: unsigned int
  */
 unsigned int
-pkgconf_pkg_verify_graph(pkgconf_client_t *client, pkgconf_pkg_t *root, int depth)
+pkgconf_pkg_verify_graph(const pkgconf_query_t *query, pkgconf_pkg_t *root, int depth)
 {
-	return pkgconf_pkg_traverse(client, root, NULL, NULL, depth);
+	return pkgconf_pkg_traverse(query, root, NULL, NULL, depth);
 }
 
 static unsigned int
-pkgconf_pkg_report_graph_error(pkgconf_client_t *client, pkgconf_pkg_t *parent, pkgconf_pkg_t *pkg, pkgconf_dependency_t *node, unsigned int eflags)
+pkgconf_pkg_report_graph_error(const pkgconf_query_t *query, pkgconf_pkg_t *parent, pkgconf_pkg_t *pkg, pkgconf_dependency_t *node, unsigned int eflags)
 {
-	static bool already_sent_notice = false;
+	pkgconf_client_t *client = query->client;
 
 	if (eflags & PKGCONF_PKG_ERRF_PACKAGE_NOT_FOUND)
 	{
-		if (!(client->flags & PKGCONF_PKG_PKGF_SIMPLIFY_ERRORS) & !already_sent_notice)
+		/* the hint is given once per client, even if several queries miss a package at the same time */
+		if (!(query->flags & PKGCONF_PKG_PKGF_SIMPLIFY_ERRORS) && !pkgconf_atomic_test_and_set(&client->not_found_notice_sent))
 		{
 			pkgconf_error(client, "Package %s was not found in the pkg-config search path.\n", node->package);
 			pkgconf_error(client, "Perhaps you should add the directory containing `%s.pc'\n", node->package);
 			pkgconf_error(client, "to the PKG_CONFIG_PATH environment variable\n");
-			already_sent_notice = true;
 		}
 
 		pkgconf_error(client, "Package '%s', required by '%s', not found\n", node->package, parent->id);
@@ -1322,194 +1782,581 @@ pkgconf_pkg_report_graph_error(pkgconf_client_t *client, pkgconf_pkg_t *parent,
 	return eflags;
 }
 
-static inline unsigned int
-pkgconf_pkg_walk_list(pkgconf_client_t *client,
-	pkgconf_pkg_t *parent,
-	pkgconf_list_t *deplist,
-	pkgconf_pkg_traverse_func_t func,
-	void *data,
-	int depth)
+/*
+ * pkgconf_pkg_resolve_dependency(query, parent, depnode, eflags)
+ *
+ * look up a single dependency of `parent`, reporting an error if it cannot be satisfied.
+ * returns a new reference to the matching package, or NULL if there is nothing to walk into.
+ */
+static pkgconf_pkg_t *
+pkgconf_pkg_resolve_dependency(const pkgconf_query_t *query, pkgconf_pkg_t *parent, pkgconf_dependency_t *depnode, unsigned int *eflags)
 {
-	unsigned int eflags = PKGCONF_PKG_ERRF_OK;
-	pkgconf_node_t *node;
+	unsigned int eflags_local = PKGCONF_PKG_ERRF_OK;
+	pkgconf_pkg_t *pkgdep;
 
-	PKGCONF_FOREACH_LIST_ENTRY(deplist->head, node)
-	{
-		unsigned int eflags_local = PKGCONF_PKG_ERRF_OK;
-		pkgconf_dependency_t *depnode = node->data;
-		pkgconf_pkg_t *pkgdep;
+	if (*depnode->package == '\0')
+		return NULL;
 
-		if (*depnode->package == '\0')
-			continue;
+	pkgdep = pkgconf_pkg_verify_dependency(query, depnode, &eflags_local);
 
-		pkgdep = pkgconf_pkg_verify_dependency(client, depnode, &eflags_local);
+	*eflags |= eflags_local;
+	if (eflags_local != PKGCONF_PKG_ERRF_OK && !(query->flags & PKGCONF_PKG_PKGF_SKIP_ERRORS))
+	{
+		pkgconf_pkg_report_graph_error(query, parent, pkgdep, depnode, eflags_local);
+		return NULL;
+	}
 
-		eflags |= eflags_local;
-		if (eflags_local != PKGCONF_PKG_ERRF_OK && !(client->flags & PKGCONF_PKG_PKGF_SKIP_ERRORS))
-		{
-			pkgconf_pkg_report_graph_error(client, parent, pkgdep, depnode, eflags_local);
-			continue;
-		}
-		if (pkgdep == NULL)
-			continue;
+	return pkgdep;
+}
 
-		if (pkgdep->flags & PKGCONF_PKG_PROPF_SEEN)
-		{
-			pkgconf_pkg_unref(client, pkgdep);
-			continue;
-		}
+static void
+pkgconf_pkg_index_dependency_names(pkgconf_hash_t *names, const pkgconf_list_t *deplist)
+{
+	pkgconf_node_t *node;
 
-		pkgconf_audit_log_dependency(client, pkgdep, depnode);
+	PKGCONF_FOREACH_LIST_ENTRY(deplist->head, node)
+	{
+		const pkgconf_dependency_t *depnode = node->data;
 
-		pkgdep->flags |= PKGCONF_PKG_PROPF_SEEN;
-		eflags |= pkgconf_pkg_traverse(client, pkgdep, func, data, depth - 1);
-		pkgdep->flags &= ~PKGCONF_PKG_PROPF_SEEN;
-		pkgconf_pkg_unref(client, pkgdep);
+		if (*depnode->package != '\0' && pkgconf_hash_lookup(names, depnode->package) == NULL)
+			pkgconf_hash_insert(names, depnode->package, depnode->package);
 	}
-
-	return eflags;
 }
 
-static inline unsigned int
-pkgconf_pkg_walk_conflicts_list(pkgconf_client_t *client,
-	pkgconf_pkg_t *root, pkgconf_list_t *deplist)
+/*
+ * !doc
+ *
+ * .. c:function:: unsigned int pkgconf_pkg_verify_conflicts(const pkgconf_query_t *query, pkgconf_pkg_t *const *pkgs, size_t npkgs)
+ *
+ *    Checks the ``Conflicts`` rules of every package in a resolved set against the whole set, rather than against the
+ *    direct dependencies of each package only.  A rule applies if its target is required by any package of the set.
+ *    The set is indexed once, so a target which is part of the set is not looked up again, and any other target,
+ *    such as a package required under a name it provides, is looked up at most once.  The first rule violated by
+ *    each package is reported.
+ *
+ *    :param pkgconf_query_t* query: The query the set was resolved for.
+ *    :param pkgconf_pkg_t** pkgs: The packages of the resolved set, usually every package expanded during a traversal.
+ *    :param size_t npkgs: The number of packages in the set.
+ *    :return: ``PKGCONF_PKG_ERRF_OK`` if no rule is violated, else ``PKGCONF_PKG_ERRF_PACKAGE_CONFLICT``.
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_pkg_verify_conflicts(const pkgconf_query_t *query, pkgconf_pkg_t *const *pkgs, size_t npkgs)
 {
-	unsigned int eflags;
-	pkgconf_node_t *node, *childnode;
+	pkgconf_client_t *client = query->client;
+	pkgconf_hash_t resolved, required, found;
+	pkgconf_pkg_t **lookups = NULL;
+	size_t nlookups = 0, i;
+	unsigned int eflags = PKGCONF_PKG_ERRF_OK;
 
-	PKGCONF_FOREACH_LIST_ENTRY(deplist->head, node)
+	pkgconf_hash_init(&resolved, pkgconf_hash_str, pkgconf_hash_str_equal);
+	pkgconf_hash_init(&required, pkgconf_hash_str, pkgconf_hash_str_equal);
+	pkgconf_hash_init(&found, pkgconf_hash_str, pkgconf_hash_str_equal);
+
+	for (i = 0; i < npkgs; i++)
 	{
-		pkgconf_dependency_t *parentnode = node->data;
+		if (pkgs[i]->id != NULL && pkgconf_hash_lookup(&resolved, pkgs[i]->id) == NULL)
+			pkgconf_hash_insert(&resolved, pkgs[i]->id, pkgs[i]);
 
-		if (*parentnode->package == '\0')
-			continue;
+		pkgconf_pkg_index_dependency_names(&required, &pkgs[i]->requires);
+
+		if (query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE)
+			pkgconf_pkg_index_dependency_names(&required, &pkgs[i]->requires_private);
+	}
+
+	for (i = 0; i < npkgs; i++)
+	{
+		pkgconf_pkg_t *pkg = pkgs[i];
+		pkgconf_node_t *node;
 
-		PKGCONF_FOREACH_LIST_ENTRY(root->requires.head, childnode)
+		PKGCONF_FOREACH_LIST_ENTRY(pkg->conflicts.head, node)
 		{
-			pkgconf_pkg_t *pkgdep;
-			pkgconf_dependency_t *depnode = childnode->data;
+			pkgconf_dependency_t *rule = node->data;
+			pkgconf_pkg_t *target, *provider = NULL;
+			uintptr_t slot;
+			bool conflicts;
+
+			if (*rule->package == '\0' || pkgconf_hash_lookup(&required, rule->package) == NULL)
+				continue;
+
+			/* the target is usually part of the set, else look it up once for all rules naming it */
+			target = pkgconf_hash_lookup(&resolved, rule->package);
+			if (target == NULL)
+			{
+				slot = (uintptr_t) pkgconf_hash_lookup(&found, rule->package);
+				if (slot == 0)
+				{
+					lookups = realloc(lookups, (nlookups + 1) * sizeof(pkgconf_pkg_t *));
+					lookups[nlookups++] = pkgconf_pkg_find(client, rule->package);
+					slot = nlookups;
+
+					pkgconf_hash_insert(&found, rule->package, (void *) slot);
+				}
+
+				target = lookups[slot - 1];
+			}
 
-			if (*depnode->package == '\0' || strcmp(depnode->package, parentnode->package))
+			if (target == pkg)
 				continue;
 
-			pkgdep = pkgconf_pkg_verify_dependency(client, parentnode, &eflags);
-			if (eflags == PKGCONF_PKG_ERRF_OK)
+			if (target != NULL)
+				conflicts = pkgconf_pkg_comparator_impls[rule->compare](pkgconf_pkg_vercmp(target->version, target->parsed_version, rule->version, rule->parsed_version));
+			else if (!(query->flags & PKGCONF_PKG_PKGF_SKIP_PROVIDES))
+			{
+				/* only a provider can satisfy the rule, which depends on the version being asked for */
+				provider = pkgconf_pkg_scan_providers(client, rule, NULL);
+				conflicts = provider != NULL;
+				target = provider;
+			}
+			else
+				conflicts = false;
+
+			if (conflicts)
 			{
 				pkgconf_error(client, "Version '%s' of '%s' conflicts with '%s' due to satisfying conflict rule '%s %s%s%s'.\n",
-					pkgdep->version, pkgdep->realname, root->realname, parentnode->package, pkgconf_pkg_get_comparator(parentnode),
-					parentnode->version != NULL ? " " : "", parentnode->version != NULL ? parentnode->version : "");
+					target->version, target->realname, pkg->realname, rule->package, pkgconf_pkg_get_comparator(rule),
+					rule->version != NULL ? " " : "", rule->version != NULL ? rule->version : "");
 				pkgconf_error(client, "It may be possible to ignore this conflict and continue, try the\n");
 				pkgconf_error(client, "PKG_CONFIG_IGNORE_CONFLICTS environment variable.\n");
 
-				pkgconf_pkg_unref(client, pkgdep);
-
-				return PKGCONF_PKG_ERRF_PACKAGE_CONFLICT;
+				eflags |= PKGCONF_PKG_ERRF_PACKAGE_CONFLICT;
 			}
 
-			pkgconf_pkg_unref(client, pkgdep);
+			if (provider != NULL)
+				pkgconf_pkg_unref(client, provider);
+
+			if (conflicts)
+				break;
 		}
 	}
 
-	return PKGCONF_PKG_ERRF_OK;
+	for (i = 0; i < nlookups; i++)
+	{
+		if (lookups[i] != NULL)
+			pkgconf_pkg_unref(client, lookups[i]);
+	}
+
+	free(lookups);
+
+	pkgconf_hash_deinit(&found);
+	pkgconf_hash_deinit(&required);
+	pkgconf_hash_deinit(&resolved);
+
+	return eflags;
+}
+
+static unsigned int
+pkgconf_pkg_resolve_list(const pkgconf_query_t *query, pkgconf_pkg_t *parent, pkgconf_list_t *deplist, bool is_private, pkgconf_pkg_resolve_func_t func, void *data)
+{
+	unsigned int eflags = PKGCONF_PKG_ERRF_OK;
+	pkgconf_node_t *node;
+
+	PKGCONF_FOREACH_LIST_ENTRY(deplist->head, node)
+	{
+		pkgconf_dependency_t *depnode = node->data;
+		pkgconf_pkg_t *pkgdep;
+
+		pkgdep = pkgconf_pkg_resolve_dependency(query, parent, depnode, &eflags);
+		if (pkgdep == NULL)
+			continue;
+
+		pkgconf_audit_log_dependency(query->client, pkgdep, depnode);
+
+		func(query, parent, pkgdep, is_private, data);
+	}
+
+	return eflags;
 }
 
 /*
  * !doc
  *
- * .. c:function:: unsigned int pkgconf_pkg_traverse(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_pkg_traverse_func_t func, void *data, int maxdepth)
+ * .. c:function:: unsigned int pkgconf_pkg_resolve(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, pkgconf_pkg_resolve_func_t func, void *data)
  *
- *    Walk and resolve the dependency graph up to `maxdepth` levels.
+ *    Resolves the direct dependencies of a package, without walking the dependency graph any further.  The ``Requires``
+ *    of the package are resolved, followed by its ``Requires.private`` if the ``PKGCONF_PKG_PKGF_SEARCH_PRIVATE`` flag is
+ *    set on the query and every ``Requires`` entry could be resolved.  Errors are reported in the same way as during a
+ *    traversal.  ``Conflicts`` are not checked, as they apply to the whole resolved graph, see ``pkgconf_pkg_verify_conflicts()``.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
- *    :param pkgconf_pkg_t* root: The root of the dependency graph.
- *    :param pkgconf_pkg_traverse_func_t func: A traversal function to call for each resolved node in the dependency graph.
- *    :param void* data: An opaque pointer to data to be passed to the traversal function.
- *    :param int maxdepth: The maximum depth to walk the dependency graph for.  -1 means infinite recursion.
+ *    :param pkgconf_query_t* query: The query to resolve the dependencies for.
+ *    :param pkgconf_pkg_t* pkg: The package whose dependencies should be resolved.
+ *    :param pkgconf_pkg_resolve_func_t func: A function to call for each resolved dependency.  It is passed a new reference
+ *                                            to the dependency, which it must release with ``pkgconf_pkg_unref()``.
+ *    :param void* data: An opaque pointer to data to be passed to the function.
  *    :return: ``PKGCONF_PKG_ERRF_OK`` on success, else an error code.
  *    :rtype: unsigned int
  */
 unsigned int
-pkgconf_pkg_traverse(pkgconf_client_t *client,
+pkgconf_pkg_resolve(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, pkgconf_pkg_resolve_func_t func, void *data)
+{
+	pkgconf_client_t *client = query->client;
+	unsigned int eflags;
+
+	if (client->prefetch != NULL)
+	{
+		pkgconf_prefetch_submit(client, &pkg->requires);
+
+		if (query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE)
+			pkgconf_prefetch_submit(client, &pkg->requires_private);
+	}
+
+	eflags = pkgconf_pkg_resolve_list(query, pkg, &pkg->requires, false, func, data);
+
+	if (eflags == PKGCONF_PKG_ERRF_OK && (query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE))
+		eflags |= pkgconf_pkg_resolve_list(query, pkg, &pkg->requires_private, true, func, data);
+
+	return eflags;
+}
+
+static unsigned int
+pkgconf_pkg_traverse_once(const pkgconf_query_t *query,
 	pkgconf_pkg_t *root,
 	pkgconf_pkg_traverse_func_t func,
 	void *data,
 	int maxdepth)
 {
-	unsigned int eflags = PKGCONF_PKG_ERRF_OK;
+	pkgconf_graph_t *graph;
+	unsigned int eflags;
 
 	if (maxdepth == 0)
-		return eflags;
+		return PKGCONF_PKG_ERRF_OK;
+
+	graph = pkgconf_graph_new_from_pkg(query, root, maxdepth);
+	eflags = pkgconf_graph_get_errors(graph);
 
-	PKGCONF_TRACE(client, "%s: level %d", root->id, maxdepth);
+	if (func != NULL)
+		pkgconf_graph_traverse(graph, query, func, data);
 
-	if ((root->flags & PKGCONF_PKG_PROPF_VIRTUAL) != PKGCONF_PKG_PROPF_VIRTUAL || (client->flags & PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL) != PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL)
+	pkgconf_graph_free(graph);
+
+	return eflags;
+}
+
+/*
+ * the default traversal visits a package once for every path leading to it.  the path being
+ * walked is kept on a heap-allocated stack rather than on the C stack, so that the depth of a
+ * dependency graph is limited by maxdepth alone.  the traversal callback is run in the same
+ * order as a recursive depth-first walk would run it.
+ */
+typedef struct {
+	pkgconf_pkg_t *pkg;
+	pkgconf_node_t *next;
+	int maxdepth;
+	unsigned int eflags;
+	bool private_path;
+	bool walking_private;
+} pkgconf_pkg_traverse_frame_t;
+
+typedef struct {
+	pkgconf_pkg_traverse_frame_t *frames;
+	size_t depth;
+	size_t size;
+
+	/* every package expanded during the walk, for the conflict check once it is done */
+	bool check_conflicts;
+	pkgconf_hash_t expanded;
+	pkgconf_pkg_t **closure;
+	size_t nclosure;
+	size_t closure_size;
+} pkgconf_pkg_traverse_stack_t;
+
+/*
+ * pkgconf_pkg_traverse_stack_contains(stack, pkg)
+ *
+ * check whether a package is already on the path being walked, to break dependency cycles
+ * without marking the (possibly shared) package objects themselves.  the root of the walk is
+ * not part of the path, so a package requiring the root still walks into it once.
+ */
+static bool
+pkgconf_pkg_traverse_stack_contains(const pkgconf_pkg_traverse_stack_t *stack, const pkgconf_pkg_t *pkg)
+{
+	size_t i;
+
+	for (i = stack->depth; i > 1; i--)
+	{
+		if (stack->frames[i - 1].pkg == pkg)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * pkgconf_pkg_traverse_enter(walk, stack, pkg, func, data, maxdepth, private_path, eflags)
+ *
+ * visit a package, then push it on the stack so that its dependencies are walked next.
+ * `walk` is the copy of the query owned by the walk, whose iteration flags describe the
+ * package being visited.
+ * if conflicts are checked by the walk, the package is also added to the closure checked at the end.
+ * returns false if there is nothing to walk below the package, in which case `eflags`
+ * holds the result for it.
+ */
+static bool
+pkgconf_pkg_traverse_enter(pkgconf_query_t *walk,
+	pkgconf_pkg_traverse_stack_t *stack,
+	pkgconf_pkg_t *pkg,
+	pkgconf_pkg_traverse_func_t func,
+	void *data,
+	int maxdepth,
+	bool private_path,
+	unsigned int *eflags)
+{
+	pkgconf_client_t *client = walk->client;
+	pkgconf_pkg_traverse_frame_t *frame;
+
+	*eflags = PKGCONF_PKG_ERRF_OK;
+
+	if (maxdepth == 0)
+		return false;
+
+	/* the span of a package lasts until its frame is popped, so the spans of its dependencies nest inside it */
+	PKGCONF_TIMING_BEGIN(client, PKGCONF_TIMING_TRAVERSE, pkg->id);
+	PKGCONF_TRACE(client, "%s: level %d", pkg->id, maxdepth);
+
+	if (client->profile != NULL)
+		pkgconf_profile_visit(client, pkg->id);
+
+	if ((pkg->flags & PKGCONF_PKG_PROPF_VIRTUAL) != PKGCONF_PKG_PROPF_VIRTUAL || (walk->flags & PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL) != PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL)
 	{
 		if (func != NULL)
-			func(client, root, data);
+		{
+			if (private_path)
+				walk->flags |= PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH;
+			else
+				walk->flags &= ~PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH;
+
+			func(walk, pkg, data);
+		}
 	}
 
-	if (!(client->flags & PKGCONF_PKG_PKGF_SKIP_CONFLICTS))
+	if (stack->check_conflicts && pkgconf_hash_lookup(&stack->expanded, pkg) == NULL)
 	{
-		eflags = pkgconf_pkg_walk_conflicts_list(client, root, &root->conflicts);
+		if (stack->nclosure == stack->closure_size)
+		{
+			stack->closure_size = stack->closure_size ? stack->closure_size * 2 : 32;
+			stack->closure = realloc(stack->closure, stack->closure_size * sizeof(pkgconf_pkg_t *));
+		}
+
+		stack->closure[stack->nclosure++] = pkgconf_pkg_ref(client, pkg);
+		pkgconf_hash_insert(&stack->expanded, pkg, pkg);
+	}
+
+	if (stack->depth == stack->size)
+	{
+		stack->size = stack->size ? stack->size * 2 : 32;
+		stack->frames = realloc(stack->frames, stack->size * sizeof(pkgconf_pkg_traverse_frame_t));
+	}
+
+	frame = &stack->frames[stack->depth++];
+	frame->pkg = pkg;
+	frame->next = pkg->requires.head;
+	frame->maxdepth = maxdepth;
+	frame->eflags = PKGCONF_PKG_ERRF_OK;
+	frame->private_path = private_path;
+	frame->walking_private = false;
+
+	if (client->prefetch != NULL)
+	{
+		pkgconf_prefetch_submit(client, &pkg->requires);
+
+		if (walk->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE)
+			pkgconf_prefetch_submit(client, &pkg->requires_private);
+	}
+
+	PKGCONF_TRACE(client, "%s: walking requires list", pkg->id);
+
+	return true;
+}
+
+static unsigned int
+pkgconf_pkg_traverse_main(const pkgconf_query_t *query,
+	pkgconf_pkg_t *root,
+	pkgconf_pkg_traverse_func_t func,
+	void *data,
+	int maxdepth)
+{
+	pkgconf_client_t *client = query->client;
+	pkgconf_query_t walk = *query;
+	pkgconf_pkg_traverse_stack_t stack = {
+		.frames = NULL,
+		.check_conflicts = !(query->flags & PKGCONF_PKG_PKGF_SKIP_CONFLICTS),
+	};
+	unsigned int eflags;
+	size_t i;
+
+	/*
+	 * the callbacks must not run for a closure which turns out to conflict, so the closure is
+	 * resolved first, visiting each package once, and the walk itself no longer checks it.
+	 */
+	if (func != NULL && stack.check_conflicts)
+	{
+		pkgconf_graph_t *graph = pkgconf_graph_new_from_pkg(query, root, maxdepth);
+
+		eflags = pkgconf_graph_get_errors(graph);
+		pkgconf_graph_free(graph);
+
 		if (eflags != PKGCONF_PKG_ERRF_OK)
 			return eflags;
+
+		stack.check_conflicts = false;
 	}
 
-	PKGCONF_TRACE(client, "%s: walking requires list", root->id);
-	eflags = pkgconf_pkg_walk_list(client, root, &root->requires, func, data, maxdepth);
-	if (eflags != PKGCONF_PKG_ERRF_OK)
+	pkgconf_hash_init(&stack.expanded, pkgconf_hash_ptr, pkgconf_hash_ptr_equal);
+
+	if (!pkgconf_pkg_traverse_enter(&walk, &stack, root, func, data, maxdepth, false, &eflags))
+	{
+		pkgconf_hash_deinit(&stack.expanded);
 		return eflags;
+	}
 
-	if (client->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE)
+	while (stack.depth > 0)
 	{
-		PKGCONF_TRACE(client, "%s: walking requires.private list", root->id);
+		pkgconf_pkg_traverse_frame_t *frame = &stack.frames[stack.depth - 1];
 
-		/* XXX: ugly */
-		client->flags |= PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE;
-		eflags = pkgconf_pkg_walk_list(client, root, &root->requires_private, func, data, maxdepth);
-		client->flags &= ~PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE;
+		if (frame->next != NULL)
+		{
+			pkgconf_dependency_t *depnode = frame->next->data;
+			pkgconf_pkg_t *pkgdep;
+			unsigned int eflags_child;
 
-		if (eflags != PKGCONF_PKG_ERRF_OK)
-			return eflags;
+			frame->next = frame->next->next;
+
+			pkgdep = pkgconf_pkg_resolve_dependency(&walk, frame->pkg, depnode, &frame->eflags);
+			if (pkgdep == NULL)
+				continue;
+
+			if (pkgconf_pkg_traverse_stack_contains(&stack, pkgdep))
+			{
+				pkgconf_pkg_unref(client, pkgdep);
+				continue;
+			}
+
+			pkgconf_audit_log_dependency(client, pkgdep, depnode);
+
+			/* on success the dependency is now on top of the stack, and is released when it is popped */
+			if (!pkgconf_pkg_traverse_enter(&walk, &stack, pkgdep, func, data, frame->maxdepth - 1,
+				frame->walking_private || frame->private_path, &eflags_child))
+			{
+				frame->eflags |= eflags_child;
+				pkgconf_pkg_unref(client, pkgdep);
+			}
+
+			continue;
+		}
+
+		/* the requires list is exhausted, walk the requires.private list if it was resolved cleanly */
+		if (!frame->walking_private && frame->eflags == PKGCONF_PKG_ERRF_OK && (walk.flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE))
+		{
+			PKGCONF_TRACE(client, "%s: walking requires.private list", frame->pkg->id);
+
+			walk.flags |= PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE;
+
+			frame->walking_private = true;
+			frame->next = frame->pkg->requires_private.head;
+			continue;
+		}
+
+		if (frame->walking_private)
+			walk.flags &= ~PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE;
+
+		eflags = frame->eflags;
+		stack.depth--;
+
+		PKGCONF_TIMING_END(client, PKGCONF_TIMING_TRAVERSE);
+
+		if (stack.depth > 0)
+		{
+			stack.frames[stack.depth - 1].eflags |= eflags;
+			pkgconf_pkg_unref(client, frame->pkg);
+		}
 	}
 
+	free(stack.frames);
+
+	if (stack.nclosure > 0)
+		eflags |= pkgconf_pkg_verify_conflicts(&walk, stack.closure, stack.nclosure);
+
+	for (i = 0; i < stack.nclosure; i++)
+		pkgconf_pkg_unref(client, stack.closure[i]);
+
+	free(stack.closure);
+	pkgconf_hash_deinit(&stack.expanded);
+
 	return eflags;
 }
 
-static void
-pkgconf_pkg_cflags_collect(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data)
+/*
+ * !doc
+ *
+ * .. c:function:: unsigned int pkgconf_pkg_traverse(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_pkg_traverse_func_t func, void *data, int maxdepth)
+ *
+ *    Walk and resolve the dependency graph up to `maxdepth` levels.
+ *
+ *    By default, a package is visited once for every path leading to it.  If the ``PKGCONF_PKG_PKGF_TRAVERSE_ONCE``
+ *    flag is set on the query, each package is resolved and visited only once, and packages are visited in an order
+ *    where every package comes after all of the packages which require it.  In that mode, a package is only treated
+ *    as private if it cannot be reached without going through a ``Requires.private`` edge, so a traversal function
+ *    collecting fragments gets a different result than with the default walk.  ``pkgconf_pkg_cflags()`` and
+ *    ``pkgconf_pkg_libs()`` use a graph instead, which comes closer to the default output but can still differ from it.
+ *
+ *    The traversal function is passed a copy of the query, owned by the walk.  Its ``PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH``
+ *    flag is set if the package being visited was reached through a ``Requires.private`` edge, and its
+ *    ``PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE`` flag while a ``Requires.private`` list is being walked.  The query passed
+ *    in is not modified, so several traversals can run on the same query at once.
+ *
+ *    Unless the ``PKGCONF_PKG_PKGF_SKIP_CONFLICTS`` flag is set, the ``Conflicts`` rules of every package in the
+ *    dependency graph are checked against the whole graph before the traversal function is called for any package.
+ *    If the graph cannot be resolved or has a conflict, the traversal function is not called at all.
+ *
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
+ *    :param pkgconf_pkg_t* root: The root of the dependency graph.
+ *    :param pkgconf_pkg_traverse_func_t func: A traversal function to call for each resolved node in the dependency graph.
+ *    :param void* data: An opaque pointer to data to be passed to the traversal function.
+ *    :param int maxdepth: The maximum depth to walk the dependency graph for.  -1 means infinite recursion.
+ *    :return: ``PKGCONF_PKG_ERRF_OK`` on success, else an error code.
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_pkg_traverse(const pkgconf_query_t *query,
+	pkgconf_pkg_t *root,
+	pkgconf_pkg_traverse_func_t func,
+	void *data,
+	int maxdepth)
 {
-	pkgconf_list_t *list = data;
-	pkgconf_node_t *node;
+	unsigned int eflags;
 
-	PKGCONF_FOREACH_LIST_ENTRY(pkg->cflags.head, node)
-	{
-		pkgconf_fragment_t *frag = node->data;
-		pkgconf_fragment_copy(client, list, frag, false);
-	}
+	PKGCONF_TIMING_BEGIN(query->client, PKGCONF_TIMING_TRAVERSE, root->id);
+
+	if (query->flags & PKGCONF_PKG_PKGF_TRAVERSE_ONCE)
+		eflags = pkgconf_pkg_traverse_once(query, root, func, data, maxdepth);
+	else
+		eflags = pkgconf_pkg_traverse_main(query, root, func, data, maxdepth);
+
+	PKGCONF_TIMING_END(query->client, PKGCONF_TIMING_TRAVERSE);
+
+	return eflags;
 }
 
 static void
-pkgconf_pkg_cflags_private_collect(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data)
+pkgconf_pkg_cflags_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
 {
-	pkgconf_list_t *list = data;
-	pkgconf_node_t *node;
+	pkgconf_fragment_copy_list(query->client, data, &pkg->cflags, false);
+}
 
-	PKGCONF_FOREACH_LIST_ENTRY(pkg->cflags_private.head, node)
-	{
-		pkgconf_fragment_t *frag = node->data;
-		pkgconf_fragment_copy(client, list, frag, true);
-	}
+static void
+pkgconf_pkg_cflags_private_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	pkgconf_fragment_copy_list(query->client, data, &pkg->cflags_private, true);
 }
 
 /*
  * !doc
  *
- * .. c:function:: int pkgconf_pkg_cflags(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
+ * .. c:function:: int pkgconf_pkg_cflags(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
  *
  *    Walks a dependency graph and extracts relevant ``CFLAGS`` fragments.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
  *    :param pkgconf_pkg_t* root: The root of the dependency graph.
  *    :param pkgconf_list_t* list: The fragment list to add the extracted ``CFLAGS`` fragments to.
  *    :param int maxdepth: The maximum allowed depth for dependency resolution.  -1 means infinite recursion.
@@ -1517,17 +2364,29 @@ pkgconf_pkg_cflags_private_collect(pkgconf_client_t *client, pkgconf_pkg_t *pkg,
  *    :rtype: unsigned int
  */
 unsigned int
-pkgconf_pkg_cflags(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
+pkgconf_pkg_cflags(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
 {
 	unsigned int eflag;
 
-	eflag = pkgconf_pkg_traverse(client, root, pkgconf_pkg_cflags_collect, list, maxdepth);
+	pkgconf_fragment_index_list(list);
+
+	if (query->flags & PKGCONF_PKG_PKGF_TRAVERSE_ONCE)
+	{
+		pkgconf_graph_t *graph = pkgconf_graph_new_from_pkg(query, root, maxdepth);
+
+		eflag = pkgconf_graph_cflags(graph, query, list);
+		pkgconf_graph_free(graph);
+
+		return eflag;
+	}
+
+	eflag = pkgconf_pkg_traverse(query, root, pkgconf_pkg_cflags_collect, list, maxdepth);
 	if (eflag != PKGCONF_PKG_ERRF_OK)
 		pkgconf_fragment_free(list);
 
-	if (client->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+	if (query->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
 	{
-		eflag = pkgconf_pkg_traverse(client, root, pkgconf_pkg_cflags_private_collect, list, maxdepth);
+		eflag = pkgconf_pkg_traverse(query, root, pkgconf_pkg_cflags_private_collect, list, maxdepth);
 		if (eflag != PKGCONF_PKG_ERRF_OK)
 			pkgconf_fragment_free(list);
 	}
@@ -1536,52 +2395,175 @@ pkgconf_pkg_cflags(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t
 }
 
 static void
-pkgconf_pkg_libs_collect(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data)
+pkgconf_pkg_libs_collect(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
 {
-	pkgconf_list_t *list = data;
-	pkgconf_node_t *node;
+	pkgconf_fragment_copy_list(query->client, data, &pkg->libs, (query->flags & PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE) != 0);
+
+	if (query->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+		pkgconf_fragment_copy_list(query->client, data, &pkg->libs_private, true);
+}
 
-	PKGCONF_FOREACH_LIST_ENTRY(pkg->libs.head, node)
+/*
+ * !doc
+ *
+ * .. c:function:: int pkgconf_pkg_libs(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
+ *
+ *    Walks a dependency graph and extracts relevant ``LIBS`` fragments.  If the ``PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS``
+ *    flag is set on the query, the graph is resolved once and the fragments are extracted as ``pkgconf_graph_libs()``
+ *    does.
+ *
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
+ *    :param pkgconf_pkg_t* root: The root of the dependency graph.
+ *    :param pkgconf_list_t* list: The fragment list to add the extracted ``LIBS`` fragments to.
+ *    :param int maxdepth: The maximum allowed depth for dependency resolution.  -1 means infinite recursion.
+ *    :return: ``PKGCONF_PKG_ERRF_OK`` if successful, otherwise an error code.
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_pkg_libs(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
+{
+	unsigned int eflag;
+
+	pkgconf_fragment_index_list(list);
+
+	if (query->flags & PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS)
 	{
-		pkgconf_fragment_t *frag = node->data;
-		pkgconf_fragment_copy(client, list, frag, (client->flags & PKGCONF_PKG_PKGF_ITER_PKG_IS_PRIVATE) != 0);
+		pkgconf_graph_t *graph = pkgconf_graph_new_from_pkg(query, root, maxdepth);
+
+		eflag = pkgconf_graph_libs(graph, query, list);
+		pkgconf_graph_free(graph);
+
+		return eflag;
 	}
 
-	if (client->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+	eflag = pkgconf_pkg_traverse(query, root, pkgconf_pkg_libs_collect, list, maxdepth);
+
+	if (eflag != PKGCONF_PKG_ERRF_OK)
 	{
-		PKGCONF_FOREACH_LIST_ENTRY(pkg->libs_private.head, node)
-		{
-			pkgconf_fragment_t *frag = node->data;
-			pkgconf_fragment_copy(client, list, frag, true);
-		}
+		pkgconf_fragment_free(list);
+		return eflag;
 	}
+
+	return eflag;
+}
+
+typedef struct {
+	pkgconf_list_t *cflags;
+	pkgconf_list_t cflags_private;
+	pkgconf_list_t *libs;
+	bool libs_private;
+} pkgconf_pkg_collect_ctx_t;
+
+static void
+pkgconf_pkg_collect_visit(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	pkgconf_pkg_collect_ctx_t *ctx = data;
+
+	if (ctx->cflags != NULL)
+	{
+		pkgconf_pkg_cflags_collect(query, pkg, ctx->cflags);
+
+		/* private fragments are never merged, so collecting them on the side is the same as a second pass */
+		if (query->flags & PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+			pkgconf_pkg_cflags_private_collect(query, pkg, &ctx->cflags_private);
+	}
+
+	if (ctx->libs != NULL && (ctx->libs_private || !(query->flags & PKGCONF_PKG_PKGF_ITER_PKG_PRIVATE_PATH)))
+		pkgconf_pkg_libs_collect(query, pkg, ctx->libs);
+}
+
+static unsigned int
+pkgconf_pkg_collect_once(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *cflags, pkgconf_list_t *libs, const pkgconf_query_t *libs_query, int maxdepth)
+{
+	pkgconf_graph_t *graph;
+	unsigned int eflags;
+
+	if (maxdepth == 0)
+		return PKGCONF_PKG_ERRF_OK;
+
+	graph = pkgconf_graph_new_from_pkg(query, root, maxdepth);
+	eflags = pkgconf_graph_get_errors(graph);
+
+	if (cflags != NULL)
+		pkgconf_graph_cflags(graph, query, cflags);
+
+	if (libs != NULL)
+		pkgconf_graph_libs(graph, libs_query, libs);
+
+	pkgconf_graph_free(graph);
+
+	return eflags;
 }
 
 /*
  * !doc
  *
- * .. c:function:: int pkgconf_pkg_libs(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
+ * .. c:function:: int pkgconf_pkg_collect(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *cflags, pkgconf_list_t *libs, int maxdepth)
  *
- *    Walks a dependency graph and extracts relevant ``LIBS`` fragments.
+ *    Walks a dependency graph once and extracts both the ``CFLAGS`` and the ``LIBS`` fragments from it.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    The ``CFLAGS`` fragments are collected as ``pkgconf_pkg_cflags()`` would with ``PKGCONF_PKG_PKGF_SEARCH_PRIVATE`` set,
+ *    since the headers of private dependencies are needed to compile against a package.  The ``LIBS`` fragments are collected
+ *    as ``pkgconf_pkg_libs()`` would with the query unchanged.  The output is identical to calling both functions in
+ *    turn, but the dependency graph is only walked once.  The ``PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS`` flag only changes
+ *    how the ``LIBS`` fragments are collected, so in that case they are extracted from a graph of their own.
+ *
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
  *    :param pkgconf_pkg_t* root: The root of the dependency graph.
- *    :param pkgconf_list_t* list: The fragment list to add the extracted ``LIBS`` fragments to.
+ *    :param pkgconf_list_t* cflags: The fragment list to add the extracted ``CFLAGS`` fragments to, or ``NULL``.
+ *    :param pkgconf_list_t* libs: The fragment list to add the extracted ``LIBS`` fragments to, or ``NULL``.
  *    :param int maxdepth: The maximum allowed depth for dependency resolution.  -1 means infinite recursion.
  *    :return: ``PKGCONF_PKG_ERRF_OK`` if successful, otherwise an error code.
  *    :rtype: unsigned int
  */
 unsigned int
-pkgconf_pkg_libs(pkgconf_client_t *client, pkgconf_pkg_t *root, pkgconf_list_t *list, int maxdepth)
+pkgconf_pkg_collect(const pkgconf_query_t *query, pkgconf_pkg_t *root, pkgconf_list_t *cflags, pkgconf_list_t *libs, int maxdepth)
 {
+	pkgconf_pkg_collect_ctx_t ctx = {
+		.cflags = cflags,
+		.cflags_private = PKGCONF_LIST_INITIALIZER,
+		.libs = libs,
+		.libs_private = (query->flags & PKGCONF_PKG_PKGF_SEARCH_PRIVATE) != 0,
+	};
+	pkgconf_query_t walk = *query;
 	unsigned int eflag;
 
-	eflag = pkgconf_pkg_traverse(client, root, pkgconf_pkg_libs_collect, list, maxdepth);
+	if (cflags != NULL)
+	{
+		pkgconf_fragment_index_list(cflags);
+		walk.flags |= PKGCONF_PKG_PKGF_SEARCH_PRIVATE;
+	}
+
+	if (libs != NULL)
+		pkgconf_fragment_index_list(libs);
+
+	if (walk.flags & PKGCONF_PKG_PKGF_TRAVERSE_ONCE)
+		eflag = pkgconf_pkg_collect_once(&walk, root, cflags, libs, query, maxdepth);
+	else if (libs != NULL && (walk.flags & PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS))
+	{
+		/* only the LIBS fragments are ordered topologically, the CFLAGS ones are collected as usual */
+		ctx.libs = NULL;
+		eflag = PKGCONF_PKG_ERRF_OK;
+
+		if (cflags != NULL)
+			eflag = pkgconf_pkg_traverse(&walk, root, pkgconf_pkg_collect_visit, &ctx, maxdepth);
+
+		if (eflag == PKGCONF_PKG_ERRF_OK)
+			eflag = pkgconf_pkg_libs(query, root, libs, maxdepth);
+	}
+	else
+		eflag = pkgconf_pkg_traverse(&walk, root, pkgconf_pkg_collect_visit, &ctx, maxdepth);
+
+	if (cflags != NULL)
+		pkgconf_fragment_move_list(cflags, &ctx.cflags_private);
 
 	if (eflag != PKGCONF_PKG_ERRF_OK)
 	{
-		pkgconf_fragment_free(list);
-		return eflag;
+		if (cflags != NULL)
+			pkgconf_fragment_free(cflags);
+
+		if (libs != NULL)
+			pkgconf_fragment_free(libs);
 	}
 
 	return eflag;
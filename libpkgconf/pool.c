@@ -0,0 +1,296 @@
+/*
+ * pool.c
+ * shared immutable package object pool
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_POOL
+
+#include <libpkgconf/libpkgconf.h>
+#include <libpkgconf/thread.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `pool` module
+ * ========================
+ *
+ * The libpkgconf `pool` module implements a process-wide pool of parsed package objects which
+ * may be shared between any number of client objects, including clients living on different
+ * threads.
+ *
+ * Entries are keyed by the identity of the `.pc` file they were parsed from (path, device, inode,
+ * size and modification time) combined with every client setting which influences parsing, such
+ * as the sysroot, the prefix variable name and the global variables.  Clients with equivalent
+ * settings therefore parse a given `.pc` file only once, while a modified file or a client with
+ * different settings gets a fresh entry.
+ *
+ * Packages obtained from a pool carry the ``PKGCONF_PKG_PROPF_SHARED`` flag.  They are immutable
+ * once published and are reference counted atomically; ``pkgconf_pkg_free()`` on such a package
+ * only drops the caller's reference.
+ */
+
+struct pkgconf_pool_ {
+	pkgconf_mutex_t mutex;
+	pkgconf_list_t entries;
+	int refcount;
+
+	/* the entries indexed by key, and by package for eviction */
+	pkgconf_hash_t index;
+	pkgconf_hash_t pkg_index;
+};
+
+typedef struct {
+	pkgconf_node_t iter;
+
+	char *key;
+	pkgconf_pkg_t *pkg;
+} pkgconf_pool_entry_t;
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_pool_t *pkgconf_pool_new(void)
+ *
+ *    Allocates a new, empty package pool with a reference count of one.
+ *
+ *    :return: A package pool object.
+ *    :rtype: pkgconf_pool_t *
+ */
+pkgconf_pool_t *
+pkgconf_pool_new(void)
+{
+	pkgconf_pool_t *pool = calloc(sizeof(pkgconf_pool_t), 1);
+
+	pkgconf_mutex_init(&pool->mutex);
+	pkgconf_hash_init(&pool->index, pkgconf_hash_str, pkgconf_hash_str_equal);
+	pkgconf_hash_init(&pool->pkg_index, pkgconf_hash_ptr, pkgconf_hash_ptr_equal);
+	pool->refcount = 1;
+
+	return pool;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_pool_t *pkgconf_pool_ref(pkgconf_pool_t *pool)
+ *
+ *    Adds a reference to a package pool.
+ *
+ *    :param pkgconf_pool_t* pool: The package pool being referenced.
+ *    :return: The package pool itself.
+ *    :rtype: pkgconf_pool_t *
+ */
+pkgconf_pool_t *
+pkgconf_pool_ref(pkgconf_pool_t *pool)
+{
+	pkgconf_atomic_inc(&pool->refcount);
+	return pool;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_pool_unref(pkgconf_pool_t *pool)
+ *
+ *    Releases a reference to a package pool.  When the last reference is released, the pool drops
+ *    its references to all of the packages it holds.  Packages which are still referenced by a client
+ *    remain valid until that client releases them.
+ *
+ *    :param pkgconf_pool_t* pool: The package pool being dereferenced.
+ *    :return: nothing
+ */
+void
+pkgconf_pool_unref(pkgconf_pool_t *pool)
+{
+	pkgconf_node_t *iter, *iter2;
+
+	if (pool == NULL || pkgconf_atomic_dec(&pool->refcount) > 0)
+		return;
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(pool->entries.head, iter2, iter)
+	{
+		pkgconf_pool_entry_t *entry = iter->data;
+
+		pkgconf_pkg_unref(NULL, entry->pkg);
+		free(entry->key);
+		free(entry);
+	}
+
+	pkgconf_hash_deinit(&pool->index);
+	pkgconf_hash_deinit(&pool->pkg_index);
+	pkgconf_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_pkg_t *pkgconf_pool_lookup(pkgconf_pool_t *pool, const char *key)
+ *
+ *    Looks up a package in the pool.
+ *
+ *    :param pkgconf_pool_t* pool: The package pool to search.
+ *    :param char* key: The identity key of the package, as computed by the parser.
+ *    :return: A new reference to the pooled package, or ``NULL`` if no package matches the key.
+ *    :rtype: pkgconf_pkg_t *
+ */
+pkgconf_pkg_t *
+pkgconf_pool_lookup(pkgconf_pool_t *pool, const char *key)
+{
+	pkgconf_pool_entry_t *entry;
+	pkgconf_pkg_t *pkg = NULL;
+
+	pkgconf_mutex_lock(&pool->mutex);
+
+	entry = pkgconf_hash_lookup(&pool->index, key);
+	if (entry != NULL)
+		pkg = pkgconf_pkg_ref(NULL, entry->pkg);
+
+	pkgconf_mutex_unlock(&pool->mutex);
+
+	return pkg;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_pkg_t *pkgconf_pool_insert(pkgconf_pool_t *pool, const char *key, pkgconf_pkg_t *pkg)
+ *
+ *    Publishes a freshly parsed package in the pool.  The package is marked as shared and must not be
+ *    modified afterwards.  If another client published a package under the same key in the meantime,
+ *    the caller's package is released and the already published one is returned instead.
+ *
+ *    :param pkgconf_pool_t* pool: The package pool to publish the package in.
+ *    :param char* key: The identity key of the package, as computed by the parser.
+ *    :param pkgconf_pkg_t* pkg: The package to publish.  The caller's reference is transferred to the return value.
+ *    :return: A reference to the pooled package.
+ *    :rtype: pkgconf_pkg_t *
+ */
+pkgconf_pkg_t *
+pkgconf_pool_insert(pkgconf_pool_t *pool, const char *key, pkgconf_pkg_t *pkg)
+{
+	pkgconf_pool_entry_t *entry;
+	pkgconf_pkg_t *out;
+
+	pkgconf_mutex_lock(&pool->mutex);
+
+	entry = pkgconf_hash_lookup(&pool->index, key);
+	if (entry == NULL)
+	{
+		entry = calloc(sizeof(pkgconf_pool_entry_t), 1);
+		entry->key = strdup(key);
+
+		/* the pool is a cache as well, and the package may not be modified once it is published */
+		pkg->flags |= PKGCONF_PKG_PROPF_SHARED | PKGCONF_PKG_PROPF_CACHED;
+		entry->pkg = pkgconf_pkg_ref(NULL, pkg);
+
+		pkgconf_node_insert(&entry->iter, entry, &pool->entries);
+		pkgconf_hash_insert(&pool->index, entry->key, entry);
+		pkgconf_hash_insert(&pool->pkg_index, entry->pkg, entry);
+
+		pkgconf_mutex_unlock(&pool->mutex);
+		return pkg;
+	}
+
+	out = pkgconf_pkg_ref(NULL, entry->pkg);
+
+	pkgconf_mutex_unlock(&pool->mutex);
+
+	/* lost the race against another client: the package was never published, so free it directly */
+	pkgconf_pkg_free(NULL, pkg);
+
+	return out;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: bool pkgconf_pool_evict(pkgconf_pool_t *pool, const pkgconf_pkg_t *pkg)
+ *
+ *    Removes a package from the pool, so that the next lookup of its `.pc` file parses the file again even if
+ *    its identity did not change, as happens when a file is rewritten within the same second.  References to
+ *    the package which were already handed out remain valid.
+ *
+ *    :param pkgconf_pool_t* pool: The package pool to modify.
+ *    :param pkgconf_pkg_t* pkg: The package to remove.
+ *    :return: true if the package was found in the pool, else false
+ *    :rtype: bool
+ */
+bool
+pkgconf_pool_evict(pkgconf_pool_t *pool, const pkgconf_pkg_t *pkg)
+{
+	pkgconf_pool_entry_t *entry;
+
+	pkgconf_mutex_lock(&pool->mutex);
+
+	entry = pkgconf_hash_lookup(&pool->pkg_index, pkg);
+	if (entry != NULL)
+	{
+		pkgconf_hash_remove(&pool->index, entry->key, entry);
+		pkgconf_hash_remove(&pool->pkg_index, entry->pkg, entry);
+		pkgconf_node_delete(&entry->iter, &pool->entries);
+	}
+
+	pkgconf_mutex_unlock(&pool->mutex);
+
+	if (entry == NULL)
+		return false;
+
+	pkgconf_pkg_unref(NULL, entry->pkg);
+	free(entry->key);
+	free(entry);
+
+	return true;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_pool(pkgconf_client_t *client, pkgconf_pool_t *pool)
+ *
+ *    Attaches a package pool to a client object, or detaches the current one if `pool` is ``NULL``.
+ *    The client takes its own reference on the pool.  Packages already present in the client's cache
+ *    are not affected.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param pkgconf_pool_t* pool: The package pool to use, or ``NULL``.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_pool(pkgconf_client_t *client, pkgconf_pool_t *pool)
+{
+	if (pool != NULL)
+		pkgconf_pool_ref(pool);
+
+	pkgconf_pool_unref(client->pool);
+	client->pool = pool;
+
+	PKGCONF_TRACE(client, "set package pool to @%p", pool);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_pool_t *pkgconf_client_get_pool(const pkgconf_client_t *client)
+ *
+ *    Retrieves the package pool attached to a client object, if any.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :return: The package pool or ``NULL``.
+ *    :rtype: pkgconf_pool_t *
+ */
+pkgconf_pool_t *
+pkgconf_client_get_pool(const pkgconf_client_t *client)
+{
+	return client->pool;
+}
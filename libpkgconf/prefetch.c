@@ -0,0 +1,317 @@
+/*
+ * prefetch.c
+ * speculative loading of dependencies on worker threads
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_POOL
+
+#include <libpkgconf/libpkgconf.h>
+#include <libpkgconf/thread.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `prefetch` module
+ * ============================
+ *
+ * The libpkgconf `prefetch` module lets a client look up and parse the dependencies of a package on a
+ * pool of worker threads, while the dependency resolver is still busy with the first of them.  When the
+ * resolver enters a package, every entry of its ``Requires`` list (and of its ``Requires.private`` list when
+ * private dependencies are searched) is queued for the workers, which parse the matching `.pc` files into
+ * the client's package pool using ``pkgconf_pkg_preload()``.
+ *
+ * The resolver itself is unchanged: it still looks every dependency up in order, on the calling thread,
+ * and merely finds most of them already parsed.  A dependency which is still being parsed by a worker is
+ * waited for instead of being parsed twice.  The results, including warnings and errors, are therefore
+ * exactly the same as without prefetching.
+ *
+ * The workers use a copy of the client settings taken when prefetching is enabled.  Changes made to the
+ * client afterwards are not seen by the workers, which only costs a wasted parse, never a wrong result.
+ */
+
+typedef enum {
+	PKGCONF_PREFETCH_PENDING,
+	PKGCONF_PREFETCH_RUNNING,
+	PKGCONF_PREFETCH_DONE,
+} pkgconf_prefetch_state_t;
+
+typedef struct {
+	pkgconf_node_t iter;
+	pkgconf_node_t queue_iter;
+
+	char *name;
+	pkgconf_prefetch_state_t state;
+} pkgconf_prefetch_job_t;
+
+struct pkgconf_prefetch_ {
+	pkgconf_mutex_t mutex;
+	pkgconf_cond_t work_cond;
+	pkgconf_cond_t done_cond;
+
+	/* a silent clone of the owning client, as read by the workers */
+	pkgconf_client_t *client;
+
+	/* the jobs not waited on yet, indexed by package name, and those not picked up by a worker yet */
+	pkgconf_list_t jobs;
+	pkgconf_hash_t job_index;
+	pkgconf_list_t queue;
+
+	pkgconf_thread_t *threads;
+	size_t nthreads;
+	bool shutdown;
+};
+
+static PKGCONF_THREAD_FUNC
+pkgconf_prefetch_worker(void *arg)
+{
+	pkgconf_prefetch_t *prefetch = arg;
+
+	pkgconf_mutex_lock(&prefetch->mutex);
+
+	while (!prefetch->shutdown)
+	{
+		pkgconf_prefetch_job_t *job;
+
+		if (prefetch->queue.head == NULL)
+		{
+			pkgconf_cond_wait(&prefetch->work_cond, &prefetch->mutex);
+			continue;
+		}
+
+		job = prefetch->queue.head->data;
+		pkgconf_node_delete(&job->queue_iter, &prefetch->queue);
+		job->state = PKGCONF_PREFETCH_RUNNING;
+
+		pkgconf_mutex_unlock(&prefetch->mutex);
+		pkgconf_pkg_preload(prefetch->client, job->name);
+		pkgconf_mutex_lock(&prefetch->mutex);
+
+		job->state = PKGCONF_PREFETCH_DONE;
+		pkgconf_cond_broadcast(&prefetch->done_cond);
+	}
+
+	pkgconf_mutex_unlock(&prefetch->mutex);
+
+	return 0;
+}
+
+static void
+pkgconf_prefetch_free(pkgconf_prefetch_t *prefetch)
+{
+	pkgconf_node_t *iter, *iter2;
+	size_t i;
+
+	pkgconf_mutex_lock(&prefetch->mutex);
+	prefetch->shutdown = true;
+	pkgconf_cond_broadcast(&prefetch->work_cond);
+	pkgconf_mutex_unlock(&prefetch->mutex);
+
+	for (i = 0; i < prefetch->nthreads; i++)
+		pkgconf_thread_join(prefetch->threads[i]);
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(prefetch->jobs.head, iter2, iter)
+	{
+		pkgconf_prefetch_job_t *job = iter->data;
+
+		free(job->name);
+		free(job);
+	}
+
+	pkgconf_hash_deinit(&prefetch->job_index);
+	pkgconf_client_free(prefetch->client);
+
+	pkgconf_cond_destroy(&prefetch->done_cond);
+	pkgconf_cond_destroy(&prefetch->work_cond);
+	pkgconf_mutex_destroy(&prefetch->mutex);
+
+	free(prefetch->threads);
+	free(prefetch);
+}
+
+static pkgconf_prefetch_t *
+pkgconf_prefetch_new(pkgconf_client_t *client, size_t nthreads)
+{
+	pkgconf_prefetch_t *prefetch = calloc(sizeof(pkgconf_prefetch_t), 1);
+
+	pkgconf_mutex_init(&prefetch->mutex);
+	pkgconf_cond_init(&prefetch->work_cond);
+	pkgconf_cond_init(&prefetch->done_cond);
+	pkgconf_hash_init(&prefetch->job_index, pkgconf_hash_str, pkgconf_hash_str_equal);
+
+	/* the workers search and parse like the owning client, but report nothing */
+	prefetch->client = pkgconf_client_clone(client);
+	pkgconf_client_set_trace_handler(prefetch->client, NULL, NULL);
+	pkgconf_client_set_error_handler(prefetch->client, NULL, NULL);
+	pkgconf_client_set_warn_handler(prefetch->client, NULL, NULL);
+
+	prefetch->threads = calloc(sizeof(pkgconf_thread_t), nthreads);
+	while (prefetch->nthreads < nthreads)
+	{
+		if (!pkgconf_thread_create(&prefetch->threads[prefetch->nthreads], pkgconf_prefetch_worker, prefetch))
+			break;
+
+		prefetch->nthreads++;
+	}
+
+	if (prefetch->nthreads == 0)
+	{
+		pkgconf_prefetch_free(prefetch);
+		return NULL;
+	}
+
+	return prefetch;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_prefetch_threads(pkgconf_client_t *client, size_t nthreads)
+ *
+ *    Enables prefetching of dependencies on `nthreads` worker threads, or disables it if `nthreads` is zero.
+ *    If no package pool is attached to the client, a new one is attached, as prefetched packages are handed
+ *    over through the pool.  The workers use a clone of the client made at this point, as by
+ *    ``pkgconf_client_clone()``, so prefetching should be enabled once the client is fully configured.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param size_t nthreads: The number of worker threads to use.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_prefetch_threads(pkgconf_client_t *client, size_t nthreads)
+{
+	if (client->prefetch != NULL)
+	{
+		pkgconf_prefetch_free(client->prefetch);
+		client->prefetch = NULL;
+	}
+
+	if (nthreads == 0)
+		return;
+
+	if (client->pool == NULL)
+	{
+		pkgconf_pool_t *pool = pkgconf_pool_new();
+
+		pkgconf_client_set_pool(client, pool);
+		pkgconf_pool_unref(pool);
+	}
+
+	client->prefetch = pkgconf_prefetch_new(client, nthreads);
+
+	PKGCONF_TRACE(client, "prefetching packages with %zu threads", pkgconf_client_get_prefetch_threads(client));
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: size_t pkgconf_client_get_prefetch_threads(const pkgconf_client_t *client)
+ *
+ *    Retrieves the number of worker threads prefetching dependencies for a client object.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :return: The number of worker threads, or zero if prefetching is disabled.
+ *    :rtype: size_t
+ */
+size_t
+pkgconf_client_get_prefetch_threads(const pkgconf_client_t *client)
+{
+	return client->prefetch != NULL ? client->prefetch->nthreads : 0;
+}
+
+/*
+ * pkgconf_prefetch_submit(client, deplist)
+ *
+ * queue the packages of a dependency list for loading on the client's worker threads.  packages
+ * which are already cached by the client or still have a job of their own are skipped.  does
+ * nothing if prefetching is disabled.
+ */
+void
+pkgconf_prefetch_submit(pkgconf_client_t *client, const pkgconf_list_t *deplist)
+{
+	pkgconf_prefetch_t *prefetch = client->prefetch;
+	pkgconf_node_t *node;
+	bool submitted = false;
+
+	if (prefetch == NULL)
+		return;
+
+	pkgconf_mutex_lock(&prefetch->mutex);
+
+	PKGCONF_FOREACH_LIST_ENTRY(deplist->head, node)
+	{
+		const pkgconf_dependency_t *dep = node->data;
+		pkgconf_prefetch_job_t *job;
+
+		if (*dep->package == '\0' || pkgconf_hash_lookup(&client->pkg_cache_ids, dep->package) != NULL)
+			continue;
+
+		if (pkgconf_hash_lookup(&prefetch->job_index, dep->package) != NULL)
+			continue;
+
+		job = calloc(sizeof(pkgconf_prefetch_job_t), 1);
+		job->name = strdup(dep->package);
+		job->state = PKGCONF_PREFETCH_PENDING;
+
+		pkgconf_node_insert_tail(&job->iter, job, &prefetch->jobs);
+		pkgconf_node_insert_tail(&job->queue_iter, job, &prefetch->queue);
+		pkgconf_hash_insert(&prefetch->job_index, job->name, job);
+
+		submitted = true;
+	}
+
+	if (submitted)
+		pkgconf_cond_broadcast(&prefetch->work_cond);
+
+	pkgconf_mutex_unlock(&prefetch->mutex);
+}
+
+/*
+ * pkgconf_prefetch_wait(client, name)
+ *
+ * called before a package is looked up.  if a worker thread is loading the package, wait for it
+ * to finish.  if the package is still queued, it is withdrawn, as the caller is about to load it
+ * anyway.  either way the job is done with, and is dropped: the caller caches the package, so it
+ * is not submitted again.
+ */
+void
+pkgconf_prefetch_wait(pkgconf_client_t *client, const char *name)
+{
+	pkgconf_prefetch_t *prefetch = client->prefetch;
+	pkgconf_prefetch_job_t *job;
+
+	if (prefetch == NULL)
+		return;
+
+	pkgconf_mutex_lock(&prefetch->mutex);
+
+	job = pkgconf_hash_lookup(&prefetch->job_index, name);
+	if (job == NULL)
+	{
+		pkgconf_mutex_unlock(&prefetch->mutex);
+		return;
+	}
+
+	if (job->state == PKGCONF_PREFETCH_PENDING)
+		pkgconf_node_delete(&job->queue_iter, &prefetch->queue);
+
+	while (job->state == PKGCONF_PREFETCH_RUNNING)
+		pkgconf_cond_wait(&prefetch->done_cond, &prefetch->mutex);
+
+	pkgconf_hash_remove(&prefetch->job_index, job->name, job);
+	pkgconf_node_delete(&job->iter, &prefetch->jobs);
+
+	pkgconf_mutex_unlock(&prefetch->mutex);
+
+	free(job->name);
+	free(job);
+}
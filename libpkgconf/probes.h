@@ -0,0 +1,55 @@
+/*
+ * probes.h
+ * USDT probe points for dynamic tracing
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#ifndef LIBPKGCONF__PROBES_H
+#define LIBPKGCONF__PROBES_H
+
+/*
+ * This header is private to libpkgconf and is not installed.  When libpkgconf is built with
+ * PKGCONF_ENABLE_USDT defined, the probes below are compiled in as USDT probes of the `pkgconf`
+ * provider using <sys/sdt.h>, so they can be attached to with bpftrace, perf or systemtap.
+ * Otherwise they expand to dead code, and their arguments are not evaluated.
+ *
+ *   find__start(name)                              pkgconf_pkg_find() was called
+ *   find__done(name, filename, found)              pkgconf_pkg_find() returns; filename is NULL if nothing was found
+ *   probe__path(name, path, found)                 a package directory was probed for a .pc file
+ *   parse__start(filename)                         a .pc file is about to be parsed
+ *   parse__done(filename, id, ok)                  a .pc file was parsed; id is NULL if it was invalid
+ *   cache__lookup(name, hit)                       the package cache was consulted
+ *   verify__dependency(package, id, eflags)        a dependency was resolved; id is NULL if nothing satisfied it
+ *   fragment__copy(type, data, outcome)            a fragment was copied into a list; outcome is one of the
+ *                                                  PKGCONF_PROBE_FRAGMENT_* values
+ *
+ * String arguments are NUL-terminated C strings, flags and outcomes are integers.
+ */
+
+#define PKGCONF_PROBE_FRAGMENT_DROPPED	0
+#define PKGCONF_PROBE_FRAGMENT_ADDED	1
+#define PKGCONF_PROBE_FRAGMENT_MOVED	2
+
+#ifdef PKGCONF_ENABLE_USDT
+#include <sys/sdt.h>
+
+#define PKGCONF_PROBE1(name, a)		DTRACE_PROBE1(pkgconf, name, a)
+#define PKGCONF_PROBE2(name, a, b)	DTRACE_PROBE2(pkgconf, name, a, b)
+#define PKGCONF_PROBE3(name, a, b, c)	DTRACE_PROBE3(pkgconf, name, a, b, c)
+#else
+/* the arguments stay referenced, so that variables only passed to probes do not trigger warnings */
+#define PKGCONF_PROBE1(name, a)		do { if (0) { (void) (a); } } while (0)
+#define PKGCONF_PROBE2(name, a, b)	do { if (0) { (void) (a); (void) (b); } } while (0)
+#define PKGCONF_PROBE3(name, a, b, c)	do { if (0) { (void) (a); (void) (b); (void) (c); } } while (0)
+#endif
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * profile.c
+ * per-package resolution cost profile
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#include <libpkgconf/libpkgconf.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `profile` module
+ * ===========================
+ *
+ * The libpkgconf `profile` module attributes the work done by a client to the packages it was done for:
+ * how often each package was looked up, how many `package directories` were probed for it, how often its
+ * `.pc` file was parsed and how long that took, how often the dependency graph walks visited it, and how
+ * many of its fragments were copied into fragment lists or dropped there as duplicates.
+ *
+ * A package is re-parsed when the package cache is disabled, or when resolving a ``Provides`` rule scans
+ * every package, so a high parse count next to a low lookup count points at such scans.
+ *
+ * Profiling is enabled with ``pkgconf_client_set_profile()``; until then, every counted event only costs
+ * a test of the client's ``profile`` field.
+ */
+
+struct pkgconf_profile_ {
+	pkgconf_hash_t index;
+
+	pkgconf_profile_entry_t **entries;
+	size_t nentries;
+	size_t size;
+
+	/* the package being visited, fragments copied meanwhile are attributed to it */
+	pkgconf_profile_entry_t *current;
+};
+
+static pkgconf_profile_entry_t *
+pkgconf_profile_entry(pkgconf_profile_t *profile, const char *package)
+{
+	pkgconf_profile_entry_t *entry;
+
+	if ((entry = pkgconf_hash_lookup(&profile->index, package)) != NULL)
+		return entry;
+
+	if (profile->nentries == profile->size)
+	{
+		profile->size = profile->size ? profile->size * 2 : 32;
+		profile->entries = realloc(profile->entries, profile->size * sizeof(pkgconf_profile_entry_t *));
+	}
+
+	entry = calloc(sizeof(pkgconf_profile_entry_t), 1);
+	entry->package = strdup(package);
+
+	profile->entries[profile->nentries++] = entry;
+	pkgconf_hash_insert(&profile->index, entry->package, entry);
+
+	return entry;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_profile(pkgconf_client_t *client, bool enabled)
+ *
+ *    Starts or stops profiling the packages resolved by a client.  Stopping discards the profile.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param bool enabled: Whether packages should be profiled.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_profile(pkgconf_client_t *client, bool enabled)
+{
+	pkgconf_profile_t *profile = client->profile;
+	size_t i;
+
+	if (enabled)
+	{
+		if (profile == NULL)
+		{
+			client->profile = calloc(sizeof(pkgconf_profile_t), 1);
+			pkgconf_hash_init(&client->profile->index, pkgconf_hash_str, pkgconf_hash_str_equal);
+		}
+
+		return;
+	}
+
+	if (profile == NULL)
+		return;
+
+	for (i = 0; i < profile->nentries; i++)
+	{
+		free((char *) profile->entries[i]->package);
+		free(profile->entries[i]);
+	}
+
+	pkgconf_hash_deinit(&profile->index);
+	free(profile->entries);
+	free(profile);
+
+	client->profile = NULL;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_profile_count(const pkgconf_client_t *client, const char *package, pkgconf_profile_counter_t counter, size_t n)
+ *
+ *    Adds to one of the counters of a package.  This is normally called through the ``PKGCONF_PROFILE_COUNT()``
+ *    macro, which skips the call if the client is not being profiled.
+ *
+ *    :param pkgconf_client_t* client: The client object being profiled.
+ *    :param char* package: The name of the package.
+ *    :param pkgconf_profile_counter_t counter: The counter to add to.
+ *    :param size_t n: The amount to add.
+ *    :return: nothing
+ */
+void
+pkgconf_profile_count(const pkgconf_client_t *client, const char *package, pkgconf_profile_counter_t counter, size_t n)
+{
+	if (client->profile == NULL || (unsigned int) counter >= PKGCONF_PROFILE_COUNTER_COUNT)
+		return;
+
+	pkgconf_profile_entry(client->profile, package)->counters[counter] += n;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_profile_parse(const pkgconf_client_t *client, const char *package, uint64_t elapsed_ns)
+ *
+ *    Records that the `.pc` file of a package was parsed.
+ *
+ *    :param pkgconf_client_t* client: The client object being profiled.
+ *    :param char* package: The name of the package.
+ *    :param uint64_t elapsed_ns: The time the parse took, in nanoseconds.
+ *    :return: nothing
+ */
+void
+pkgconf_profile_parse(const pkgconf_client_t *client, const char *package, uint64_t elapsed_ns)
+{
+	pkgconf_profile_entry_t *entry;
+
+	if (client->profile == NULL)
+		return;
+
+	entry = pkgconf_profile_entry(client->profile, package);
+	entry->counters[PKGCONF_PROFILE_PARSES]++;
+	entry->parse_ns += elapsed_ns;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_profile_visit(const pkgconf_client_t *client, const char *package)
+ *
+ *    Records that a dependency graph walk visited a package.  Fragments copied until the next visit are
+ *    attributed to the package.
+ *
+ *    :param pkgconf_client_t* client: The client object being profiled.
+ *    :param char* package: The name of the package.
+ *    :return: nothing
+ */
+void
+pkgconf_profile_visit(const pkgconf_client_t *client, const char *package)
+{
+	pkgconf_profile_entry_t *entry;
+
+	if (client->profile == NULL)
+		return;
+
+	entry = pkgconf_profile_entry(client->profile, package);
+	entry->counters[PKGCONF_PROFILE_VISITS]++;
+
+	client->profile->current = entry;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_profile_fragments(const pkgconf_client_t *client, size_t copied, size_t added)
+ *
+ *    Records that fragments were copied into a fragment list on behalf of the package being visited.
+ *    Fragments which were copied but did not grow the list were deduplicated.
+ *
+ *    :param pkgconf_client_t* client: The client object being profiled.
+ *    :param size_t copied: The number of fragments copied.
+ *    :param size_t added: The number of fragments the list grew by.
+ *    :return: nothing
+ */
+void
+pkgconf_profile_fragments(const pkgconf_client_t *client, size_t copied, size_t added)
+{
+	pkgconf_profile_entry_t *entry;
+
+	if (client->profile == NULL || (entry = client->profile->current) == NULL)
+		return;
+
+	entry->counters[PKGCONF_PROFILE_FRAGMENTS] += copied;
+	entry->counters[PKGCONF_PROFILE_DEDUPLICATED] += copied - added;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: const pkgconf_profile_entry_t *pkgconf_client_get_profile(const pkgconf_client_t *client, const char *package)
+ *
+ *    Retrieves the profile of a package.
+ *
+ *    :param pkgconf_client_t* client: The client object being profiled.
+ *    :param char* package: The name of the package.
+ *    :return: the profile of the package, or ``NULL`` if nothing was recorded for it
+ *    :rtype: const pkgconf_profile_entry_t *
+ */
+const pkgconf_profile_entry_t *
+pkgconf_client_get_profile(const pkgconf_client_t *client, const char *package)
+{
+	if (client->profile == NULL)
+		return NULL;
+
+	return pkgconf_hash_lookup(&client->profile->index, package);
+}
+
+static int
+pkgconf_profile_entry_cmp(const void *a, const void *b)
+{
+	const pkgconf_profile_entry_t *ea = *(pkgconf_profile_entry_t * const *) a;
+	const pkgconf_profile_entry_t *eb = *(pkgconf_profile_entry_t * const *) b;
+
+	if (ea->parse_ns != eb->parse_ns)
+		return ea->parse_ns > eb->parse_ns ? -1 : 1;
+
+	if (ea->counters[PKGCONF_PROFILE_VISITS] != eb->counters[PKGCONF_PROFILE_VISITS])
+		return ea->counters[PKGCONF_PROFILE_VISITS] > eb->counters[PKGCONF_PROFILE_VISITS] ? -1 : 1;
+
+	if (ea->counters[PKGCONF_PROFILE_LOOKUPS] != eb->counters[PKGCONF_PROFILE_LOOKUPS])
+		return ea->counters[PKGCONF_PROFILE_LOOKUPS] > eb->counters[PKGCONF_PROFILE_LOOKUPS] ? -1 : 1;
+
+	return strcmp(ea->package, eb->package);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_dump_profile(const pkgconf_client_t *client, FILE *out)
+ *
+ *    Writes a table of the package profiles to a stream, sorted by parse time, then by the number of visits
+ *    and lookups.
+ *
+ *    :param pkgconf_client_t* client: The client object being profiled.
+ *    :param FILE* out: The stream to write the table to.
+ *    :return: nothing
+ */
+void
+pkgconf_client_dump_profile(const pkgconf_client_t *client, FILE *out)
+{
+	const pkgconf_profile_t *profile = client->profile;
+	pkgconf_profile_entry_t **sorted;
+	size_t i;
+
+	if (profile == NULL)
+		return;
+
+	sorted = calloc(profile->nentries ? profile->nentries : 1, sizeof(pkgconf_profile_entry_t *));
+	memcpy(sorted, profile->entries, profile->nentries * sizeof(pkgconf_profile_entry_t *));
+	qsort(sorted, profile->nentries, sizeof(pkgconf_profile_entry_t *), pkgconf_profile_entry_cmp);
+
+	fprintf(out, "%-24s %8s %8s %8s %10s %8s %9s %8s\n", "package", "lookups", "probes", "parses",
+		"parse (ms)", "visits", "fragments", "deduped");
+
+	for (i = 0; i < profile->nentries; i++)
+	{
+		const pkgconf_profile_entry_t *entry = sorted[i];
+
+		fprintf(out, "%-24s %8zu %8zu %8zu %10.3f %8zu %9zu %8zu\n", entry->package,
+			entry->counters[PKGCONF_PROFILE_LOOKUPS],
+			entry->counters[PKGCONF_PROFILE_PROBES],
+			entry->counters[PKGCONF_PROFILE_PARSES],
+			entry->parse_ns / 1e6,
+			entry->counters[PKGCONF_PROFILE_VISITS],
+			entry->counters[PKGCONF_PROFILE_FRAGMENTS],
+			entry->counters[PKGCONF_PROFILE_DEDUPLICATED]);
+	}
+
+	free(sorted);
+}
@@ -26,6 +26,13 @@
  * dependency graph prior to working with it.
  *
  * Using the `queue` module functions is the recommended way of working with dependency graphs.
+ *
+ * A dependency graph is resolved on behalf of a `query`, which pairs the client used to look packages up with
+ * the flags the graph is resolved and walked with.  The flags of the client itself only govern how packages
+ * are found and parsed, and provide the defaults for its queries, so a single client can serve queries with
+ * differing flags.  Resolving a query does not modify the client once every package the query reaches is in
+ * its package cache, so such a warm client can serve queries from several threads at once, as long as it is
+ * not prefetching packages or collecting timings, a profile or trace events.
  */
 
 typedef struct {
@@ -33,6 +40,27 @@ typedef struct {
 	char *package;
 } pkgconf_queue_t;
 
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_query_init(pkgconf_query_t *query, pkgconf_client_t *client, unsigned int flags)
+ *
+ *    Initialises a query.  A query holds no resources and can be copied freely; it is only valid as long as
+ *    the client it refers to.  To resolve a query with the flags of the client, pass
+ *    ``pkgconf_client_get_flags(client)``.
+ *
+ *    :param pkgconf_query_t* query: The query object to initialise.
+ *    :param pkgconf_client_t* client: The pkgconf client object to look packages up with.
+ *    :param uint flags: The ``PKGCONF_PKG_PKGF_*`` flags to resolve dependency graphs with.
+ *    :return: nothing
+ */
+void
+pkgconf_query_init(pkgconf_query_t *query, pkgconf_client_t *client, unsigned int flags)
+{
+	query->client = client;
+	query->flags = flags;
+}
+
 /*
  * !doc
  *
@@ -107,23 +135,23 @@ pkgconf_queue_free(pkgconf_list_t *list)
 }
 
 static inline unsigned int
-pkgconf_queue_verify(pkgconf_client_t *client, pkgconf_pkg_t *world, pkgconf_list_t *list, int maxdepth)
+pkgconf_queue_verify(const pkgconf_query_t *query, pkgconf_pkg_t *world, pkgconf_list_t *list, int maxdepth)
 {
-	if (!pkgconf_queue_compile(client, world, list))
+	if (!pkgconf_queue_compile(query->client, world, list))
 		return PKGCONF_PKG_ERRF_DEPGRAPH_BREAK;
 
-	return pkgconf_pkg_verify_graph(client, world, maxdepth);
+	return pkgconf_pkg_verify_graph(query, world, maxdepth);
 }
 
 /*
  * !doc
  *
- * .. c:function:: void pkgconf_queue_apply(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data)
+ * .. c:function:: void pkgconf_queue_apply(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data)
  *
  *    Attempt to compile a dependency resolution queue into a dependency resolution problem, then attempt to solve the problem and
  *    feed the solution to a callback function if a complete dependency graph is found.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
  *    :param pkgconf_list_t* list: The list of dependency requests to consider.
  *    :param pkgconf_queue_apply_func_t func: The callback function to call if a solution is found by the dependency resolver.
  *    :param int maxdepth: The maximum allowed depth for the dependency resolver.  A depth of -1 means unlimited.
@@ -132,7 +160,7 @@ pkgconf_queue_verify(pkgconf_client_t *client, pkgconf_pkg_t *world, pkgconf_lis
  *    :rtype: bool
  */
 bool
-pkgconf_queue_apply(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data)
+pkgconf_queue_apply(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data)
 {
 	pkgconf_pkg_t world = {
 		.id = "virtual:world",
@@ -144,16 +172,20 @@ pkgconf_queue_apply(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_queu
 	if (!maxdepth)
 		maxdepth = -1;
 
-	if (pkgconf_queue_verify(client, &world, list, maxdepth) != PKGCONF_PKG_ERRF_OK)
+	/* the world package is static, so pkgconf_pkg_free() would leave its requires list behind */
+	if (pkgconf_queue_verify(query, &world, list, maxdepth) != PKGCONF_PKG_ERRF_OK)
+	{
+		pkgconf_dependency_free(&world.requires);
 		return false;
+	}
 
-	if (!func(client, &world, data, maxdepth))
+	if (!func(query, &world, data, maxdepth))
 	{
-		pkgconf_pkg_free(client, &world);
+		pkgconf_dependency_free(&world.requires);
 		return false;
 	}
 
-	pkgconf_pkg_free(client, &world);
+	pkgconf_dependency_free(&world.requires);
 
 	return true;
 }
@@ -161,18 +193,51 @@ pkgconf_queue_apply(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_queu
 /*
  * !doc
  *
- * .. c:function:: void pkgconf_queue_validate(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data)
+ * .. c:function:: bool pkgconf_queue_solve(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_pkg_t *world, int maxdepth)
+ *
+ *    Attempt to compile a dependency resolution queue into a dependency resolution problem, then attempt to solve the problem,
+ *    keeping the solution in a caller-provided virtual package.  This allows any number of callbacks to be run against the
+ *    same solution without compiling and solving the queue again for each of them.
+ *
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
+ *    :param pkgconf_list_t* list: The list of dependency requests to consider.
+ *    :param pkgconf_pkg_t* world: The package object to initialise as the root of the dependency graph.  It is always
+ *                                 initialised, and its ``requires`` list must be released with ``pkgconf_dependency_free()``
+ *                                 whether a solution was found or not.
+ *    :param int maxdepth: The maximum allowed depth for the dependency resolver.  A depth of -1 means unlimited.
+ *    :returns: true if the dependency resolver found a solution, otherwise false.
+ *    :rtype: bool
+ */
+bool
+pkgconf_queue_solve(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_pkg_t *world, int maxdepth)
+{
+	memset(world, 0, sizeof *world);
+	world->id = "virtual:world";
+	world->realname = "virtual world package";
+	world->flags = PKGCONF_PKG_PROPF_STATIC | PKGCONF_PKG_PROPF_VIRTUAL;
+
+	/* if maxdepth is one, then we will not traverse deeper than our virtual package. */
+	if (!maxdepth)
+		maxdepth = -1;
+
+	return pkgconf_queue_verify(query, world, list, maxdepth) == PKGCONF_PKG_ERRF_OK;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_queue_validate(const pkgconf_query_t *query, pkgconf_list_t *list, pkgconf_queue_apply_func_t func, int maxdepth, void *data)
  *
  *    Attempt to compile a dependency resolution queue into a dependency resolution problem, then attempt to solve the problem.
  *
- *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param pkgconf_query_t* query: The query to resolve the dependency graph for.
  *    :param pkgconf_list_t* list: The list of dependency requests to consider.
  *    :param int maxdepth: The maximum allowed depth for the dependency resolver.  A depth of -1 means unlimited.
  *    :returns: true if the dependency resolver found a solution, otherwise false.
  *    :rtype: bool
  */
 bool
-pkgconf_queue_validate(pkgconf_client_t *client, pkgconf_list_t *list, int maxdepth)
+pkgconf_queue_validate(const pkgconf_query_t *query, pkgconf_list_t *list, int maxdepth)
 {
 	bool retval = true;
 	pkgconf_pkg_t world = {
@@ -185,10 +250,10 @@ pkgconf_queue_validate(pkgconf_client_t *client, pkgconf_list_t *list, int maxde
 	if (!maxdepth)
 		maxdepth = -1;
 
-	if (pkgconf_queue_verify(client, &world, list, maxdepth) != PKGCONF_PKG_ERRF_OK)
+	if (pkgconf_queue_verify(query, &world, list, maxdepth) != PKGCONF_PKG_ERRF_OK)
 		retval = false;
 
-	pkgconf_pkg_free(client, &world);
+	pkgconf_dependency_free(&world.requires);
 
 	return retval;
 }
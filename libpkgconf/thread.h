@@ -0,0 +1,224 @@
+/*
+ * thread.h
+ * internal locking and atomic reference counting primitives
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#ifndef LIBPKGCONF__THREAD_H
+#define LIBPKGCONF__THREAD_H
+
+#include <libpkgconf/stdinc.h>
+#include <libpkgconf/libpkgconf.h>
+
+/*
+ * This header is private to libpkgconf and is not installed.  It only provides the
+ * handful of primitives needed to share immutable package objects between clients
+ * and clients between queries, and to run the worker threads used for prefetching packages.
+ * It also declares the prefetch hooks called by the resolver, which are not part of the API.
+ */
+
+#if defined(__GNUC__) && !defined(_WIN32)
+# define PKGCONF_INTERNAL __attribute__((visibility("hidden")))
+#else
+# define PKGCONF_INTERNAL
+#endif
+
+#ifdef _WIN32
+typedef SRWLOCK pkgconf_mutex_t;
+
+static inline void
+pkgconf_mutex_init(pkgconf_mutex_t *mutex)
+{
+	InitializeSRWLock(mutex);
+}
+
+static inline void
+pkgconf_mutex_destroy(pkgconf_mutex_t *mutex)
+{
+	(void) mutex;
+}
+
+static inline void
+pkgconf_mutex_lock(pkgconf_mutex_t *mutex)
+{
+	AcquireSRWLockExclusive(mutex);
+}
+
+static inline void
+pkgconf_mutex_unlock(pkgconf_mutex_t *mutex)
+{
+	ReleaseSRWLockExclusive(mutex);
+}
+
+typedef CONDITION_VARIABLE pkgconf_cond_t;
+
+static inline void
+pkgconf_cond_init(pkgconf_cond_t *cond)
+{
+	InitializeConditionVariable(cond);
+}
+
+static inline void
+pkgconf_cond_destroy(pkgconf_cond_t *cond)
+{
+	(void) cond;
+}
+
+static inline void
+pkgconf_cond_wait(pkgconf_cond_t *cond, pkgconf_mutex_t *mutex)
+{
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static inline void
+pkgconf_cond_broadcast(pkgconf_cond_t *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+typedef HANDLE pkgconf_thread_t;
+
+/* thread functions are declared as `static PKGCONF_THREAD_FUNC name(void *arg)` and return 0 */
+#define PKGCONF_THREAD_FUNC	DWORD WINAPI
+
+static inline bool
+pkgconf_thread_create(pkgconf_thread_t *thread, LPTHREAD_START_ROUTINE func, void *arg)
+{
+	*thread = CreateThread(NULL, 0, func, arg, 0, NULL);
+	return *thread != NULL;
+}
+
+static inline void
+pkgconf_thread_join(pkgconf_thread_t thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+#else
+#include <pthread.h>
+
+typedef pthread_mutex_t pkgconf_mutex_t;
+
+static inline void
+pkgconf_mutex_init(pkgconf_mutex_t *mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+static inline void
+pkgconf_mutex_destroy(pkgconf_mutex_t *mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+static inline void
+pkgconf_mutex_lock(pkgconf_mutex_t *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+static inline void
+pkgconf_mutex_unlock(pkgconf_mutex_t *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+typedef pthread_cond_t pkgconf_cond_t;
+
+static inline void
+pkgconf_cond_init(pkgconf_cond_t *cond)
+{
+	pthread_cond_init(cond, NULL);
+}
+
+static inline void
+pkgconf_cond_destroy(pkgconf_cond_t *cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+static inline void
+pkgconf_cond_wait(pkgconf_cond_t *cond, pkgconf_mutex_t *mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+static inline void
+pkgconf_cond_broadcast(pkgconf_cond_t *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+typedef pthread_t pkgconf_thread_t;
+
+/* thread functions are declared as `static PKGCONF_THREAD_FUNC name(void *arg)` and return 0 */
+#define PKGCONF_THREAD_FUNC	void *
+
+static inline bool
+pkgconf_thread_create(pkgconf_thread_t *thread, void *(*func)(void *), void *arg)
+{
+	return pthread_create(thread, NULL, func, arg) == 0;
+}
+
+static inline void
+pkgconf_thread_join(pkgconf_thread_t thread)
+{
+	pthread_join(thread, NULL);
+}
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+static inline int
+pkgconf_atomic_inc(volatile int *value)
+{
+	return __atomic_add_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+static inline int
+pkgconf_atomic_dec(volatile int *value)
+{
+	return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+/* sets a flag, and returns whether it was already set */
+static inline bool
+pkgconf_atomic_test_and_set(volatile int *value)
+{
+	return __atomic_exchange_n(value, 1, __ATOMIC_ACQ_REL) != 0;
+}
+#elif defined(_WIN32)
+static inline int
+pkgconf_atomic_inc(volatile int *value)
+{
+	return InterlockedIncrement((volatile LONG *) value);
+}
+
+static inline int
+pkgconf_atomic_dec(volatile int *value)
+{
+	return InterlockedDecrement((volatile LONG *) value);
+}
+
+static inline bool
+pkgconf_atomic_test_and_set(volatile int *value)
+{
+	return InterlockedExchange((volatile LONG *) value, 1) != 0;
+}
+#else
+# error "no atomic reference counting primitives available for this compiler"
+#endif
+
+/* prefetch.c */
+PKGCONF_INTERNAL void pkgconf_prefetch_submit(pkgconf_client_t *client, const pkgconf_list_t *deplist);
+PKGCONF_INTERNAL void pkgconf_prefetch_wait(pkgconf_client_t *client, const char *name);
+
+#endif
@@ -0,0 +1,437 @@
+/*
+ * timing.c
+ * per-phase timing of package resolution
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#include <libpkgconf/libpkgconf.h>
+#include <time.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `timing` module
+ * ==========================
+ *
+ * The libpkgconf `timing` module measures where the time of a client goes: building the `package
+ * directory list`, looking up packages, parsing `.pc` files, walking dependency graphs and rendering
+ * fragment lists.  Timings are collected once enabled with ``pkgconf_client_set_timings()``; until
+ * then, every instrumented phase only costs a test of the client's ``timings`` field.
+ *
+ * Phases nest, for example a lookup parses the package it finds.  The time of a phase excludes the
+ * time spent in the phases nested inside it, so the phase times add up to the time spent in
+ * libpkgconf.  The time is read from a monotonic clock.
+ *
+ * Library users may time phases of their own with ``pkgconf_timing_begin()`` and
+ * ``pkgconf_timing_end()``, or the ``PKGCONF_TIMING_BEGIN()`` and ``PKGCONF_TIMING_END()`` macros
+ * which skip the calls when timings are not being collected.
+ *
+ * The same phases can be written out as a timeline with ``pkgconf_client_set_trace_events()``, in the
+ * Chrome trace-event JSON format understood by Perfetto and ``chrome://tracing``.  Every phase becomes a
+ * span named after the package it works on, and the default traversal also opens a span for every
+ * package it walks into, so the spans nest along the dependency graph.
+ */
+
+/* nesting deeper than this is charged to the innermost tracked phase */
+#define PKGCONF_TIMING_STACK_DEPTH	32
+
+struct pkgconf_timings_ {
+	/* whether the phase times are being collected, the spans may be written out on their own */
+	bool collect;
+	FILE *events;
+	size_t nevents;
+	uint64_t events_started;
+
+	uint64_t started;
+	uint64_t mark;
+
+	size_t depth;
+	pkgconf_timing_phase_t stack[PKGCONF_TIMING_STACK_DEPTH];
+
+	pkgconf_timing_t phases[PKGCONF_TIMING_PHASE_COUNT];
+};
+
+static const char *pkgconf_timing_phase_names[PKGCONF_TIMING_PHASE_COUNT] = {
+	[PKGCONF_TIMING_PATH_SETUP] = "path setup",
+	[PKGCONF_TIMING_LOOKUP] = "lookup",
+	[PKGCONF_TIMING_PARSE] = "parse",
+	[PKGCONF_TIMING_TRAVERSE] = "traversal",
+	[PKGCONF_TIMING_RENDER] = "rendering",
+};
+
+/*
+ * !doc
+ *
+ * .. c:function:: uint64_t pkgconf_timing_now(void)
+ *
+ *    Reads the monotonic clock used for timings.
+ *
+ *    :return: the current time in nanoseconds, relative to an unspecified starting point
+ *    :rtype: uint64_t
+ */
+uint64_t
+pkgconf_timing_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000000 +
+		(uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * pkgconf_timings_get(client)
+ *
+ * return the timing state of a client, allocating it if neither timings nor trace events were enabled.
+ */
+static pkgconf_timings_t *
+pkgconf_timings_get(pkgconf_client_t *client)
+{
+	if (client->timings == NULL)
+	{
+		client->timings = calloc(sizeof(pkgconf_timings_t), 1);
+		client->timings->started = client->timings->mark = pkgconf_timing_now();
+	}
+
+	return client->timings;
+}
+
+static void
+pkgconf_timings_release(pkgconf_client_t *client)
+{
+	if (client->timings->collect || client->timings->events != NULL)
+		return;
+
+	free(client->timings);
+	client->timings = NULL;
+}
+
+static void
+pkgconf_timing_write_string(FILE *out, const char *str)
+{
+	putc('"', out);
+
+	for (; *str; str++)
+	{
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			putc(c, out);
+	}
+
+	putc('"', out);
+}
+
+/*
+ * pkgconf_timing_write_event(timings, ph, now, phase, subject)
+ *
+ * append one event to the JSON array of trace events.  the array is opened by the first event.
+ */
+static void
+pkgconf_timing_write_event(pkgconf_timings_t *timings, char ph, uint64_t now, pkgconf_timing_phase_t phase, const char *subject)
+{
+	FILE *out = timings->events;
+
+	fputs(timings->nevents++ ? ",\n" : "[\n", out);
+	fprintf(out, "{\"ph\":\"%c\",\"pid\":1,\"tid\":1,\"ts\":%.3f", ph, (now - timings->events_started) / 1e3);
+
+	if (ph == 'B')
+	{
+		fputs(",\"cat\":", out);
+		pkgconf_timing_write_string(out, pkgconf_timing_phase_names[phase]);
+		fputs(",\"name\":", out);
+		pkgconf_timing_write_string(out, subject != NULL ? subject : pkgconf_timing_phase_names[phase]);
+		fprintf(out, ",\"args\":{\"depth\":%zu", timings->depth);
+
+		if (subject != NULL)
+		{
+			fputs(phase == PKGCONF_TIMING_PARSE ? ",\"file\":" : ",\"package\":", out);
+			pkgconf_timing_write_string(out, subject);
+		}
+
+		putc('}', out);
+	}
+
+	putc('}', out);
+}
+
+/*
+ * pkgconf_timing_charge(timings, now)
+ *
+ * charge the time since the last mark to the innermost running phase.
+ */
+static void
+pkgconf_timing_charge(pkgconf_timings_t *timings, uint64_t now)
+{
+	if (timings->depth > 0)
+	{
+		size_t top = timings->depth < PKGCONF_TIMING_STACK_DEPTH ? timings->depth : PKGCONF_TIMING_STACK_DEPTH;
+
+		timings->phases[timings->stack[top - 1]].elapsed_ns += now - timings->mark;
+	}
+
+	timings->mark = now;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_timings(pkgconf_client_t *client, bool enabled)
+ *
+ *    Starts or stops collecting timings for a client.  Starting discards the timings collected before.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param bool enabled: Whether timings should be collected.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_timings(pkgconf_client_t *client, bool enabled)
+{
+	pkgconf_timings_t *timings;
+
+	if (!enabled)
+	{
+		if (client->timings != NULL)
+		{
+			client->timings->collect = false;
+			pkgconf_timings_release(client);
+		}
+
+		return;
+	}
+
+	timings = pkgconf_timings_get(client);
+	timings->collect = true;
+	timings->started = pkgconf_timing_now();
+	memset(timings->phases, 0, sizeof timings->phases);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_trace_events(pkgconf_client_t *client, FILE *out)
+ *
+ *    Starts writing the phases of a client to a stream as Chrome trace events, or stops writing them if `out`
+ *    is ``NULL``.  Stopping terminates the JSON array of events; the stream itself is left open.  If the
+ *    client is never stopped, the array is left unterminated, which trace viewers accept.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param FILE* out: The stream to write the trace events to, or ``NULL``.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_trace_events(pkgconf_client_t *client, FILE *out)
+{
+	pkgconf_timings_t *timings;
+
+	if (client->timings != NULL && client->timings->events != NULL)
+	{
+		fputs(client->timings->nevents ? "\n]\n" : "[]\n", client->timings->events);
+		client->timings->events = NULL;
+	}
+
+	if (out == NULL)
+	{
+		if (client->timings != NULL)
+			pkgconf_timings_release(client);
+
+		return;
+	}
+
+	timings = pkgconf_timings_get(client);
+	timings->events = out;
+	timings->nevents = 0;
+	timings->events_started = pkgconf_timing_now();
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: bool pkgconf_client_get_timing(const pkgconf_client_t *client, pkgconf_timing_phase_t phase, pkgconf_timing_t *timing)
+ *
+ *    Retrieves the time spent in a phase, excluding the phases nested inside it, and the number of times
+ *    the phase was entered.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :param pkgconf_timing_phase_t phase: The phase to look up.
+ *    :param pkgconf_timing_t* timing: The structure to fill in.
+ *    :return: true if timings are being collected for the client, else false.
+ *    :rtype: bool
+ */
+bool
+pkgconf_client_get_timing(const pkgconf_client_t *client, pkgconf_timing_phase_t phase, pkgconf_timing_t *timing)
+{
+	if (client->timings == NULL || !client->timings->collect || (unsigned int) phase >= PKGCONF_TIMING_PHASE_COUNT)
+		return false;
+
+	*timing = client->timings->phases[phase];
+	return true;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: uint64_t pkgconf_client_get_timings_total(const pkgconf_client_t *client)
+ *
+ *    Retrieves the time elapsed since timings were enabled for a client, in nanoseconds.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :return: the elapsed time, or 0 if timings are not being collected
+ *    :rtype: uint64_t
+ */
+uint64_t
+pkgconf_client_get_timings_total(const pkgconf_client_t *client)
+{
+	if (client->timings == NULL || !client->timings->collect)
+		return 0;
+
+	return pkgconf_timing_now() - client->timings->started;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: const char *pkgconf_timing_phase_name(pkgconf_timing_phase_t phase)
+ *
+ *    Retrieves a human-readable name for a phase.
+ *
+ *    :param pkgconf_timing_phase_t phase: The phase to name.
+ *    :return: the name of the phase, or ``NULL`` for an unknown phase
+ *    :rtype: const char *
+ */
+const char *
+pkgconf_timing_phase_name(pkgconf_timing_phase_t phase)
+{
+	if ((unsigned int) phase >= PKGCONF_TIMING_PHASE_COUNT)
+		return NULL;
+
+	return pkgconf_timing_phase_names[phase];
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_timing_begin(const pkgconf_client_t *client, pkgconf_timing_phase_t phase, const char *subject)
+ *
+ *    Enters a phase.  The phase which was running is paused until the matching ``pkgconf_timing_end()``.
+ *
+ *    :param pkgconf_client_t* client: The client object to charge the time to.
+ *    :param pkgconf_timing_phase_t phase: The phase being entered.
+ *    :param char* subject: The package or file the phase works on, used to name its trace event, or ``NULL``.
+ *    :return: nothing
+ */
+void
+pkgconf_timing_begin(const pkgconf_client_t *client, pkgconf_timing_phase_t phase, const char *subject)
+{
+	pkgconf_timings_t *timings = client->timings;
+	uint64_t now;
+
+	if (timings == NULL || (unsigned int) phase >= PKGCONF_TIMING_PHASE_COUNT)
+		return;
+
+	now = pkgconf_timing_now();
+	pkgconf_timing_charge(timings, now);
+
+	if (timings->events != NULL)
+		pkgconf_timing_write_event(timings, 'B', now, phase, subject);
+
+	if (timings->depth < PKGCONF_TIMING_STACK_DEPTH)
+		timings->stack[timings->depth] = phase;
+
+	timings->depth++;
+	timings->phases[phase].count++;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_timing_end(const pkgconf_client_t *client, pkgconf_timing_phase_t phase)
+ *
+ *    Leaves a phase entered with ``pkgconf_timing_begin()``, resuming the phase which was running before.
+ *
+ *    :param pkgconf_client_t* client: The client object to charge the time to.
+ *    :param pkgconf_timing_phase_t phase: The phase being left.
+ *    :return: nothing
+ */
+void
+pkgconf_timing_end(const pkgconf_client_t *client, pkgconf_timing_phase_t phase)
+{
+	pkgconf_timings_t *timings = client->timings;
+
+	uint64_t now;
+
+	if (timings == NULL || (unsigned int) phase >= PKGCONF_TIMING_PHASE_COUNT || timings->depth == 0)
+		return;
+
+	now = pkgconf_timing_now();
+	pkgconf_timing_charge(timings, now);
+	timings->depth--;
+
+	if (timings->events != NULL)
+		pkgconf_timing_write_event(timings, 'E', now, phase, NULL);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_dump_timings(const pkgconf_client_t *client, FILE *out)
+ *
+ *    Writes a table of the time spent in each phase to a stream.  The time spent outside of any phase is
+ *    listed as `other`.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :param FILE* out: The stream to write the table to.
+ *    :return: nothing
+ */
+void
+pkgconf_client_dump_timings(const pkgconf_client_t *client, FILE *out)
+{
+	const pkgconf_timings_t *timings = client->timings;
+	uint64_t total, phases = 0;
+	size_t i;
+
+	if (timings == NULL || !timings->collect)
+		return;
+
+	total = pkgconf_client_get_timings_total(client);
+
+	fprintf(out, "%-12s %10s %12s %7s\n", "phase", "calls", "time (ms)", "share");
+
+	for (i = 0; i < PKGCONF_TIMING_PHASE_COUNT; i++)
+	{
+		const pkgconf_timing_t *timing = &timings->phases[i];
+
+		fprintf(out, "%-12s %10zu %12.3f %6.1f%%\n", pkgconf_timing_phase_names[i], timing->count,
+			timing->elapsed_ns / 1e6, total ? timing->elapsed_ns * 100.0 / total : 0.0);
+
+		phases += timing->elapsed_ns;
+	}
+
+	/* phases which are still running have not been charged yet, so this can not go below zero */
+	fprintf(out, "%-12s %10s %12.3f %6.1f%%\n", "other", "", (total - phases) / 1e6,
+		total ? (total - phases) * 100.0 / total : 0.0);
+	fprintf(out, "%-12s %10s %12.3f\n", "total", "", total / 1e6);
+}
@@ -0,0 +1,561 @@
+/*
+ * trace.c
+ * trace message filtering and recording
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#include <libpkgconf/libpkgconf.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `trace` module
+ * =========================
+ *
+ * The libpkgconf `trace` module delivers the trace messages emitted with ``PKGCONF_TRACE()`` and
+ * ``PKGCONF_TRACE_VERBOSE()``.  Every message belongs to a `subsystem`, such as the package cache or the
+ * `.pc` file parser, and has a level: ``PKGCONF_TRACE_LEVEL_INFO`` for messages describing the progress of
+ * an operation, or ``PKGCONF_TRACE_LEVEL_VERBOSE`` for messages emitted from inner loops.
+ *
+ * The trace macros check whether a message would be delivered before evaluating any of its arguments, so
+ * a disabled message costs a test of two client fields.  Messages are delivered when a trace handler or a
+ * trace buffer is installed on the client, and the level of the message's subsystem is high enough.
+ * All subsystems start at ``PKGCONF_TRACE_LEVEL_VERBOSE``.
+ *
+ * A trace buffer keeps the most recent messages in memory without formatting them: only the message
+ * arguments are recorded, and the messages are formatted when the buffer is dumped.  The format string,
+ * file name and function name of a message must therefore stay valid, which is the case for the string
+ * literals passed by the trace macros.
+ *
+ * Defining ``PKGCONF_DISABLE_TRACE`` when building libpkgconf compiles all trace messages out.
+ */
+
+/* arguments and bytes of string arguments kept per recorded message, the rest is cut off */
+#define PKGCONF_TRACE_RECORD_ARGS	8
+#define PKGCONF_TRACE_RECORD_STRINGS	192
+
+typedef enum {
+	PKGCONF_TRACE_LENGTH_NONE,
+	PKGCONF_TRACE_LENGTH_HH,
+	PKGCONF_TRACE_LENGTH_H,
+	PKGCONF_TRACE_LENGTH_L,
+	PKGCONF_TRACE_LENGTH_LL,
+	PKGCONF_TRACE_LENGTH_Z,
+	PKGCONF_TRACE_LENGTH_J,
+	PKGCONF_TRACE_LENGTH_T,
+	PKGCONF_TRACE_LENGTH_BIG_L,
+} pkgconf_trace_length_t;
+
+typedef union {
+	intmax_t i;
+	uintmax_t u;
+	const void *p;
+	double d;
+	size_t str;
+} pkgconf_trace_arg_t;
+
+typedef struct {
+	const char *filename;
+	const char *funcname;
+	const char *format;
+	size_t lineno;
+
+	size_t nargs;
+	bool truncated;
+	pkgconf_trace_arg_t args[PKGCONF_TRACE_RECORD_ARGS];
+
+	size_t strings_len;
+	char strings[PKGCONF_TRACE_RECORD_STRINGS];
+} pkgconf_trace_record_t;
+
+struct pkgconf_trace_buffer_ {
+	size_t head;
+	size_t count;
+	size_t size;
+
+	pkgconf_trace_record_t records[];
+};
+
+/*
+ * pkgconf_trace_parse_conversion(p, length, conv)
+ *
+ * parse a printf conversion specification, p points just past the '%'.  returns a pointer to the
+ * conversion character, or NULL if the specification is not supported.
+ */
+static const char *
+pkgconf_trace_parse_conversion(const char *p, const char **length)
+{
+	while (*p && strchr("-+ #0", *p) != NULL)
+		p++;
+
+	while (isdigit((unsigned int)*p))
+		p++;
+
+	if (*p == '.')
+	{
+		p++;
+		while (isdigit((unsigned int)*p))
+			p++;
+	}
+
+	if (*p == '*')
+		return NULL;
+
+	*length = p;
+
+	while (*p && strchr("hlzjtL", *p) != NULL)
+		p++;
+
+	return *p ? p : NULL;
+}
+
+static pkgconf_trace_length_t
+pkgconf_trace_length(const char *length, const char *conv)
+{
+	switch (conv - length)
+	{
+	case 0:
+		return PKGCONF_TRACE_LENGTH_NONE;
+	case 1:
+		switch (*length)
+		{
+		case 'h':
+			return PKGCONF_TRACE_LENGTH_H;
+		case 'l':
+			return PKGCONF_TRACE_LENGTH_L;
+		case 'z':
+			return PKGCONF_TRACE_LENGTH_Z;
+		case 'j':
+			return PKGCONF_TRACE_LENGTH_J;
+		case 't':
+			return PKGCONF_TRACE_LENGTH_T;
+		default:
+			return PKGCONF_TRACE_LENGTH_BIG_L;
+		}
+	default:
+		return *length == 'h' ? PKGCONF_TRACE_LENGTH_HH : PKGCONF_TRACE_LENGTH_LL;
+	}
+}
+
+static void
+pkgconf_trace_record(pkgconf_trace_record_t *record, const char *filename, size_t lineno, const char *funcname, const char *format, va_list va)
+{
+	const char *p;
+
+	record->filename = filename;
+	record->lineno = lineno;
+	record->funcname = funcname;
+	record->format = format;
+	record->nargs = 0;
+	record->truncated = false;
+	record->strings_len = 0;
+
+	for (p = format; *p; p++)
+	{
+		pkgconf_trace_arg_t *arg = &record->args[record->nargs];
+		const char *length = NULL, *conv;
+		pkgconf_trace_length_t lenmod;
+
+		if (*p != '%')
+			continue;
+
+		if (*++p == '%')
+			continue;
+
+		conv = pkgconf_trace_parse_conversion(p, &length);
+		if (conv == NULL || record->nargs == PKGCONF_TRACE_RECORD_ARGS)
+		{
+			record->truncated = true;
+			return;
+		}
+
+		lenmod = pkgconf_trace_length(length, conv);
+
+		switch (*conv)
+		{
+		case 'd':
+		case 'i':
+			switch (lenmod)
+			{
+			case PKGCONF_TRACE_LENGTH_L:
+				arg->i = va_arg(va, long);
+				break;
+			case PKGCONF_TRACE_LENGTH_LL:
+				arg->i = va_arg(va, long long);
+				break;
+			case PKGCONF_TRACE_LENGTH_Z:
+				arg->i = va_arg(va, ssize_t);
+				break;
+			case PKGCONF_TRACE_LENGTH_J:
+				arg->i = va_arg(va, intmax_t);
+				break;
+			case PKGCONF_TRACE_LENGTH_T:
+				arg->i = va_arg(va, ptrdiff_t);
+				break;
+			default:
+				arg->i = va_arg(va, int);
+				break;
+			}
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			switch (lenmod)
+			{
+			case PKGCONF_TRACE_LENGTH_L:
+				arg->u = va_arg(va, unsigned long);
+				break;
+			case PKGCONF_TRACE_LENGTH_LL:
+				arg->u = va_arg(va, unsigned long long);
+				break;
+			case PKGCONF_TRACE_LENGTH_Z:
+				arg->u = va_arg(va, size_t);
+				break;
+			case PKGCONF_TRACE_LENGTH_J:
+				arg->u = va_arg(va, uintmax_t);
+				break;
+			case PKGCONF_TRACE_LENGTH_T:
+				arg->u = (uintmax_t) va_arg(va, ptrdiff_t);
+				break;
+			default:
+				arg->u = va_arg(va, unsigned int);
+				break;
+			}
+			break;
+		case 'c':
+			arg->i = va_arg(va, int);
+			break;
+		case 'p':
+			arg->p = va_arg(va, void *);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+			if (lenmod == PKGCONF_TRACE_LENGTH_BIG_L)
+				arg->d = (double) va_arg(va, long double);
+			else
+				arg->d = va_arg(va, double);
+			break;
+		case 's':
+			{
+				const char *str = va_arg(va, const char *);
+
+				if (str == NULL)
+					str = "(null)";
+
+				/* the string area is full, there is not even room for an empty string */
+				if (record->strings_len == sizeof(record->strings))
+				{
+					record->truncated = true;
+					return;
+				}
+
+				arg->str = record->strings_len;
+				record->strings_len += pkgconf_strlcpy(record->strings + record->strings_len, str,
+					sizeof(record->strings) - record->strings_len);
+
+				if (record->strings_len >= sizeof(record->strings))
+				{
+					record->strings_len = sizeof(record->strings) - 1;
+					record->truncated = true;
+				}
+
+				record->strings_len++;
+			}
+			break;
+		default:
+			record->truncated = true;
+			return;
+		}
+
+		record->nargs++;
+		p = conv;
+	}
+}
+
+/*
+ * pkgconf_trace_print_arg(out, spec, ...)
+ *
+ * print one recorded argument using a conversion specification rebuilt from the message format.
+ */
+static void
+pkgconf_trace_print_arg(FILE *out, const char *spec, ...)
+{
+	va_list va;
+
+	va_start(va, spec);
+	vfprintf(out, spec, va);
+	va_end(va);
+}
+
+static void
+pkgconf_trace_record_print(const pkgconf_trace_record_t *record, FILE *out)
+{
+	const char *p, *text;
+	size_t argn = 0;
+
+	fprintf(out, "%s:%zu [%s]: ", record->filename, record->lineno, record->funcname);
+
+	for (p = text = record->format; *p; p++)
+	{
+		const pkgconf_trace_arg_t *arg;
+		const char *length = NULL, *conv;
+		char spec[64];
+		size_t speclen;
+
+		if (*p != '%')
+			continue;
+
+		fwrite(text, 1, p - text, out);
+
+		if (p[1] == '%')
+		{
+			putc('%', out);
+			text = ++p + 1;
+			continue;
+		}
+
+		conv = pkgconf_trace_parse_conversion(p + 1, &length);
+		if (conv == NULL || argn == record->nargs || (size_t)(length - p) + 3 > sizeof spec)
+		{
+			text = p + strlen(p);
+			break;
+		}
+
+		arg = &record->args[argn++];
+
+		/* rebuild the specification with the length modifier matching the recorded argument */
+		speclen = length - p;
+		memcpy(spec, p, speclen);
+
+		switch (*conv)
+		{
+		case 'd':
+		case 'i':
+			spec[speclen++] = 'j';
+			spec[speclen++] = *conv;
+			spec[speclen] = '\0';
+			pkgconf_trace_print_arg(out, spec, arg->i);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			spec[speclen++] = 'j';
+			spec[speclen++] = *conv;
+			spec[speclen] = '\0';
+			pkgconf_trace_print_arg(out, spec, arg->u);
+			break;
+		case 'c':
+			spec[speclen++] = 'c';
+			spec[speclen] = '\0';
+			pkgconf_trace_print_arg(out, spec, (int) arg->i);
+			break;
+		case 'p':
+			spec[speclen++] = 'p';
+			spec[speclen] = '\0';
+			pkgconf_trace_print_arg(out, spec, arg->p);
+			break;
+		case 's':
+			spec[speclen++] = 's';
+			spec[speclen] = '\0';
+			pkgconf_trace_print_arg(out, spec, record->strings + arg->str);
+			break;
+		default:
+			spec[speclen++] = *conv;
+			spec[speclen] = '\0';
+			pkgconf_trace_print_arg(out, spec, arg->d);
+			break;
+		}
+
+		text = conv + 1;
+		p = conv;
+	}
+
+	fputs(text, out);
+
+	/* the loop stops early at the first argument which was not recorded */
+	if (record->truncated || *p != '\0')
+		fputs("...", out);
+
+	putc('\n', out);
+}
+
+static void
+pkgconf_trace_update_active(pkgconf_client_t *client)
+{
+	client->trace_active = client->trace_buffer != NULL ||
+		(client->trace_handler != NULL && client->trace_handler != pkgconf_default_error_handler);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: bool pkgconf_trace(const pkgconf_client_t *client, const char *filename, size_t len, const char *funcname, const char *format, ...)
+ *
+ *    Report a message to a client-registered trace handler, and record it in the client's trace buffer if one is
+ *    installed.  This function is normally called through the ``PKGCONF_TRACE()`` macros, which skip it for
+ *    messages which are filtered out.
+ *
+ *    :param pkgconf_client_t* client: The pkgconf client object to report the trace message to.
+ *    :param char* filename: The file the function is in.
+ *    :param size_t lineno: The line number currently being executed.
+ *    :param char* funcname: The function name to use.
+ *    :param char* format: A printf-style format string to use for formatting the trace message.
+ *    :return: true if the trace handler processed the message, else false.
+ *    :rtype: bool
+ */
+bool
+pkgconf_trace(const pkgconf_client_t *client, const char *filename, size_t lineno, const char *funcname, const char *format, ...)
+{
+	char errbuf[PKGCONF_BUFSIZE];
+	size_t len;
+	va_list va;
+
+	if (client->trace_buffer != NULL)
+	{
+		pkgconf_trace_buffer_t *buffer = client->trace_buffer;
+
+		va_start(va, format);
+		pkgconf_trace_record(&buffer->records[buffer->head], filename, lineno, funcname, format, va);
+		va_end(va);
+
+		buffer->head = (buffer->head + 1) % buffer->size;
+		if (buffer->count < buffer->size)
+			buffer->count++;
+	}
+
+	if (client->trace_handler == pkgconf_default_error_handler)
+		return true;
+
+	len = snprintf(errbuf, sizeof errbuf, "%s:%zu [%s]: ", filename, lineno, funcname);
+
+	va_start(va, format);
+	vsnprintf(errbuf + len, sizeof(errbuf) - len, format, va);
+	va_end(va);
+
+	pkgconf_strlcat(errbuf, "\n", sizeof errbuf);
+
+	return client->trace_handler(errbuf, client, client->trace_handler_data);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_trace_level(pkgconf_client_t *client, pkgconf_trace_subsystem_t subsystem, unsigned int level)
+ *
+ *    Sets the level of the trace messages delivered for a subsystem.  Messages of a higher level are dropped
+ *    without being formatted.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param pkgconf_trace_subsystem_t subsystem: The subsystem to set the level for.
+ *    :param uint level: One of ``PKGCONF_TRACE_LEVEL_NONE``, ``PKGCONF_TRACE_LEVEL_INFO`` or ``PKGCONF_TRACE_LEVEL_VERBOSE``.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_trace_level(pkgconf_client_t *client, pkgconf_trace_subsystem_t subsystem, unsigned int level)
+{
+	unsigned int l;
+
+	if ((unsigned int) subsystem >= PKGCONF_TRACE_SUBSYSTEM_COUNT)
+		return;
+
+	for (l = PKGCONF_TRACE_LEVEL_INFO; l <= PKGCONF_TRACE_LEVEL_VERBOSE; l++)
+	{
+		if (l > level)
+			client->trace_filter |= PKGCONF_TRACE_FILTER_BIT(subsystem, l);
+		else
+			client->trace_filter &= ~PKGCONF_TRACE_FILTER_BIT(subsystem, l);
+	}
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: unsigned int pkgconf_client_get_trace_level(const pkgconf_client_t *client, pkgconf_trace_subsystem_t subsystem)
+ *
+ *    Retrieves the level of the trace messages delivered for a subsystem.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :param pkgconf_trace_subsystem_t subsystem: The subsystem to look up.
+ *    :return: the highest level of trace messages delivered for the subsystem
+ *    :rtype: unsigned int
+ */
+unsigned int
+pkgconf_client_get_trace_level(const pkgconf_client_t *client, pkgconf_trace_subsystem_t subsystem)
+{
+	unsigned int level = PKGCONF_TRACE_LEVEL_NONE;
+
+	if ((unsigned int) subsystem >= PKGCONF_TRACE_SUBSYSTEM_COUNT)
+		return level;
+
+	while (level < PKGCONF_TRACE_LEVEL_VERBOSE && !(client->trace_filter & PKGCONF_TRACE_FILTER_BIT(subsystem, level + 1)))
+		level++;
+
+	return level;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_set_trace_buffer(pkgconf_client_t *client, size_t nrecords)
+ *
+ *    Installs a trace buffer keeping the last `nrecords` trace messages, or removes the trace buffer if `nrecords`
+ *    is zero.  Any previously recorded messages are discarded.
+ *
+ *    :param pkgconf_client_t* client: The client object to modify.
+ *    :param size_t nrecords: The number of messages to keep.
+ *    :return: nothing
+ */
+void
+pkgconf_client_set_trace_buffer(pkgconf_client_t *client, size_t nrecords)
+{
+	free(client->trace_buffer);
+	client->trace_buffer = NULL;
+
+	if (nrecords != 0)
+	{
+		client->trace_buffer = calloc(sizeof(pkgconf_trace_buffer_t) + nrecords * sizeof(pkgconf_trace_record_t), 1);
+		client->trace_buffer->size = nrecords;
+	}
+
+	pkgconf_trace_update_active(client);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_client_dump_trace_buffer(const pkgconf_client_t *client, FILE *out)
+ *
+ *    Formats the messages held in the client's trace buffer, oldest first, and writes them to a stream.
+ *    Arguments which did not fit into a recorded message are replaced with ``...``.
+ *
+ *    :param pkgconf_client_t* client: The client object to access.
+ *    :param FILE* out: The stream to write the messages to.
+ *    :return: nothing
+ */
+void
+pkgconf_client_dump_trace_buffer(const pkgconf_client_t *client, FILE *out)
+{
+	const pkgconf_trace_buffer_t *buffer = client->trace_buffer;
+	size_t i;
+
+	if (buffer == NULL)
+		return;
+
+	for (i = 0; i < buffer->count; i++)
+		pkgconf_trace_record_print(&buffer->records[(buffer->head + buffer->size - buffer->count + i) % buffer->size], out);
+}
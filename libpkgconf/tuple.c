@@ -44,7 +44,14 @@
 void
 pkgconf_tuple_add_global(pkgconf_client_t *client, const char *key, const char *value)
 {
-	pkgconf_tuple_add(client, &client->global_vars, key, value, false);
+	pkgconf_tuple_t *tuple = pkgconf_tuple_add(client, &client->global_vars, key, value, false);
+
+	/* fragment munging needs $(pc_sysrootdir) for every fragment, keep it at hand */
+	if (!strcmp(key, "pc_sysrootdir"))
+	{
+		client->sysroot_var = tuple->value;
+		client->sysroot_var_len = strlen(tuple->value);
+	}
 }
 
 /*
@@ -89,6 +96,9 @@ void
 pkgconf_tuple_free_global(pkgconf_client_t *client)
 {
 	pkgconf_tuple_free(&client->global_vars);
+
+	client->sysroot_var = NULL;
+	client->sysroot_var_len = 0;
 }
 
 /*
@@ -230,7 +240,7 @@ pkgconf_tuple_parse(const pkgconf_client_t *client, pkgconf_list_t *vars, const
 			*bptr++ = *ptr;
 		else if (*(ptr + 1) == '{')
 		{
-			static char varname[PKGCONF_BUFSIZE];
+			char varname[PKGCONF_BUFSIZE];
 			char *vptr = varname;
 			const char *pptr;
 			char *kv, *parsekv;
@@ -0,0 +1,467 @@
+/*
+ * watch.c
+ * incremental re-resolution of long-lived queries
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#define PKGCONF_TRACE_SUBSYSTEM PKGCONF_TRACE_GRAPH
+
+#include <libpkgconf/libpkgconf.h>
+
+/*
+ * !doc
+ *
+ * libpkgconf `watch` module
+ * =========================
+ *
+ * The `watch` module keeps the results of a set of queries up to date for a long-lived client, such as
+ * a build system recomputing the flags of many targets while `.pc` files are being edited.
+ *
+ * Each query resolves a list of packages into a dependency graph, and its ``CFLAGS`` and ``LIBS`` are
+ * computed from that graph when first asked for.  While a graph is built, the watch records a reverse
+ * edge from every name the query depends on to the query: the packages of the graph as well as every
+ * name they require, including names which could not be found.  When a package is invalidated, only the
+ * queries reachable through its reverse edges are dropped, and the package is evicted from the client
+ * cache and package pool.  Re-resolving them parses the changed package again, while every other package
+ * is still found in the client cache.
+ *
+ * Results are also recomputed if the client flags differ from the ones they were computed with.  A package
+ * which starts to provide a name through a ``Provides`` entry is not tracked; invalidate the provided name
+ * as well in that case.
+ */
+
+typedef struct {
+	pkgconf_node_t iter;
+
+	char *name;
+	pkgconf_list_t links;
+} pkgconf_watch_entry_t;
+
+typedef struct {
+	pkgconf_node_t entry_iter;
+	pkgconf_node_t query_iter;
+
+	pkgconf_watch_entry_t *entry;
+	pkgconf_watch_query_t *query;
+} pkgconf_watch_link_t;
+
+typedef struct {
+	pkgconf_list_t fragments;
+	unsigned int eflags;
+	bool valid;
+} pkgconf_watch_result_t;
+
+struct pkgconf_watch_query_ {
+	pkgconf_node_t iter;
+
+	pkgconf_watch_t *watch;
+	pkgconf_list_t queue;
+
+	pkgconf_graph_t *graph;
+	unsigned int flags;
+	pkgconf_list_t links;
+
+	pkgconf_watch_result_t cflags;
+	pkgconf_watch_result_t libs;
+};
+
+struct pkgconf_watch_ {
+	pkgconf_client_t *client;
+	int maxdepth;
+
+	pkgconf_list_t queries;
+
+	/* reverse edges: package name -> entry listing the queries depending on that name */
+	pkgconf_hash_t index;
+	pkgconf_list_t entries;
+};
+
+static void
+pkgconf_watch_link(pkgconf_watch_query_t *query, const char *name)
+{
+	pkgconf_watch_t *watch = query->watch;
+	pkgconf_watch_entry_t *entry;
+	pkgconf_watch_link_t *link;
+
+	entry = pkgconf_hash_lookup(&watch->index, name);
+	if (entry == NULL)
+	{
+		entry = calloc(sizeof(pkgconf_watch_entry_t), 1);
+		entry->name = strdup(name);
+
+		pkgconf_node_insert_tail(&entry->iter, entry, &watch->entries);
+		pkgconf_hash_insert(&watch->index, entry->name, entry);
+	}
+
+	/* the edges of a query are all added at once, so an existing edge from this query is the last one */
+	if (entry->links.tail != NULL && ((pkgconf_watch_link_t *) entry->links.tail->data)->query == query)
+		return;
+
+	link = calloc(sizeof(pkgconf_watch_link_t), 1);
+	link->entry = entry;
+	link->query = query;
+
+	pkgconf_node_insert_tail(&link->entry_iter, link, &entry->links);
+	pkgconf_node_insert_tail(&link->query_iter, link, &query->links);
+}
+
+static void
+pkgconf_watch_link_list(pkgconf_watch_query_t *query, const pkgconf_list_t *deplist)
+{
+	pkgconf_node_t *node;
+
+	PKGCONF_FOREACH_LIST_ENTRY(deplist->head, node)
+	{
+		const pkgconf_dependency_t *dep = node->data;
+
+		if (*dep->package != '\0')
+			pkgconf_watch_link(query, dep->package);
+	}
+}
+
+static bool
+pkgconf_watch_link_pkg(const pkgconf_pkg_t *pkg, void *data)
+{
+	pkgconf_watch_query_t *query = data;
+
+	if (!(pkg->flags & PKGCONF_PKG_PROPF_VIRTUAL) && pkg->id != NULL)
+		pkgconf_watch_link(query, pkg->id);
+
+	pkgconf_watch_link_list(query, &pkg->requires);
+	pkgconf_watch_link_list(query, &pkg->requires_private);
+
+	return false;
+}
+
+static void
+pkgconf_watch_result_reset(pkgconf_watch_result_t *result)
+{
+	pkgconf_fragment_free(&result->fragments);
+
+	result->eflags = PKGCONF_PKG_ERRF_OK;
+	result->valid = false;
+}
+
+/*
+ * pkgconf_watch_query_reset(query)
+ *
+ * drop the graph and results of a query, along with its reverse edges, which are
+ * recorded again when the query is resolved the next time.
+ */
+static void
+pkgconf_watch_query_reset(pkgconf_watch_query_t *query)
+{
+	pkgconf_node_t *iter, *iter2;
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(query->links.head, iter2, iter)
+	{
+		pkgconf_watch_link_t *link = iter->data;
+
+		pkgconf_node_delete(&link->entry_iter, &link->entry->links);
+		free(link);
+	}
+
+	memset(&query->links, 0, sizeof query->links);
+
+	pkgconf_watch_result_reset(&query->cflags);
+	pkgconf_watch_result_reset(&query->libs);
+
+	pkgconf_graph_free(query->graph);
+	query->graph = NULL;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_watch_t *pkgconf_watch_new(pkgconf_client_t *client, int maxdepth)
+ *
+ *    Creates an empty set of queries resolved by a client.  The client must outlive the watch.
+ *
+ *    :param pkgconf_client_t* client: The pkgconf client object to use for dependency resolution.
+ *    :param int maxdepth: The maximum depth to resolve the queries to.  -1 means infinite recursion.
+ *    :return: A watch object.
+ *    :rtype: pkgconf_watch_t *
+ */
+pkgconf_watch_t *
+pkgconf_watch_new(pkgconf_client_t *client, int maxdepth)
+{
+	pkgconf_watch_t *watch = calloc(sizeof(pkgconf_watch_t), 1);
+
+	watch->client = client;
+	watch->maxdepth = maxdepth;
+
+	pkgconf_hash_init(&watch->index, pkgconf_hash_str, pkgconf_hash_str_equal);
+
+	return watch;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_watch_free(pkgconf_watch_t *watch)
+ *
+ *    Releases a watch object along with all of its queries.
+ *
+ *    :param pkgconf_watch_t* watch: The watch object to release.
+ *    :return: nothing
+ */
+void
+pkgconf_watch_free(pkgconf_watch_t *watch)
+{
+	pkgconf_node_t *iter, *iter2;
+
+	if (watch == NULL)
+		return;
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(watch->queries.head, iter2, iter)
+		pkgconf_watch_remove(watch, iter->data);
+
+	PKGCONF_FOREACH_LIST_ENTRY_SAFE(watch->entries.head, iter2, iter)
+	{
+		pkgconf_watch_entry_t *entry = iter->data;
+
+		free(entry->name);
+		free(entry);
+	}
+
+	pkgconf_hash_deinit(&watch->index);
+	free(watch);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_watch_query_t *pkgconf_watch_add(pkgconf_watch_t *watch, const char *packages)
+ *
+ *    Adds a query to a watch.  The query is resolved when its results are first asked for.
+ *
+ *    :param pkgconf_watch_t* watch: The watch object to add the query to.
+ *    :param char* packages: The packages to resolve, in the format accepted by ``pkgconf_queue_push()``.
+ *    :return: A query object, owned by the watch.
+ *    :rtype: pkgconf_watch_query_t *
+ */
+pkgconf_watch_query_t *
+pkgconf_watch_add(pkgconf_watch_t *watch, const char *packages)
+{
+	pkgconf_watch_query_t *query = calloc(sizeof(pkgconf_watch_query_t), 1);
+
+	query->watch = watch;
+	pkgconf_queue_push(&query->queue, packages);
+
+	pkgconf_node_insert_tail(&query->iter, query, &watch->queries);
+
+	return query;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: void pkgconf_watch_remove(pkgconf_watch_t *watch, pkgconf_watch_query_t *query)
+ *
+ *    Removes a query from a watch and releases it.
+ *
+ *    :param pkgconf_watch_t* watch: The watch object owning the query.
+ *    :param pkgconf_watch_query_t* query: The query to release.
+ *    :return: nothing
+ */
+void
+pkgconf_watch_remove(pkgconf_watch_t *watch, pkgconf_watch_query_t *query)
+{
+	pkgconf_watch_query_reset(query);
+	pkgconf_queue_free(&query->queue);
+
+	pkgconf_node_delete(&query->iter, &watch->queries);
+	free(query);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: pkgconf_graph_t *pkgconf_watch_query_get_graph(pkgconf_watch_query_t *query)
+ *
+ *    Retrieves the dependency graph of a query, resolving it first if it was never resolved, was invalidated,
+ *    or was resolved with different client flags.  The graph remains owned by the query and is only valid until
+ *    the query is resolved again.
+ *
+ *    :param pkgconf_watch_query_t* query: The query to access.
+ *    :return: The dependency graph, or ``NULL`` if the query names no package.
+ *    :rtype: pkgconf_graph_t *
+ */
+pkgconf_graph_t *
+pkgconf_watch_query_get_graph(pkgconf_watch_query_t *query)
+{
+	pkgconf_watch_t *watch = query->watch;
+	unsigned int flags = watch->client->flags;
+	pkgconf_query_t graph_query;
+
+	if (query->graph != NULL && query->flags == flags)
+		return query->graph;
+
+	pkgconf_watch_query_reset(query);
+
+	pkgconf_query_init(&graph_query, watch->client, flags);
+	query->graph = pkgconf_graph_new(&graph_query, &query->queue, watch->maxdepth);
+	query->flags = flags;
+
+	if (query->graph != NULL)
+		pkgconf_graph_foreach_pkg(query->graph, pkgconf_watch_link_pkg, query);
+
+	return query->graph;
+}
+
+static const pkgconf_list_t *
+pkgconf_watch_query_result(pkgconf_watch_query_t *query, pkgconf_watch_result_t *result,
+	unsigned int (*collect)(pkgconf_graph_t *graph, const pkgconf_query_t *query, pkgconf_list_t *list), unsigned int *eflags)
+{
+	pkgconf_graph_t *graph = pkgconf_watch_query_get_graph(query);
+
+	if (!result->valid)
+	{
+		if (graph != NULL)
+			result->eflags = collect(graph, NULL, &result->fragments);
+		else
+			result->eflags = PKGCONF_PKG_ERRF_PACKAGE_NOT_FOUND;
+
+		result->valid = true;
+	}
+
+	if (eflags != NULL)
+		*eflags = result->eflags;
+
+	return &result->fragments;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: const pkgconf_list_t *pkgconf_watch_query_cflags(pkgconf_watch_query_t *query, unsigned int *eflags)
+ *
+ *    Retrieves the ``CFLAGS`` fragments of a query, as extracted by ``pkgconf_graph_cflags()``.  They are only
+ *    computed again once the query has been invalidated.
+ *
+ *    :param pkgconf_watch_query_t* query: The query to access.
+ *    :param uint* eflags: An optional pointer that, if set, will be populated with the errors found while resolving the query.
+ *    :return: The fragment list, owned by the query and valid until the query is resolved again.
+ *    :rtype: const pkgconf_list_t *
+ */
+const pkgconf_list_t *
+pkgconf_watch_query_cflags(pkgconf_watch_query_t *query, unsigned int *eflags)
+{
+	return pkgconf_watch_query_result(query, &query->cflags, pkgconf_graph_cflags, eflags);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: const pkgconf_list_t *pkgconf_watch_query_libs(pkgconf_watch_query_t *query, unsigned int *eflags)
+ *
+ *    Retrieves the ``LIBS`` fragments of a query, as extracted by ``pkgconf_graph_libs()``.  They are only
+ *    computed again once the query has been invalidated.
+ *
+ *    :param pkgconf_watch_query_t* query: The query to access.
+ *    :param uint* eflags: An optional pointer that, if set, will be populated with the errors found while resolving the query.
+ *    :return: The fragment list, owned by the query and valid until the query is resolved again.
+ *    :rtype: const pkgconf_list_t *
+ */
+const pkgconf_list_t *
+pkgconf_watch_query_libs(pkgconf_watch_query_t *query, unsigned int *eflags)
+{
+	return pkgconf_watch_query_result(query, &query->libs, pkgconf_graph_libs, eflags);
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: size_t pkgconf_watch_invalidate(pkgconf_watch_t *watch, const char *name)
+ *
+ *    Marks a package as changed.  The package is evicted from the client cache and from the package pool, and
+ *    the queries depending on it are dropped, to be resolved again when their results are next asked for or
+ *    when ``pkgconf_watch_refresh()`` is called.  Other queries keep their results.
+ *
+ *    :param pkgconf_watch_t* watch: The watch object to update.
+ *    :param char* name: The name of the package which changed, added or was removed.
+ *    :return: The number of queries which depended on the package.
+ *    :rtype: size_t
+ */
+size_t
+pkgconf_watch_invalidate(pkgconf_watch_t *watch, const char *name)
+{
+	pkgconf_client_t *client = watch->client;
+	pkgconf_watch_entry_t *entry;
+	pkgconf_pkg_t *pkg;
+	size_t count = 0;
+
+	pkg = pkgconf_cache_lookup(client, name);
+	if (pkg != NULL)
+	{
+		/* drop the reference held by the cache, ours keeps the package alive until it is out of the pool */
+		pkgconf_cache_remove(client, pkg);
+		pkgconf_pkg_unref(client, pkg);
+
+		if ((pkg->flags & PKGCONF_PKG_PROPF_SHARED) && client->pool != NULL)
+			pkgconf_pool_evict(client->pool, pkg);
+
+		pkgconf_pkg_unref(client, pkg);
+	}
+
+	entry = pkgconf_hash_lookup(&watch->index, name);
+	if (entry != NULL)
+	{
+		/* a query has a single edge per name, so resetting it never removes the next edge of this entry */
+		pkgconf_node_t *iter, *iter2;
+
+		PKGCONF_FOREACH_LIST_ENTRY_SAFE(entry->links.head, iter2, iter)
+		{
+			pkgconf_watch_link_t *link = iter->data;
+
+			pkgconf_watch_query_reset(link->query);
+			count++;
+		}
+	}
+
+	PKGCONF_TRACE(client, "%s: invalidated, %zu queries affected", name, count);
+
+	return count;
+}
+
+/*
+ * !doc
+ *
+ * .. c:function:: size_t pkgconf_watch_refresh(pkgconf_watch_t *watch)
+ *
+ *    Resolves every query of a watch which is not resolved yet, for example after calls to
+ *    ``pkgconf_watch_invalidate()``, so that errors are reported up front.
+ *
+ *    :param pkgconf_watch_t* watch: The watch object to update.
+ *    :return: The number of queries which were resolved.
+ *    :rtype: size_t
+ */
+size_t
+pkgconf_watch_refresh(pkgconf_watch_t *watch)
+{
+	unsigned int flags = watch->client->flags;
+	pkgconf_node_t *iter;
+	size_t count = 0;
+
+	PKGCONF_FOREACH_LIST_ENTRY(watch->queries.head, iter)
+	{
+		pkgconf_watch_query_t *query = iter->data;
+
+		if (query->graph != NULL && query->flags == flags)
+			continue;
+
+		pkgconf_watch_query_get_graph(query);
+		count++;
+	}
+
+	return count;
+}
@@ -62,6 +62,14 @@
 #define PKG_DEBUG			(((uint64_t) 1) << 38)
 #define PKG_SHORT_ERRORS		(((uint64_t) 1) << 39)
 #define PKG_EXISTS			(((uint64_t) 1) << 40)
+#define PKG_TRAVERSE_ONCE		(((uint64_t) 1) << 41)
+#define PKG_TOPOLOGICAL_LIBS		(((uint64_t) 1) << 42)
+#define PKG_SHALLOW			(((uint64_t) 1) << 43)
+#define PKG_TIMINGS			(((uint64_t) 1) << 44)
+#define PKG_PROFILE			(((uint64_t) 1) << 45)
+
+/* more workers than this only contend for the prefetch queue */
+#define PKG_PREFETCH_THREADS_MAX	64
 
 static pkgconf_client_t pkg_client;
 
@@ -73,6 +81,7 @@ static char *want_variable = NULL;
 
 FILE *error_msgout = NULL;
 FILE *logfile_out = NULL;
+static FILE *trace_events_out = NULL;
 
 static bool
 error_handler(const char *msg, const pkgconf_client_t *client, const void *data)
@@ -83,6 +92,23 @@ error_handler(const char *msg, const pkgconf_client_t *client, const void *data)
 	return true;
 }
 
+static bool
+parse_prefetch_threads(const char *progname, const char *value, int *threads)
+{
+	char *end;
+	long count;
+
+	count = strtol(value, &end, 10);
+	if (end == value || *end != '\0' || count < 0)
+	{
+		fprintf(stderr, "%s: invalid number of prefetch threads: %s\n", progname, value);
+		return false;
+	}
+
+	*threads = count > PKG_PREFETCH_THREADS_MAX ? PKG_PREFETCH_THREADS_MAX : (int) count;
+	return true;
+}
+
 static bool
 print_list_entry(const pkgconf_pkg_t *entry, void *data)
 {
@@ -215,7 +241,7 @@ print_provides(pkgconf_pkg_t *pkg)
 }
 
 static bool
-apply_provides(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_provides(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) unused;
@@ -226,7 +252,7 @@ apply_provides(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 		print_provides(pkg);
 
 		pkgconf_pkg_free(&pkg_client, pkg);
@@ -236,10 +262,10 @@ apply_provides(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int
 }
 
 static void
-print_digraph_node(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *unused)
+print_digraph_node(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *unused)
 {
 	pkgconf_node_t *node;
-	(void) client;
+	(void) query;
 	(void) unused;
 
 	printf("\"%s\" [fontname=Sans fontsize=8]\n", pkg->id);
@@ -253,7 +279,7 @@ print_digraph_node(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *unused)
 }
 
 static bool
-apply_digraph(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_digraph(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	int eflag;
 
@@ -261,7 +287,7 @@ apply_digraph(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int
 	printf("edge [color=blue len=7.5 fontname=Sans fontsize=8]\n");
 	printf("node [fontname=Sans fontsize=8]\n");
 
-	eflag = pkgconf_pkg_traverse(client, world, print_digraph_node, unused, maxdepth);
+	eflag = pkgconf_pkg_traverse(query, world, print_digraph_node, unused, maxdepth);
 
 	if (eflag != PKGCONF_PKG_ERRF_OK)
 		return false;
@@ -271,7 +297,7 @@ apply_digraph(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int
 }
 
 static bool
-apply_modversion(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_modversion(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) unused;
@@ -282,7 +308,7 @@ apply_modversion(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, i
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 		if (pkg->version != NULL)
 			printf("%s\n", pkg->version);
 
@@ -293,7 +319,7 @@ apply_modversion(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, i
 }
 
 static bool
-apply_variables(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_variables(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) unused;
@@ -304,7 +330,7 @@ apply_variables(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, in
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 		print_variables(pkg);
 
 		pkgconf_pkg_free(&pkg_client, pkg);
@@ -314,7 +340,7 @@ apply_variables(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, in
 }
 
 static bool
-apply_path(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_path(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) unused;
@@ -325,7 +351,7 @@ apply_path(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int max
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 		printf("%s\n", pkg->filename);
 
 		pkgconf_pkg_free(&pkg_client, pkg);
@@ -345,7 +371,7 @@ print_variable(pkgconf_client_t *client, pkgconf_pkg_t *pkg, const char *variabl
 }
 
 static bool
-apply_variable(pkgconf_client_t *client, pkgconf_pkg_t *world, void *variable, int maxdepth)
+apply_variable(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *variable, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) maxdepth;
@@ -355,12 +381,12 @@ apply_variable(pkgconf_client_t *client, pkgconf_pkg_t *world, void *variable, i
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 
 		if (iter->prev != NULL)
 			printf(" ");
 
-		print_variable(client, pkg, variable);
+		print_variable(query->client, pkg, variable);
 
 		pkgconf_pkg_free(&pkg_client, pkg);
 	}
@@ -370,64 +396,61 @@ apply_variable(pkgconf_client_t *client, pkgconf_pkg_t *world, void *variable, i
 	return true;
 }
 
-static bool
-apply_cflags(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+static void
+print_reports(void)
 {
-	pkgconf_list_t unfiltered_list = PKGCONF_LIST_INITIALIZER;
-	pkgconf_list_t filtered_list = PKGCONF_LIST_INITIALIZER;
-	int eflag;
-	char *render_buf;
-	(void) unused;
+	/* stop collecting, so that the exit handler does not print the reports a second time */
+	pkgconf_client_dump_timings(&pkg_client, stderr);
+	pkgconf_client_set_timings(&pkg_client, false);
 
-	eflag = pkgconf_pkg_cflags(client, world, &unfiltered_list, maxdepth);
-	if (eflag != PKGCONF_PKG_ERRF_OK)
-		return false;
+	pkgconf_client_dump_profile(&pkg_client, stderr);
+	pkgconf_client_set_profile(&pkg_client, false);
+}
+
+static void
+print_fragment_list(pkgconf_client_t *client, pkgconf_list_t *list, pkgconf_fragment_filter_func_t filter)
+{
+	pkgconf_list_t filtered_list = PKGCONF_LIST_INITIALIZER;
 
-	pkgconf_fragment_filter(client, &filtered_list, &unfiltered_list, filter_cflags, NULL);
+	PKGCONF_TIMING_BEGIN(client, PKGCONF_TIMING_RENDER, NULL);
 
-	if (filtered_list.head == NULL)
-		return true;
+	pkgconf_fragment_filter(client, &filtered_list, list, filter, NULL);
 
-	render_buf = pkgconf_fragment_render(&filtered_list, true);
-	printf("%s", render_buf);
-	free(render_buf);
+	if (filtered_list.head != NULL)
+		pkgconf_fragment_render_file(&filtered_list, stdout, true);
 
-	pkgconf_fragment_free(&unfiltered_list);
 	pkgconf_fragment_free(&filtered_list);
 
-	return true;
+	PKGCONF_TIMING_END(client, PKGCONF_TIMING_RENDER);
 }
 
 static bool
-apply_libs(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_fragments(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
-	pkgconf_list_t unfiltered_list = PKGCONF_LIST_INITIALIZER;
-	pkgconf_list_t filtered_list = PKGCONF_LIST_INITIALIZER;
+	pkgconf_list_t cflags_list = PKGCONF_LIST_INITIALIZER;
+	pkgconf_list_t libs_list = PKGCONF_LIST_INITIALIZER;
 	int eflag;
-	char *render_buf;
 	(void) unused;
 
-	eflag = pkgconf_pkg_libs(client, world, &unfiltered_list, maxdepth);
+	/* collect the CFLAGS and the LIBS in a single walk of the dependency graph */
+	eflag = pkgconf_pkg_collect(query, world,
+		(want_flags & PKG_CFLAGS) ? &cflags_list : NULL,
+		(want_flags & PKG_LIBS) ? &libs_list : NULL,
+		maxdepth);
 	if (eflag != PKGCONF_PKG_ERRF_OK)
 		return false;
 
-	pkgconf_fragment_filter(client, &filtered_list, &unfiltered_list, filter_libs, NULL);
-
-	if (filtered_list.head == NULL)
-		return true;
+	print_fragment_list(query->client, &cflags_list, filter_cflags);
+	print_fragment_list(query->client, &libs_list, filter_libs);
 
-	render_buf = pkgconf_fragment_render(&filtered_list, true);
-	printf("%s", render_buf);
-	free(render_buf);
-
-	pkgconf_fragment_free(&unfiltered_list);
-	pkgconf_fragment_free(&filtered_list);
+	pkgconf_fragment_free(&cflags_list);
+	pkgconf_fragment_free(&libs_list);
 
 	return true;
 }
 
 static bool
-apply_requires(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_requires(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) unused;
@@ -438,7 +461,7 @@ apply_requires(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 		print_requires(pkg);
 
 		pkgconf_pkg_free(&pkg_client, pkg);
@@ -448,7 +471,7 @@ apply_requires(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int
 }
 
 static bool
-apply_requires_private(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unused, int maxdepth)
+apply_requires_private(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *unused, int maxdepth)
 {
 	pkgconf_node_t *iter;
 	(void) unused;
@@ -459,7 +482,7 @@ apply_requires_private(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unu
 		pkgconf_pkg_t *pkg;
 		pkgconf_dependency_t *dep = iter->data;
 
-		pkg = pkgconf_pkg_verify_dependency(client, dep, NULL);
+		pkg = pkgconf_pkg_verify_dependency(query, dep, NULL);
 		print_requires_private(pkg);
 
 		pkgconf_pkg_free(&pkg_client, pkg);
@@ -468,21 +491,21 @@ apply_requires_private(pkgconf_client_t *client, pkgconf_pkg_t *world, void *unu
 }
 
 static void
-check_uninstalled(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data)
+check_uninstalled(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
 {
 	int *retval = data;
-	(void) client;
+	(void) query;
 
 	if (pkg->flags & PKGCONF_PKG_PROPF_UNINSTALLED)
 		*retval = EXIT_SUCCESS;
 }
 
 static bool
-apply_uninstalled(pkgconf_client_t *client, pkgconf_pkg_t *world, void *data, int maxdepth)
+apply_uninstalled(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *data, int maxdepth)
 {
 	int eflag;
 
-	eflag = pkgconf_pkg_traverse(client, world, check_uninstalled, data, maxdepth);
+	eflag = pkgconf_pkg_traverse(query, world, check_uninstalled, data, maxdepth);
 
 	if (eflag != PKGCONF_PKG_ERRF_OK)
 		return false;
@@ -491,11 +514,11 @@ apply_uninstalled(pkgconf_client_t *client, pkgconf_pkg_t *world, void *data, in
 }
 
 static void
-print_graph_node(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data)
+print_graph_node(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
 {
 	pkgconf_node_t *n;
 
-	(void) client;
+	(void) query;
 	(void) data;
 
 	printf("node '%s' {\n", pkg->id);
@@ -522,11 +545,11 @@ print_graph_node(pkgconf_client_t *client, pkgconf_pkg_t *pkg, void *data)
 }
 
 static bool
-apply_simulate(pkgconf_client_t *client, pkgconf_pkg_t *world, void *data, int maxdepth)
+apply_simulate(const pkgconf_query_t *query, pkgconf_pkg_t *world, void *data, int maxdepth)
 {
 	int eflag;
 
-	eflag = pkgconf_pkg_traverse(client, world, print_graph_node, data, maxdepth);
+	eflag = pkgconf_pkg_traverse(query, world, print_graph_node, data, maxdepth);
 
 	if (eflag != PKGCONF_PKG_ERRF_OK)
 		return false;
@@ -576,6 +599,14 @@ usage(void)
 	printf("  --simulate                        simulate walking the calculated dependency graph\n");
 	printf("  --no-cache                        do not cache already seen packages when\n");
 	printf("                                    walking the dependency graph\n");
+	printf("  --traverse-once                   visit each package only once when walking the\n");
+	printf("                                    dependency graph\n");
+	printf("  --prefetch-threads=N              load the dependencies of a package on N threads\n");
+	printf("                                    while walking the dependency graph\n");
+	printf("  --timings                         print the time spent in each phase of the run\n");
+	printf("                                    to stderr\n");
+	printf("  --profile                         print how often each package was looked up, parsed\n");
+	printf("                                    and visited to stderr\n");
 	printf("  --log-file=filename               write an audit log to a specified file\n");
 	printf("  --with-path=path                  adds a directory to the search path\n");
 	printf("  --define-prefix                   override the prefix variable with one that is guessed based on\n");
@@ -596,10 +627,14 @@ usage(void)
 	printf("  --no-uninstalled                  never use uninstalled modules when satisfying dependencies\n");
 	printf("  --no-provides                     do not use 'provides' rules to resolve dependencies\n");
 	printf("  --maximum-traverse-depth          maximum allowed depth for dependency graph\n");
+	printf("  --shallow                         only load the named packages when querying their\n");
+	printf("                                    version, variables, path or provides\n");
 	printf("  --static                          be more aggressive when computing dependency graph\n");
 	printf("                                    (for static linking)\n");
 	printf("  --pure                            optimize a static dependency graph as if it were a normal\n");
 	printf("                                    dependency graph\n");
+	printf("  --topological-libs                order libraries topologically and list each of them\n");
+	printf("                                    only once (mainly for static linking)\n");
 	printf("  --env-only                        look only for package entries in PKG_CONFIG_PATH\n");
 	printf("  --ignore-conflicts                ignore 'conflicts' rules in modules\n");
 	printf("  --validate                        validate specific .pc files for correctness\n");
@@ -644,6 +679,10 @@ main(int argc, char *argv[])
 {
 	int ret;
 	pkgconf_list_t pkgq = PKGCONF_LIST_INITIALIZER;
+	pkgconf_pkg_t world = {
+		.id = "virtual:world",
+	};
+	pkgconf_query_t query;
 	char *builddir;
 	char *sysroot_dir;
 	char *env_traverse_depth;
@@ -652,6 +691,9 @@ main(int argc, char *argv[])
 	char *required_max_module_version = NULL;
 	char *required_module_version = NULL;
 	char *logfile_arg = NULL;
+	char *env_prefetch_threads;
+	char *trace_events_file;
+	int prefetch_threads = 0;
 	unsigned int want_client_flags = PKGCONF_PKG_PKGF_NONE;
 
 	want_flags = 0;
@@ -681,6 +723,8 @@ main(int argc, char *argv[])
 		{ "maximum-traverse-depth", required_argument, NULL, 11, },
 		{ "static", no_argument, &want_flags, PKG_STATIC, },
 		{ "pure", no_argument, &want_flags, PKG_PURE, },
+		{ "topological-libs", no_argument, &want_flags, PKG_TOPOLOGICAL_LIBS, },
+		{ "shallow", no_argument, &want_flags, PKG_SHALLOW, },
 		{ "print-requires", no_argument, &want_flags, PKG_REQUIRES, },
 		{ "print-variables", no_argument, &want_flags, PKG_VARIABLES|PKG_PRINT_ERRORS, },
 		{ "digraph", no_argument, &want_flags, PKG_DIGRAPH, },
@@ -706,6 +750,10 @@ main(int argc, char *argv[])
 		{ "list-package-names", no_argument, &want_flags, PKG_LIST_PACKAGE_NAMES|PKG_PRINT_ERRORS, },
 		{ "simulate", no_argument, &want_flags, PKG_SIMULATE, },
 		{ "no-cache", no_argument, &want_flags, PKG_NO_CACHE, },
+		{ "traverse-once", no_argument, &want_flags, PKG_TRAVERSE_ONCE, },
+		{ "prefetch-threads", required_argument, NULL, 46, },
+		{ "timings", no_argument, &want_flags, PKG_TIMINGS, },
+		{ "profile", no_argument, &want_flags, PKG_PROFILE, },
 		{ "print-provides", no_argument, &want_flags, PKG_PROVIDES, },
 		{ "no-provides", no_argument, &want_flags, PKG_NO_PROVIDES, },
 		{ "debug", no_argument, &want_flags, PKG_DEBUG|PKG_PRINT_ERRORS, },
@@ -766,6 +814,10 @@ main(int argc, char *argv[])
 		case 45:
 			relocate_path(pkg_optarg);
 			return EXIT_SUCCESS;
+		case 46:
+			if (!parse_prefetch_threads(argv[0], pkg_optarg, &prefetch_threads))
+				return EXIT_FAILURE;
+			break;
 		case '?':
 		case ':':
 			return EXIT_FAILURE;
@@ -778,6 +830,10 @@ main(int argc, char *argv[])
 	if ((env_traverse_depth = getenv("PKG_CONFIG_MAXIMUM_TRAVERSE_DEPTH")) != NULL)
 		maximum_traverse_depth = atoi(env_traverse_depth);
 
+	if ((env_prefetch_threads = getenv("PKG_CONFIG_PREFETCH_THREADS")) != NULL &&
+		!parse_prefetch_threads(argv[0], env_prefetch_threads, &prefetch_threads))
+		return EXIT_FAILURE;
+
 	if ((want_flags & PKG_PRINT_ERRORS) != PKG_PRINT_ERRORS)
 		want_flags |= (PKG_SILENCE_ERRORS);
 
@@ -795,6 +851,24 @@ main(int argc, char *argv[])
 	if ((want_flags & PKG_DEBUG) == PKG_DEBUG)
 		pkgconf_client_set_trace_handler(&pkg_client, error_handler, NULL);
 
+	if ((want_flags & PKG_TIMINGS) == PKG_TIMINGS)
+		pkgconf_client_set_timings(&pkg_client, true);
+
+	if ((want_flags & PKG_PROFILE) == PKG_PROFILE)
+		pkgconf_client_set_profile(&pkg_client, true);
+
+	/* several modes exit early, so report from an exit handler */
+	if (want_flags & (PKG_TIMINGS|PKG_PROFILE))
+		atexit(print_reports);
+
+	if ((trace_events_file = getenv("PKG_CONFIG_TRACE_EVENTS")) != NULL)
+	{
+		if ((trace_events_out = fopen(trace_events_file, "w")) != NULL)
+			pkgconf_client_set_trace_events(&pkg_client, trace_events_out);
+		else
+			fprintf(stderr, "%s: unable to open trace events file %s\n", argv[0], trace_events_file);
+	}
+
 	if ((want_flags & PKG_ABOUT) == PKG_ABOUT)
 	{
 		about();
@@ -854,6 +928,12 @@ main(int argc, char *argv[])
 	if ((want_flags & PKG_NO_CACHE) == PKG_NO_CACHE)
 		want_client_flags |= PKGCONF_PKG_PKGF_NO_CACHE;
 
+	if ((want_flags & PKG_TRAVERSE_ONCE) == PKG_TRAVERSE_ONCE)
+		want_client_flags |= PKGCONF_PKG_PKGF_TRAVERSE_ONCE;
+
+	if ((want_flags & PKG_TOPOLOGICAL_LIBS) == PKG_TOPOLOGICAL_LIBS)
+		want_client_flags |= PKGCONF_PKG_PKGF_TOPOLOGICAL_LIBS;
+
 	if ((want_flags & PKG_DEFINE_PREFIX) == PKG_DEFINE_PREFIX)
 		want_client_flags |= PKGCONF_PKG_PKGF_REDEFINE_PREFIX;
 
@@ -866,28 +946,26 @@ main(int argc, char *argv[])
 	if ((want_flags & PKG_DONT_DEFINE_PREFIX) == PKG_DONT_DEFINE_PREFIX)
 		want_client_flags &= ~PKGCONF_PKG_PKGF_REDEFINE_PREFIX;
 
-#ifdef XXX_NOTYET
-	/* if these selectors are used, it means that we are inquiring about a single package.
-	 * so signal to libpkgconf that we do not want to use the dependency resolver for more than one level,
-	 * and also limit the SAT problem to a single package.
+	/* if these selectors are used, it means that we are inquiring about the named packages only.
+	 * so with --shallow, signal to libpkgconf that we do not want to use the dependency resolver for more
+	 * than one level: the named packages are still looked up and their versions checked, but their own
+	 * dependencies are neither loaded nor verified.
 	 *
-	 * i disabled this because too many upstream maintainers are still invoking pkg-config correctly to have
-	 * the more sane behaviour as default.  use --maximum-traverse-depth=1 or PKG_CONFIG_MAXIMUM_TRAVERSE_DEPTH
-	 * environment variable to get the same results in meantime.
+	 * this is not the default because too many upstream maintainers still rely on these selectors failing
+	 * when a dependency of the package is missing.
 	 */
-	if ((want_flags & PKG_EXISTS) == 0 &&
-		((want_flags & PKG_REQUIRES) == PKG_REQUIRES ||
-		(want_flags & PKG_REQUIRES_PRIVATE) == PKG_REQUIRES_PRIVATE ||
-		(want_flags & PKG_PROVIDES) == PKG_PROVIDES ||
-		(want_flags & PKG_VARIABLES) == PKG_VARIABLES ||
-		(want_flags & PKG_MODVERSION) == PKG_MODVERSION ||
-		(want_flags & PKG_PATH) == PKG_PATH ||
-		want_variable != NULL))
+	if ((want_flags & PKG_SHALLOW) == PKG_SHALLOW || getenv("PKG_CONFIG_SHALLOW") != NULL)
 	{
-		maximum_package_count = 1;
-		maximum_traverse_depth = 1;
+		if ((want_flags & (PKG_EXISTS|PKG_CFLAGS|PKG_LIBS|PKG_DIGRAPH|PKG_SIMULATE|PKG_UNINSTALLED|PKG_VALIDATE)) == 0 &&
+			((want_flags & PKG_REQUIRES) == PKG_REQUIRES ||
+			(want_flags & PKG_REQUIRES_PRIVATE) == PKG_REQUIRES_PRIVATE ||
+			(want_flags & PKG_PROVIDES) == PKG_PROVIDES ||
+			(want_flags & PKG_VARIABLES) == PKG_VARIABLES ||
+			(want_flags & PKG_MODVERSION) == PKG_MODVERSION ||
+			(want_flags & PKG_PATH) == PKG_PATH ||
+			want_variable != NULL))
+			maximum_traverse_depth = 1;
 	}
-#endif
 
 	if (getenv("PKG_CONFIG_ALLOW_SYSTEM_CFLAGS") != NULL)
 		want_flags |= PKG_KEEP_SYSTEM_CFLAGS;
@@ -1071,33 +1149,45 @@ main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	/* the client is fully configured now, so the prefetch workers can take their copy of it */
+	if (prefetch_threads > 0)
+		pkgconf_client_set_prefetch_threads(&pkg_client, prefetch_threads);
+
 	ret = EXIT_SUCCESS;
 
+	/* the selectors below adjust the flags of the query, the client keeps the ones it was configured with */
+	pkgconf_query_init(&query, &pkg_client, want_client_flags);
+
 	if ((want_flags & PKG_SIMULATE) == PKG_SIMULATE)
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		pkgconf_client_set_flags(&pkg_client, want_client_flags | PKGCONF_PKG_PKGF_SKIP_ERRORS);
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_simulate, -1, NULL))
+		query.flags = want_client_flags | PKGCONF_PKG_PKGF_SKIP_ERRORS;
+		if (!pkgconf_queue_apply(&query, &pkgq, apply_simulate, -1, NULL))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
 		}
 	}
 
-	if (!pkgconf_queue_validate(&pkg_client, &pkgq, maximum_traverse_depth))
+	/* as with pkgconf_queue_apply(), a maximum depth of zero means unlimited. */
+	if (!maximum_traverse_depth)
+		maximum_traverse_depth = -1;
+
+	/* compile and solve the queue once, then run every requested selector against the same solution */
+	if (!pkgconf_queue_solve(&query, &pkgq, &world, maximum_traverse_depth))
 	{
 		ret = EXIT_FAILURE;
 		goto out;
 	}
 
 	if ((want_flags & PKG_VALIDATE) == PKG_VALIDATE)
-		return 0;
+		goto out;
 
 	if ((want_flags & PKG_UNINSTALLED) == PKG_UNINSTALLED)
 	{
 		ret = EXIT_FAILURE;
-		pkgconf_queue_apply(&pkg_client, &pkgq, apply_uninstalled, maximum_traverse_depth, &ret);
+		apply_uninstalled(&query, &world, &ret, maximum_traverse_depth);
 		goto out;
 	}
 
@@ -1105,7 +1195,7 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_provides, maximum_traverse_depth, NULL))
+		if (!apply_provides(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1116,7 +1206,7 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_digraph, maximum_traverse_depth, NULL))
+		if (!apply_digraph(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1127,7 +1217,7 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_modversion, maximum_traverse_depth, NULL))
+		if (!apply_modversion(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1138,8 +1228,8 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		pkgconf_client_set_flags(&pkg_client, want_client_flags | PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL);
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_path, maximum_traverse_depth, NULL))
+		query.flags = want_client_flags | PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL;
+		if (!apply_path(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1150,7 +1240,7 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_variables, maximum_traverse_depth, NULL))
+		if (!apply_variables(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1161,8 +1251,8 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		pkgconf_client_set_flags(&pkg_client, want_client_flags | PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL);
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_variable, maximum_traverse_depth, want_variable))
+		query.flags = want_client_flags | PKGCONF_PKG_PKGF_SKIP_ROOT_VIRTUAL;
+		if (!apply_variable(&query, &world, want_variable, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1173,7 +1263,7 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_requires, maximum_traverse_depth, NULL))
+		if (!apply_requires(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
@@ -1184,50 +1274,43 @@ main(int argc, char *argv[])
 	{
 		want_flags &= ~(PKG_CFLAGS|PKG_LIBS);
 
-		pkgconf_client_set_flags(&pkg_client, want_client_flags | PKGCONF_PKG_PKGF_SEARCH_PRIVATE);
+		query.flags = want_client_flags | PKGCONF_PKG_PKGF_SEARCH_PRIVATE;
 
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_requires_private, maximum_traverse_depth, NULL))
+		if (pkgconf_pkg_verify_graph(&query, &world, maximum_traverse_depth) != PKGCONF_PKG_ERRF_OK ||
+			!apply_requires_private(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out;
 		}
 
-		pkgconf_client_set_flags(&pkg_client, want_client_flags);
-	}
-
-	if ((want_flags & PKG_CFLAGS))
-	{
-		pkgconf_client_set_flags(&pkg_client, want_client_flags | PKGCONF_PKG_PKGF_SEARCH_PRIVATE);
-
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_cflags, maximum_traverse_depth, NULL))
-		{
-			ret = EXIT_FAILURE;
-			goto out_println;
-		}
-
-		pkgconf_client_set_flags(&pkg_client, want_client_flags);
+		query.flags = want_client_flags;
 	}
 
-	if ((want_flags & PKG_LIBS))
+	if ((want_flags & (PKG_CFLAGS|PKG_LIBS)))
 	{
-		if (!pkgconf_queue_apply(&pkg_client, &pkgq, apply_libs, maximum_traverse_depth, NULL))
+		if (!apply_fragments(&query, &world, NULL, maximum_traverse_depth))
 		{
 			ret = EXIT_FAILURE;
 			goto out_println;
 		}
 	}
 
-	pkgconf_queue_free(&pkgq);
-
 out_println:
 	if (want_flags & (PKG_CFLAGS|PKG_LIBS))
 		printf("\n");
 
 out:
+	pkgconf_dependency_free(&world.requires);
+	pkgconf_queue_free(&pkgq);
+
+	print_reports();
 	pkgconf_client_deinit(&pkg_client);
 
 	if (logfile_out != NULL)
 		fclose(logfile_out);
 
+	if (trace_events_out != NULL)
+		fclose(trace_events_out);
+
 	return ret;
 }
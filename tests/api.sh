@@ -0,0 +1,112 @@
+#!/usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_env.sh
+
+tests_init \
+	pool_shared \
+	pool_sysroot \
+	pool_globals \
+	pool_mtime \
+	watch_client \
+	watch_pool \
+	trace_ring \
+	trace_format \
+	trace_overflow \
+	trace_levels \
+	clone_shared \
+	clone_isolated \
+	traverse_conflicts \
+	threads
+
+pool_shared_body()
+{
+	atf_check test-api pool-shared "${selfdir}/lib1"
+}
+
+pool_sysroot_body()
+{
+	atf_check test-api pool-sysroot "${selfdir}/lib1"
+}
+
+pool_globals_body()
+{
+	atf_check test-api pool-globals "${selfdir}/lib1"
+}
+
+pool_mtime_body()
+{
+	atf_check test-api pool-mtime "${selfdir}/lib1"
+}
+
+watch_client_body()
+{
+	atf_check \
+		-o inline:"app: -DAPP -DBASE=1 (ok)\nother: -DOTHER (ok)\ninvalidated: 1\nrefreshed: 1\napp: -DAPP -DBASE=2 (ok)\nother: -DOTHER (ok)\nother graph: kept\n" \
+		test-api watch-client "${selfdir}/lib1"
+}
+
+watch_pool_body()
+{
+	atf_check \
+		-o inline:"app: -DAPP -DBASE=1 (ok)\nother: -DOTHER (ok)\ninvalidated: 1\nrefreshed: 1\napp: -DAPP -DBASE=2 (ok)\nother: -DOTHER (ok)\nother graph: kept\n" \
+		test-api watch-pool "${selfdir}/lib1"
+}
+
+trace_ring_body()
+{
+	atf_check \
+		-o inline:"test.c:1 [ring]: message 2\ntest.c:1 [ring]: message 3\ntest.c:1 [ring]: message 4\ntest.c:1 [ring]: message 5\n" \
+		test-api trace-ring "${selfdir}/lib1"
+}
+
+trace_format_body()
+{
+	atf_check \
+		-o inline:"test.c:1 [format]: int: -1     2 3   | +4 005
+test.c:1 [format]: unsigned: 10 ff FF 010 0x10
+test.c:1 [format]: length: -8 -16 -32 -64 128 256 -512
+test.c:1 [format]: char: abc
+test.c:1 [format]: double: 3.14 0.5 1.000000e+03 2.50
+test.c:1 [format]: string: [plain] [     right] [left] [tru] [(null)]
+test.c:1 [format]: percent: 100% done
+test.c:1 [format]: no arguments
+test.c:1 [format]: too many: 1 2 3 4 5 6 7 8 ...
+test.c:1 [format]: star: 1 ...
+" \
+		test-api trace-format "${selfdir}/lib1"
+}
+
+trace_overflow_body()
+{
+	atf_check \
+		-o match:"^test.c:1 \[overflow\]: x{191} and \.\.\.$" \
+		-o match:"^test.c:1 \[overflow\]: 1: x{99} x{91} \.\.\.$" \
+		test-api trace-overflow "${selfdir}/lib1"
+}
+
+trace_levels_body()
+{
+	atf_check \
+		-o inline:"levels: cache 1, parser 0, graph 2\ncache: info\ngraph: info\ngraph: verbose\nlevels: cache 2, parser 0, graph 0\ncache: info\ncache: verbose\n" \
+		test-api trace-levels "${selfdir}/lib1"
+}
+
+clone_shared_body()
+{
+	atf_check test-api clone-shared "${selfdir}/lib1"
+}
+
+clone_isolated_body()
+{
+	atf_check test-api clone-isolated "${selfdir}/lib1"
+}
+
+traverse_conflicts_body()
+{
+	atf_check test-api traverse-conflicts "${selfdir}/lib1"
+}
+
+threads_body()
+{
+	atf_check test-api threads "${selfdir}/lib1:${selfdir}/lib2"
+}
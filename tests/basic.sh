@@ -35,7 +35,12 @@ tests_init \
 	arbitary_path \
 	with_path \
 	relocatable \
-	single_depth_selectors
+	single_depth_selectors \
+	shallow_selectors \
+	shallow_selectors_env \
+	timings \
+	trace_events \
+	profile
 
 noargs_body()
 {
@@ -307,3 +312,49 @@ single_depth_selectors_body()
 		-o inline:"foo\n" \
 		pkgconf --with-path=${selfdir}/lib3 --print-requires bar
 }
+
+shallow_selectors_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"1.2.3\n" \
+		pkgconf --shallow --modversion depgraph-break
+}
+
+shallow_selectors_env_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1" PKG_CONFIG_SHALLOW=1
+	atf_check \
+		-o inline:"/test\n" \
+		pkgconf --variable=prefix depgraph-break
+}
+
+timings_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-fPIC -I/test/include/foo -L/test/lib -lfoo \n" \
+		-e match:"^lookup " \
+		-e match:"^total " \
+		pkgconf --timings --cflags --libs foo
+}
+
+trace_events_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1" PKG_CONFIG_TRACE_EVENTS="trace.json"
+	atf_check \
+		-o inline:"-L/test/lib -lbar -lfoo \n" \
+		pkgconf --libs bar
+	atf_check \
+		-o match:'"cat":"lookup","name":"foo"' \
+		cat trace.json
+}
+
+profile_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-L/test/lib -lbar -lfoo \n" \
+		-e match:"^bar  *3  *1  *1 " \
+		pkgconf --profile --libs bar
+}
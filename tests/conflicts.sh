@@ -4,7 +4,10 @@
 
 tests_init \
 	libs \
-	ignore
+	ignore \
+	indirect \
+	indirect_ignore \
+	indirect_modversion
 
 libs_body()
 {
@@ -21,3 +24,33 @@ ignore_body()
 		-o inline:"-L/test/lib -lconflicts \n" \
 		pkgconf --ignore-conflicts --libs conflicts
 }
+
+indirect_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-s exit:1 \
+		-e match:"Version '1.2.3' of 'foo' conflicts with 'conflicts'" \
+		-o ignore \
+		pkgconf --libs conflicts bar
+}
+
+indirect_ignore_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-L/test/lib -lconflicts -lbar -lfoo \n" \
+		pkgconf --ignore-conflicts --libs conflicts bar
+}
+
+indirect_modversion_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-s exit:1 \
+		-e match:"Version '1.2.3' of 'foo' conflicts with 'conflicts'" \
+		pkgconf --modversion conflicts bar
+	atf_check \
+		-o inline:"1.2.3\n1.3\n" \
+		pkgconf --ignore-conflicts --modversion conflicts bar
+}
@@ -11,7 +11,19 @@ tests_init \
 	static_cflags \
 	private_duplication \
 	libs_static2 \
-	missing
+	missing \
+	traverse_once_libs \
+	traverse_once_static \
+	traverse_once_cflags_libs \
+	traverse_once_private \
+	traverse_once_multiple \
+	traverse_once_private_paths \
+	traverse_once_cflags \
+	traverse_once_cflags_private \
+	prefetch_static \
+	prefetch_invalid \
+	topological_static \
+	topological_cflags
 
 libs_body()
 {
@@ -86,3 +98,143 @@ missing_body()
 		-o inline:"\n" \
 		pkgconf --cflags missing-require
 }
+
+traverse_once_libs_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-L/test/lib -ldiamond-top -ldiamond-left -L/test/lib/bottom -ldiamond-right -ldiamond-bottom \n" \
+		pkgconf --libs diamond-top
+	atf_check \
+		-o inline:"-L/test/lib -ldiamond-top -ldiamond-left -L/test/lib/bottom -ldiamond-right -ldiamond-bottom \n" \
+		pkgconf --traverse-once --libs diamond-top
+}
+
+traverse_once_static_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-L/test/lib -ldiamond-top -ldiamond-left -L/test/lib/bottom -lm -ldiamond-right -ldiamond-bottom -lm \n" \
+		pkgconf --static --libs diamond-top
+	atf_check \
+		-o inline:"-L/test/lib -ldiamond-top -ldiamond-left -L/test/lib/bottom -lm -ldiamond-right -ldiamond-bottom -lm \n" \
+		pkgconf --traverse-once --static --libs diamond-top
+	atf_check \
+		-o inline:"-lprivate -lfoo -L/test/lib -lbaz -L/test/lib -lzee -L/test/lib -lbar -lfoo \n" \
+		pkgconf --static --libs private-libs-duplication
+	atf_check \
+		-o inline:"-lprivate -lfoo -L/test/lib -lbaz -L/test/lib -lzee -L/test/lib -lbar -lfoo \n" \
+		pkgconf --traverse-once --static --libs private-libs-duplication
+}
+
+traverse_once_cflags_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-D_BAZ -D_BAR -D_FOO -D_THREAD_SAFE -pthread \n" \
+		pkgconf --cflags fragment-collision
+	atf_check \
+		-o inline:"-D_BAZ -D_BAR -D_FOO -D_THREAD_SAFE -pthread \n" \
+		pkgconf --traverse-once --cflags fragment-collision
+	atf_check \
+		-o inline:"-I/test/include/diamond-top -I/test/include/diamond-left -I/test/include/diamond-bottom -I/test/include/diamond-right \n" \
+		pkgconf --cflags diamond-top
+	atf_check \
+		-o inline:"-I/test/include/diamond-top -I/test/include/diamond-left -I/test/include/diamond-bottom -I/test/include/diamond-right \n" \
+		pkgconf --traverse-once --cflags diamond-top
+}
+
+traverse_once_cflags_private_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-I/test/include/foo -fPIC \n" \
+		pkgconf --cflags private-libs-duplication
+	atf_check \
+		-o inline:"-I/test/include/foo -fPIC \n" \
+		pkgconf --traverse-once --cflags private-libs-duplication
+	atf_check \
+		-o inline:"-I/test/include/foo -fPIC -DFOO_STATIC -DFOO_STATIC \n" \
+		pkgconf --static --cflags private-libs-duplication
+	atf_check \
+		-o inline:"-I/test/include/foo -fPIC -DFOO_STATIC -DFOO_STATIC \n" \
+		pkgconf --traverse-once --static --cflags private-libs-duplication
+}
+
+traverse_once_cflags_libs_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-I/test/include/diamond-top -I/test/include/diamond-left -I/test/include/diamond-bottom -I/test/include/diamond-right -L/test/lib -ldiamond-top -ldiamond-left -L/test/lib/bottom -ldiamond-right -ldiamond-bottom \n" \
+		pkgconf --traverse-once --cflags --libs diamond-top
+}
+
+traverse_once_private_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-I/test/local/include/foo -fPIC -I/test/include/foo -lbar \n" \
+		pkgconf --traverse-once --cflags --libs static-libs
+	atf_check \
+		-o inline:"-I/test/local/include/foo -fPIC -I/test/include/foo -DFOO_STATIC -lbar -lbar-private -L/test/lib -lfoo \n" \
+		pkgconf --traverse-once --static --cflags --libs static-libs
+}
+
+traverse_once_multiple_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-I/test/include/foo -fPIC -L/test/lib -lbar -lfoo \n" \
+		pkgconf --traverse-once --cflags --libs foo bar
+}
+
+traverse_once_private_paths_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-L/test/lib -lprivate-paths-top -lprivate-paths-top-private -L/test/lib/middle -lprivate-paths-middle -lprivate-paths-middle-private -L/test/lib/bottom -lprivate-paths-bottom-private -lprivate-paths-bottom -lshared -lprivate-paths-bottom-private \n" \
+		pkgconf --static --libs private-paths-top
+	atf_check \
+		-o inline:"-L/test/lib -lprivate-paths-top -lprivate-paths-top-private -L/test/lib/middle -lprivate-paths-middle -lprivate-paths-middle-private -L/test/lib/bottom -lprivate-paths-bottom-private -lprivate-paths-bottom -lshared -lprivate-paths-bottom-private \n" \
+		pkgconf --traverse-once --static --libs private-paths-top
+}
+
+prefetch_static_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-L/test/lib -ldiamond-top -ldiamond-left -L/test/lib/bottom -lm -ldiamond-right -ldiamond-bottom -lm \n" \
+		pkgconf --prefetch-threads=4 --static --libs diamond-top
+}
+
+prefetch_invalid_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-s exit:1 \
+		-e match:"invalid number of prefetch threads: abc" \
+		pkgconf --prefetch-threads=abc --libs foo
+	atf_check \
+		-s exit:1 \
+		-e match:"invalid number of prefetch threads: -1" \
+		env PKG_CONFIG_PREFETCH_THREADS=-1 pkgconf --libs foo
+}
+
+topological_static_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-lprivate -lbaz -lzee -lbar -lfoo \n" \
+		pkgconf --static --topological-libs --libs-only-l private-libs-duplication
+}
+
+topological_cflags_body()
+{
+	export PKG_CONFIG_PATH="${selfdir}/lib1"
+	atf_check \
+		-o inline:"-D_BAZ -D_BAR -D_FOO -D_THREAD_SAFE -pthread \n" \
+		pkgconf --topological-libs --cflags fragment-collision
+	atf_check \
+		-o inline:"-I/test/include/foo -fPIC -DFOO_STATIC -DFOO_STATIC -lprivate -lbaz -lzee -lbar -lfoo \n" \
+		pkgconf --static --topological-libs --cflags --libs-only-l private-libs-duplication
+}
@@ -0,0 +1,979 @@
+/*
+ * test-api.c
+ * exercise the parts of the library which the command line does not reach
+ *
+ * Copyright (c) 2017 pkgconf authors (see AUTHORS).
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This software is provided 'as is' and without any warranty, express or
+ * implied.  In no event shall the authors be liable for any damages arising
+ * from the use of this software.
+ */
+
+#include <libpkgconf/libpkgconf.h>
+#include <libpkgconf/thread.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+/*
+ * usage: test-api TEST DIR
+ *
+ * Runs one of the tests below with clients searching DIR, which has to contain foo.pc.  A test
+ * reports what went wrong on stderr and exits with a failure status if the library did not behave
+ * as expected.  Tests which print their results leave the checking to the caller.
+ */
+
+typedef struct test_ test_t;
+
+struct test_ {
+	const char *name;
+	bool (*func)(const char *dir);
+};
+
+/*
+ * pool tests: every client of a test uses the same pool, and the test checks which of them got
+ * the same package object for foo.
+ */
+
+#define POOL_PACKAGE	"foo"
+
+static pkgconf_client_t *
+pool_client_new(pkgconf_pool_t *pool, const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+
+	pkgconf_path_add(dir, &client->dir_list, true);
+	pkgconf_client_set_pool(client, pool);
+
+	return client;
+}
+
+/*
+ * pool_find(client)
+ *
+ * load the test package with a client and check that it came from the pool.  the pool keeps its own
+ * reference, so the package stays valid after the client releases it.
+ */
+static pkgconf_pkg_t *
+pool_find(pkgconf_client_t *client)
+{
+	pkgconf_pkg_t *pkg = pkgconf_pkg_find(client, POOL_PACKAGE);
+	bool shared;
+
+	if (pkg == NULL)
+	{
+		fprintf(stderr, "package %s not found\n", POOL_PACKAGE);
+		exit(EXIT_FAILURE);
+	}
+
+	shared = (pkg->flags & PKGCONF_PKG_PROPF_SHARED) != 0;
+	if (!shared)
+		fprintf(stderr, "package %s was not shared\n", POOL_PACKAGE);
+
+	pkgconf_pkg_unref(client, pkg);
+
+	return shared ? pkg : NULL;
+}
+
+static bool
+pool_check(const char *what, const pkgconf_pkg_t *a, const pkgconf_pkg_t *b, bool same)
+{
+	if (a == NULL || b == NULL)
+		return false;
+
+	if ((a == b) == same)
+		return true;
+
+	fprintf(stderr, "%s: expected %s package\n", what, same ? "the same" : "a separate");
+	return false;
+}
+
+static bool
+test_pool_shared(const char *dir)
+{
+	pkgconf_pool_t *pool = pkgconf_pool_new();
+	pkgconf_client_t *a = pool_client_new(pool, dir);
+	pkgconf_client_t *b = pool_client_new(pool, dir);
+	bool ret;
+
+	/* the second client gets the package parsed by the first one */
+	ret = pool_check("second client", pool_find(a), pool_find(b), true);
+
+	pkgconf_client_free(a);
+	pkgconf_client_free(b);
+	pkgconf_pool_unref(pool);
+
+	return ret;
+}
+
+static bool
+test_pool_sysroot(const char *dir)
+{
+	pkgconf_pool_t *pool = pkgconf_pool_new();
+	pkgconf_client_t *a = pool_client_new(pool, dir);
+	pkgconf_client_t *b = pool_client_new(pool, dir);
+	pkgconf_client_t *c = pool_client_new(pool, dir);
+	pkgconf_pkg_t *pkg;
+	bool ret;
+
+	pkgconf_client_set_sysroot_dir(a, "/sysroot");
+	pkgconf_client_set_sysroot_dir(b, "/other-sysroot");
+	pkgconf_client_set_sysroot_dir(c, "/sysroot");
+
+	pkg = pool_find(a);
+	ret = pool_check("other sysroot", pkg, pool_find(b), false);
+	ret = pool_check("same sysroot", pkg, pool_find(c), true) && ret;
+
+	pkgconf_client_free(a);
+	pkgconf_client_free(b);
+	pkgconf_client_free(c);
+	pkgconf_pool_unref(pool);
+
+	return ret;
+}
+
+static bool
+test_pool_globals(const char *dir)
+{
+	pkgconf_pool_t *pool = pkgconf_pool_new();
+	pkgconf_client_t *a = pool_client_new(pool, dir);
+	pkgconf_client_t *b = pool_client_new(pool, dir);
+	pkgconf_client_t *c = pool_client_new(pool, dir);
+	pkgconf_pkg_t *pkg;
+	bool ret;
+
+	pkgconf_tuple_add_global(a, "prefix", "/usr");
+	pkgconf_tuple_add_global(b, "prefix", "/opt");
+	pkgconf_tuple_add_global(c, "prefix", "/usr");
+
+	pkg = pool_find(a);
+	ret = pool_check("other global variable", pkg, pool_find(b), false);
+	ret = pool_check("same global variable", pkg, pool_find(c), true) && ret;
+
+	pkgconf_client_free(a);
+	pkgconf_client_free(b);
+	pkgconf_client_free(c);
+	pkgconf_pool_unref(pool);
+
+	return ret;
+}
+
+static bool
+test_pool_mtime(const char *dir)
+{
+	char src[PKGCONF_BUFSIZE], line[PKGCONF_BUFSIZE];
+	FILE *in, *out;
+	struct stat st;
+	struct utimbuf times;
+	pkgconf_pool_t *pool;
+	pkgconf_client_t *a, *b;
+	pkgconf_pkg_t *pkg;
+	bool ret;
+
+	/* work on a copy of the package, so that its modification time can be changed */
+	snprintf(src, sizeof src, "%s/%s.pc", dir, POOL_PACKAGE);
+	if ((in = fopen(src, "r")) == NULL || mkdir("pool", 0755) == -1 || (out = fopen("pool/" POOL_PACKAGE ".pc", "w")) == NULL)
+	{
+		perror(src);
+		exit(EXIT_FAILURE);
+	}
+
+	while (fgets(line, sizeof line, in) != NULL)
+		fputs(line, out);
+
+	fclose(in);
+	fclose(out);
+
+	pool = pkgconf_pool_new();
+	a = pool_client_new(pool, "pool");
+	b = pool_client_new(pool, "pool");
+
+	/* move the modification time well away from the one of the first parse */
+	stat("pool/" POOL_PACKAGE ".pc", &st);
+	times.actime = st.st_atime;
+	times.modtime = st.st_mtime - 3600;
+
+	pkg = pool_find(a);
+	utime("pool/" POOL_PACKAGE ".pc", &times);
+	ret = pool_check("modified file", pkg, pool_find(b), false);
+
+	pkgconf_client_free(a);
+	pkgconf_client_free(b);
+	pkgconf_pool_unref(pool);
+
+	return ret;
+}
+
+/*
+ * watch tests: a few packages are written into a watch directory below the current directory and
+ * two queries are watched: app, which requires base, and the unrelated other.  base.pc is then
+ * rewritten with the same size, usually within the same second, so that only invalidating it lets
+ * the watch see the change.  the flags of both queries are printed before and after the change.
+ */
+
+static void
+watch_write_package(const char *name, const char *contents)
+{
+	char path[PKGCONF_BUFSIZE];
+	FILE *f;
+
+	snprintf(path, sizeof path, "watch/%s.pc", name);
+	if ((f = fopen(path, "w")) == NULL)
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void
+watch_print_cflags(const char *name, pkgconf_watch_query_t *query)
+{
+	unsigned int eflags;
+	const pkgconf_list_t *cflags = pkgconf_watch_query_cflags(query, &eflags);
+	char *rendered = pkgconf_fragment_render(cflags, true);
+
+	printf("%s: %s(%s)\n", name, rendered, eflags == PKGCONF_PKG_ERRF_OK ? "ok" : "error");
+	free(rendered);
+}
+
+static bool
+watch_run(pkgconf_pool_t *pool)
+{
+	pkgconf_client_t *client;
+	pkgconf_watch_t *watch;
+	pkgconf_watch_query_t *app, *other;
+	pkgconf_graph_t *other_graph;
+
+	if (mkdir("watch", 0755) == -1)
+	{
+		perror("watch");
+		return false;
+	}
+
+	watch_write_package("base", "Name: base\nDescription: base\nVersion: 1\nCflags: -DBASE=1\n");
+	watch_write_package("app", "Name: app\nDescription: app\nVersion: 1\nRequires: base\nCflags: -DAPP\n");
+	watch_write_package("other", "Name: other\nDescription: other\nVersion: 1\nCflags: -DOTHER\n");
+
+	client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+	pkgconf_path_add("watch", &client->dir_list, true);
+	pkgconf_client_set_pool(client, pool);
+
+	watch = pkgconf_watch_new(client, 2000);
+	app = pkgconf_watch_add(watch, "app");
+	other = pkgconf_watch_add(watch, "other");
+
+	watch_print_cflags("app", app);
+	watch_print_cflags("other", other);
+	other_graph = pkgconf_watch_query_get_graph(other);
+
+	watch_write_package("base", "Name: base\nDescription: base\nVersion: 1\nCflags: -DBASE=2\n");
+
+	printf("invalidated: %zu\n", pkgconf_watch_invalidate(watch, "base"));
+	printf("refreshed: %zu\n", pkgconf_watch_refresh(watch));
+
+	watch_print_cflags("app", app);
+	watch_print_cflags("other", other);
+	printf("other graph: %s\n", pkgconf_watch_query_get_graph(other) == other_graph ? "kept" : "rebuilt");
+
+	pkgconf_watch_free(watch);
+	pkgconf_client_free(client);
+
+	return true;
+}
+
+static bool
+test_watch_client(const char *dir)
+{
+	(void) dir;
+
+	return watch_run(NULL);
+}
+
+static bool
+test_watch_pool(const char *dir)
+{
+	pkgconf_pool_t *pool = pkgconf_pool_new();
+	bool ret;
+
+	(void) dir;
+
+	ret = watch_run(pool);
+	pkgconf_pool_unref(pool);
+
+	return ret;
+}
+
+/*
+ * trace tests: messages are recorded in a trace buffer of a client and dumped back to stdout.  the
+ * messages are emitted with pkgconf_trace() and a fixed location, except for the levels test, whose
+ * messages go through the trace macros and are printed without their location.
+ */
+
+#define TRACE(client, name, ...)	pkgconf_trace(client, "test.c", 1, name, __VA_ARGS__)
+
+static bool
+test_trace_ring(const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+	int i;
+
+	(void) dir;
+
+	/* the buffer keeps the last three messages, the oldest first */
+	pkgconf_client_set_trace_buffer(client, 3);
+	for (i = 0; i < 5; i++)
+		TRACE(client, "ring", "message %d", i);
+
+	pkgconf_client_dump_trace_buffer(client, stdout);
+
+	/* installing a buffer again discards what was recorded */
+	pkgconf_client_set_trace_buffer(client, 2);
+	pkgconf_client_dump_trace_buffer(client, stdout);
+
+	TRACE(client, "ring", "message %d", i);
+	pkgconf_client_dump_trace_buffer(client, stdout);
+
+	pkgconf_client_free(client);
+
+	return true;
+}
+
+static bool
+test_trace_format(const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+	const char * volatile null = NULL;
+
+	(void) dir;
+
+	pkgconf_client_set_trace_buffer(client, 16);
+
+	TRACE(client, "format", "int: %d %5i %-4d| %+d %03d", -1, 2, 3, 4, 5);
+	TRACE(client, "format", "unsigned: %u %x %X %#o %#x", 10U, 255U, 255U, 8U, 16U);
+	TRACE(client, "format", "length: %hhd %hd %ld %lld %zu %jd %td", (signed char) -8, (short) -16, -32L, -64LL, (size_t) 128, (intmax_t) 256, (ptrdiff_t) -512);
+	TRACE(client, "format", "char: %c%c%c", 'a', 'b', 'c');
+	TRACE(client, "format", "double: %.2f %g %e %.2Lf", 3.14159, 0.5, 1000.0, (long double) 2.5);
+	TRACE(client, "format", "string: [%s] [%10s] [%-4s] [%.3s] [%s]", "plain", "right", "left", "truncated", null);
+	TRACE(client, "format", "percent: 100%% %s", "done");
+	TRACE(client, "format", "no arguments");
+	TRACE(client, "format", "too many: %d %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+	TRACE(client, "format", "star: %d %*d", 1, 4, 2);
+
+	pkgconf_client_dump_trace_buffer(client, stdout);
+	pkgconf_client_free(client);
+
+	return true;
+}
+
+static bool
+test_trace_overflow(const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+	char string[300];
+
+	(void) dir;
+
+	memset(string, 'x', sizeof string - 1);
+	string[sizeof string - 1] = '\0';
+
+	/* the first string fills the string area of the record, the ones after it do not fit at all */
+	pkgconf_client_set_trace_buffer(client, 1);
+	TRACE(client, "overflow", "%s and %s", string, "second");
+	pkgconf_client_dump_trace_buffer(client, stdout);
+
+	TRACE(client, "overflow", "%d: %s %s %s", 1, string + 200, string + 100, "third");
+	pkgconf_client_dump_trace_buffer(client, stdout);
+
+	pkgconf_client_free(client);
+
+	return true;
+}
+
+static void
+trace_levels_emit(pkgconf_client_t *client)
+{
+	PKGCONF_TRACE_AT(client, PKGCONF_TRACE_CACHE, PKGCONF_TRACE_LEVEL_INFO, "cache: info");
+	PKGCONF_TRACE_AT(client, PKGCONF_TRACE_CACHE, PKGCONF_TRACE_LEVEL_VERBOSE, "cache: verbose");
+	PKGCONF_TRACE_AT(client, PKGCONF_TRACE_PARSER, PKGCONF_TRACE_LEVEL_INFO, "parser: info");
+	PKGCONF_TRACE_AT(client, PKGCONF_TRACE_PARSER, PKGCONF_TRACE_LEVEL_VERBOSE, "parser: verbose");
+	PKGCONF_TRACE_AT(client, PKGCONF_TRACE_GRAPH, PKGCONF_TRACE_LEVEL_INFO, "graph: info");
+	PKGCONF_TRACE_AT(client, PKGCONF_TRACE_GRAPH, PKGCONF_TRACE_LEVEL_VERBOSE, "graph: verbose");
+}
+
+static void
+trace_levels_print(pkgconf_client_t *client)
+{
+	FILE *out = tmpfile();
+	char line[PKGCONF_BUFSIZE];
+
+	if (out == NULL)
+	{
+		perror("tmpfile");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("levels: cache %u, parser %u, graph %u\n",
+		pkgconf_client_get_trace_level(client, PKGCONF_TRACE_CACHE),
+		pkgconf_client_get_trace_level(client, PKGCONF_TRACE_PARSER),
+		pkgconf_client_get_trace_level(client, PKGCONF_TRACE_GRAPH));
+
+	trace_levels_emit(client);
+
+	pkgconf_client_dump_trace_buffer(client, out);
+	rewind(out);
+
+	/* the location of a message depends on how this file was built, so only print the message */
+	while (fgets(line, sizeof line, out) != NULL)
+	{
+		const char *message = strstr(line, "]: ");
+
+		fputs(message != NULL ? message + 3 : line, stdout);
+	}
+
+	fclose(out);
+}
+
+static bool
+test_trace_levels(const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+
+	(void) dir;
+
+	/* nothing is recorded or formatted until a trace buffer is installed */
+	trace_levels_emit(client);
+
+	pkgconf_client_set_trace_buffer(client, 16);
+	pkgconf_client_set_trace_level(client, PKGCONF_TRACE_CACHE, PKGCONF_TRACE_LEVEL_INFO);
+	pkgconf_client_set_trace_level(client, PKGCONF_TRACE_PARSER, PKGCONF_TRACE_LEVEL_NONE);
+	trace_levels_print(client);
+
+	pkgconf_client_set_trace_buffer(client, 16);
+	pkgconf_client_set_trace_level(client, PKGCONF_TRACE_CACHE, PKGCONF_TRACE_LEVEL_VERBOSE);
+	pkgconf_client_set_trace_level(client, PKGCONF_TRACE_GRAPH, PKGCONF_TRACE_LEVEL_NONE);
+	trace_levels_print(client);
+
+	pkgconf_client_free(client);
+
+	return true;
+}
+
+/*
+ * clone tests: a client loads packages from DIR, which has to contain foo.pc, bar.pc and baz.pc,
+ * and the test checks which of them are shared with a clone of that client.
+ */
+
+static pkgconf_client_t *
+clone_client_new(const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+
+	pkgconf_path_add(dir, &client->dir_list, true);
+
+	return client;
+}
+
+static pkgconf_pkg_t *
+clone_find(pkgconf_client_t *client, const char *name)
+{
+	pkgconf_pkg_t *pkg = pkgconf_pkg_find(client, name);
+
+	if (pkg == NULL)
+	{
+		fprintf(stderr, "package %s not found\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	return pkg;
+}
+
+static bool
+clone_check_cached(const char *what, pkgconf_client_t *client, const char *name, const pkgconf_pkg_t *expected)
+{
+	pkgconf_pkg_t *pkg = pkgconf_cache_lookup(client, name);
+	bool ret = pkg == expected;
+
+	if (!ret)
+		fprintf(stderr, "%s: %s is %s the cache\n", what, name, pkg != NULL ? "unexpectedly in" : "missing from");
+
+	if (pkg != NULL)
+		pkgconf_pkg_unref(client, pkg);
+
+	return ret;
+}
+
+static bool
+test_clone_shared(const char *dir)
+{
+	pkgconf_client_t *parent = clone_client_new(dir);
+	pkgconf_pkg_t *pkg = clone_find(parent, "foo");
+	pkgconf_client_t *clone;
+	bool ret = true;
+
+	if (pkg->flags & PKGCONF_PKG_PROPF_SHARED)
+	{
+		fprintf(stderr, "foo is shared before cloning\n");
+		ret = false;
+	}
+
+	/* cloning turns the packages in the cache of the parent into shared packages */
+	clone = pkgconf_client_clone(parent);
+
+	if (!(pkg->flags & PKGCONF_PKG_PROPF_SHARED))
+	{
+		fprintf(stderr, "foo is not shared after cloning\n");
+		ret = false;
+	}
+
+	ret = clone_check_cached("clone", clone, "foo", pkg) && ret;
+
+	/* the clone keeps its own reference once the parent is gone */
+	pkgconf_pkg_unref(parent, pkg);
+	pkgconf_client_free(parent);
+
+	pkg = clone_find(clone, "foo");
+	if (strcmp(pkg->id, "foo"))
+	{
+		fprintf(stderr, "foo was released with the parent\n");
+		ret = false;
+	}
+
+	pkgconf_pkg_unref(clone, pkg);
+	pkgconf_client_free(clone);
+
+	return ret;
+}
+
+static bool
+test_clone_isolated(const char *dir)
+{
+	pkgconf_client_t *parent = clone_client_new(dir);
+	pkgconf_client_t *clone = pkgconf_client_clone(parent);
+	pkgconf_pkg_t *bar, *baz;
+	bool ret;
+
+	/* packages loaded after cloning stay private to the client which loaded them */
+	bar = clone_find(parent, "bar");
+	baz = clone_find(clone, "baz");
+
+	ret = clone_check_cached("parent", parent, "bar", bar);
+	ret = clone_check_cached("clone", clone, "bar", NULL) && ret;
+	ret = clone_check_cached("clone", clone, "baz", baz) && ret;
+	ret = clone_check_cached("parent", parent, "baz", NULL) && ret;
+
+	if ((bar->flags | baz->flags) & PKGCONF_PKG_PROPF_SHARED)
+	{
+		fprintf(stderr, "a package loaded after cloning is shared\n");
+		ret = false;
+	}
+
+	pkgconf_pkg_unref(parent, bar);
+	pkgconf_pkg_unref(clone, baz);
+	pkgconf_client_free(clone);
+	pkgconf_client_free(parent);
+
+	return ret;
+}
+
+/*
+ * traverse tests: DIR has to contain conflicts.pc, which conflicts with foo, and bar.pc, which
+ * requires foo.  the test walks the closure of both and checks that no package is visited when
+ * it conflicts, and that all of them are when conflicts are skipped.
+ */
+
+static void
+traverse_count_visit(const pkgconf_query_t *query, pkgconf_pkg_t *pkg, void *data)
+{
+	size_t *visits = data;
+
+	(void) query;
+	(void) pkg;
+
+	(*visits)++;
+}
+
+static bool
+traverse_check(pkgconf_client_t *client, unsigned int flags, unsigned int expected_eflags, bool expect_visits)
+{
+	pkgconf_list_t queue = PKGCONF_LIST_INITIALIZER;
+	pkgconf_pkg_t world = {
+		.id = "virtual:world",
+		.realname = "virtual world package",
+		.flags = PKGCONF_PKG_PROPF_STATIC | PKGCONF_PKG_PROPF_VIRTUAL,
+	};
+	pkgconf_query_t query;
+	unsigned int eflags;
+	size_t visits = 0;
+	bool ret = true;
+
+	pkgconf_query_init(&query, client, flags);
+	pkgconf_queue_push(&queue, "conflicts");
+	pkgconf_queue_push(&queue, "bar");
+	pkgconf_queue_compile(client, &world, &queue);
+
+	eflags = pkgconf_pkg_traverse(&query, &world, traverse_count_visit, &visits, -1);
+	if (eflags != expected_eflags)
+	{
+		fprintf(stderr, "flags %x: traverse returned %x, expected %x\n", flags, eflags, expected_eflags);
+		ret = false;
+	}
+
+	if ((visits > 0) != expect_visits)
+	{
+		fprintf(stderr, "flags %x: %zu packages visited\n", flags, visits);
+		ret = false;
+	}
+
+	pkgconf_dependency_free(&world.requires);
+	pkgconf_queue_free(&queue);
+
+	return ret;
+}
+
+static bool
+test_traverse_conflicts(const char *dir)
+{
+	pkgconf_client_t *client = pkgconf_client_new(pkgconf_default_error_handler, NULL);
+	bool ret;
+
+	pkgconf_path_add(dir, &client->dir_list, true);
+
+	ret = traverse_check(client, 0, PKGCONF_PKG_ERRF_PACKAGE_CONFLICT, false);
+	ret = traverse_check(client, PKGCONF_PKG_PKGF_SKIP_CONFLICTS, PKGCONF_PKG_ERRF_OK, true) && ret;
+
+	pkgconf_client_free(client);
+
+	return ret;
+}
+
+/*
+ * threads test: every package found in DIR, which may list several directories like PKG_CONFIG_PATH,
+ * is first resolved on the main thread, then THREADS_COUNT threads resolve all of them again
+ * THREADS_ITERATIONS times, each package with a fresh client.  the second of every three iterations
+ * uses clones of a client which already loaded every package instead of new clients, and the third
+ * one shares that client between all threads, resolving every package both with the flags of the
+ * client and with the flags of --static.  every result has to match the one computed on the main
+ * thread, and every client which could not find a package has to print the hint about
+ * PKG_CONFIG_PATH exactly once.
+ */
+
+#define THREADS_COUNT		8
+#define THREADS_ITERATIONS	10
+#define THREADS_MISSING_PACKAGE	"test-api-missing-package"
+#define THREADS_STATIC_FLAGS	(PKGCONF_PKG_PKGF_SEARCH_PRIVATE | PKGCONF_PKG_PKGF_MERGE_PRIVATE_FRAGMENTS)
+
+typedef struct {
+	char **packages;
+	char **expected;
+	char **expected_static;
+	size_t npackages;
+
+	/* the client which computed the expected results, shared by all threads on every third iteration */
+	pkgconf_client_t *shared;
+
+	const char *dir;
+} threads_stress_t;
+
+static bool
+threads_error_handler(const char *msg, const pkgconf_client_t *client, const void *data)
+{
+	/* the handler data is the notice counter of the client */
+	size_t *notices = (size_t *) data;
+	(void) client;
+
+	if (strstr(msg, "PKG_CONFIG_PATH") != NULL)
+		(*notices)++;
+
+	return true;
+}
+
+static pkgconf_client_t *
+threads_client_new(const threads_stress_t *stress, size_t *notices)
+{
+	pkgconf_client_t *client = pkgconf_client_new(threads_error_handler, notices);
+
+	pkgconf_path_split(stress->dir, &client->dir_list, true);
+
+	return client;
+}
+
+/*
+ * threads_resolve(client, flags, package)
+ *
+ * resolve a package with the given query flags and render its dependencies, CFLAGS and LIBS to
+ * a string, or describe why it could not be resolved.
+ */
+static char *
+threads_resolve(pkgconf_client_t *client, unsigned int flags, const char *package)
+{
+	pkgconf_query_t query;
+	pkgconf_list_t queue = PKGCONF_LIST_INITIALIZER;
+	pkgconf_list_t cflags = PKGCONF_LIST_INITIALIZER;
+	pkgconf_list_t libs = PKGCONF_LIST_INITIALIZER;
+	pkgconf_pkg_t world = {
+		.id = "virtual:world",
+		.realname = "virtual world package",
+		.flags = PKGCONF_PKG_PROPF_STATIC | PKGCONF_PKG_PROPF_VIRTUAL,
+	};
+	char buf[PKGCONF_BUFSIZE * 4];
+	char *cflags_str, *libs_str;
+	unsigned int eflags;
+	pkgconf_node_t *n;
+
+	pkgconf_query_init(&query, client, flags);
+	pkgconf_queue_push(&queue, package);
+
+	if (!pkgconf_queue_solve(&query, &queue, &world, -1))
+	{
+		pkgconf_dependency_free(&world.requires);
+		pkgconf_queue_free(&queue);
+		return strdup("(unsolvable)");
+	}
+
+	pkgconf_strlcpy(buf, "requires:", sizeof buf);
+	PKGCONF_FOREACH_LIST_ENTRY(world.requires.head, n)
+	{
+		char depbuf[PKGCONF_BUFSIZE];
+
+		pkgconf_strlcat(buf, " ", sizeof buf);
+		pkgconf_strlcat(buf, pkgconf_dependency_to_str_r(n->data, depbuf, sizeof depbuf), sizeof buf);
+	}
+
+	eflags = pkgconf_pkg_collect(&query, &world, &cflags, &libs, -1);
+	if (eflags != PKGCONF_PKG_ERRF_OK)
+	{
+		snprintf(buf, sizeof buf, "(collect failed: %x)", eflags);
+	}
+	else
+	{
+		cflags_str = pkgconf_fragment_render(&cflags, true);
+		libs_str = pkgconf_fragment_render(&libs, true);
+
+		pkgconf_strlcat(buf, "\ncflags: ", sizeof buf);
+		pkgconf_strlcat(buf, cflags_str, sizeof buf);
+		pkgconf_strlcat(buf, "\nlibs: ", sizeof buf);
+		pkgconf_strlcat(buf, libs_str, sizeof buf);
+
+		free(cflags_str);
+		free(libs_str);
+	}
+
+	pkgconf_fragment_free(&cflags);
+	pkgconf_fragment_free(&libs);
+	pkgconf_dependency_free(&world.requires);
+	pkgconf_queue_free(&queue);
+
+	return strdup(buf);
+}
+
+static bool
+threads_collect_package(const pkgconf_pkg_t *pkg, void *data)
+{
+	threads_stress_t *stress = data;
+
+	stress->packages = realloc(stress->packages, (stress->npackages + 1) * sizeof(char *));
+	stress->packages[stress->npackages++] = strdup(pkg->id);
+
+	return false;
+}
+
+typedef struct {
+	const threads_stress_t *stress;
+	pkgconf_thread_t thread;
+	size_t failures;
+
+	/* a clone of the client which computed the expected results, with every package in its cache */
+	pkgconf_client_t *parent;
+} threads_worker_t;
+
+static void
+threads_check_result(threads_worker_t *worker, const char *package, char *result, const char *expected)
+{
+	if (strcmp(result, expected))
+	{
+		fprintf(stderr, "%s: got:\n%s\nexpected:\n%s\n", package, result, expected);
+		worker->failures++;
+	}
+
+	free(result);
+}
+
+static pkgconf_client_t *
+threads_worker_client(threads_worker_t *worker, int iteration, size_t *notices)
+{
+	pkgconf_client_t *client;
+
+	if (iteration % 3 == 0)
+		return threads_client_new(worker->stress, notices);
+
+	client = pkgconf_client_clone(worker->parent);
+	pkgconf_client_set_error_handler(client, threads_error_handler, notices);
+
+	return client;
+}
+
+static PKGCONF_THREAD_FUNC
+threads_worker(void *arg)
+{
+	threads_worker_t *worker = arg;
+	const threads_stress_t *stress = worker->stress;
+	int iteration;
+	size_t i;
+
+	for (iteration = 0; iteration < THREADS_ITERATIONS; iteration++)
+	{
+		pkgconf_client_t *client = stress->shared;
+		unsigned int flags = pkgconf_client_get_flags(client);
+		size_t notices = 0;
+
+		/* the shared client is only ever read from, whatever the flags of the queries made on it */
+		if (iteration % 3 == 2)
+		{
+			for (i = 0; i < stress->npackages; i++)
+			{
+				threads_check_result(worker, stress->packages[i], threads_resolve(client, flags, stress->packages[i]), stress->expected[i]);
+				threads_check_result(worker, stress->packages[i], threads_resolve(client, flags | THREADS_STATIC_FLAGS, stress->packages[i]), stress->expected_static[i]);
+			}
+
+			continue;
+		}
+
+		for (i = 0; i < stress->npackages; i++)
+		{
+			client = threads_worker_client(worker, iteration, &notices);
+			threads_check_result(worker, stress->packages[i], threads_resolve(client, flags, stress->packages[i]), stress->expected[i]);
+			pkgconf_client_free(client);
+		}
+
+		/* a client has to give its hint once, no matter how many other clients already gave theirs */
+		notices = 0;
+		client = threads_worker_client(worker, iteration, &notices);
+
+		for (i = 0; i < 2; i++)
+			free(threads_resolve(client, flags, THREADS_MISSING_PACKAGE));
+
+		if (notices != 1)
+		{
+			fprintf(stderr, "%s: the PKG_CONFIG_PATH hint was given %zu times\n", THREADS_MISSING_PACKAGE, notices);
+			worker->failures++;
+		}
+
+		pkgconf_client_free(client);
+	}
+
+	return 0;
+}
+
+static bool
+test_threads(const char *dir)
+{
+	threads_stress_t stress = {
+		.dir = dir,
+	};
+	threads_worker_t workers[THREADS_COUNT] = {{0}};
+	pkgconf_client_t *client;
+	unsigned int flags;
+	size_t notices = 0;
+	size_t failures = 0;
+	size_t i;
+
+	/* the reference results, which also load every package the queries made by the threads can reach */
+	client = threads_client_new(&stress, &notices);
+	flags = pkgconf_client_get_flags(client);
+	pkgconf_scan_all(client, &stress, threads_collect_package);
+
+	stress.expected = calloc(stress.npackages ? stress.npackages : 1, sizeof(char *));
+	stress.expected_static = calloc(stress.npackages ? stress.npackages : 1, sizeof(char *));
+	for (i = 0; i < stress.npackages; i++)
+	{
+		stress.expected[i] = threads_resolve(client, flags, stress.packages[i]);
+		stress.expected_static[i] = threads_resolve(client, flags | THREADS_STATIC_FLAGS, stress.packages[i]);
+	}
+
+	stress.shared = client;
+
+	for (i = 0; i < THREADS_COUNT; i++)
+		workers[i].parent = pkgconf_client_clone(client);
+
+	for (i = 0; i < THREADS_COUNT; i++)
+	{
+		workers[i].stress = &stress;
+
+		if (!pkgconf_thread_create(&workers[i].thread, threads_worker, &workers[i]))
+		{
+			fprintf(stderr, "could not start thread %zu\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < THREADS_COUNT; i++)
+	{
+		pkgconf_thread_join(workers[i].thread);
+		failures += workers[i].failures;
+
+		pkgconf_client_free(workers[i].parent);
+	}
+
+	pkgconf_client_free(client);
+
+	for (i = 0; i < stress.npackages; i++)
+	{
+		free(stress.packages[i]);
+		free(stress.expected[i]);
+		free(stress.expected_static[i]);
+	}
+
+	free(stress.packages);
+	free(stress.expected);
+	free(stress.expected_static);
+
+	if (failures)
+		fprintf(stderr, "%zu failures resolving %zu packages\n", failures, stress.npackages);
+
+	return stress.npackages > 0 && failures == 0;
+}
+
+static const test_t tests[] = {
+	{"pool-shared", test_pool_shared},
+	{"pool-sysroot", test_pool_sysroot},
+	{"pool-globals", test_pool_globals},
+	{"pool-mtime", test_pool_mtime},
+	{"watch-client", test_watch_client},
+	{"watch-pool", test_watch_pool},
+	{"trace-ring", test_trace_ring},
+	{"trace-format", test_trace_format},
+	{"trace-overflow", test_trace_overflow},
+	{"trace-levels", test_trace_levels},
+	{"clone-shared", test_clone_shared},
+	{"clone-isolated", test_clone_isolated},
+	{"traverse-conflicts", test_traverse_conflicts},
+	{"threads", test_threads},
+};
+
+int
+main(int argc, char *argv[])
+{
+	size_t i;
+
+	for (i = 0; argc == 3 && i < PKGCONF_ARRAY_SIZE(tests); i++)
+	{
+		if (strcmp(argv[1], tests[i].name))
+			continue;
+
+		return tests[i].func(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "usage: %s TEST DIR\n", argv[0]);
+	fprintf(stderr, "tests:");
+	for (i = 0; i < PKGCONF_ARRAY_SIZE(tests); i++)
+		fprintf(stderr, " %s", tests[i].name);
+	fprintf(stderr, "\n");
+
+	return EXIT_FAILURE;
+}